@@ -28,6 +28,7 @@
 
 #include "json_adapter.h"
 #include "msgpack_adapter.h"
+#include "kis_httpd_eventstream.h"
 
 Alertracker::Alertracker(GlobalRegistry *in_globalreg) :
     Kis_Net_Httpd_Stream_Handler(in_globalreg) {
@@ -45,6 +46,8 @@ Alertracker::Alertracker(GlobalRegistry *in_globalreg) :
         static_pointer_cast<Packetchain>(globalreg->FetchGlobal("PACKETCHAIN"));
     entrytracker =
         static_pointer_cast<EntryTracker>(globalreg->FetchGlobal("ENTRY_TRACKER"));
+    eventstream =
+        static_pointer_cast<Kis_Httpd_Eventstream>(globalreg->FetchGlobal("HTTPD_EVENTSTREAM"));
 
 	if (globalreg->kismet_config->FetchOpt("alertbacklog") != "") {
 		int scantmp;
@@ -97,6 +100,10 @@ Alertracker::Alertracker(GlobalRegistry *in_globalreg) :
 
 	
 	_MSG("Created alert tracker...", MSGFLAG_INFO);
+
+	Httpd_RegisterRoute("GET", "/alerts/definitions.*");
+	Httpd_RegisterRoute("GET", "/alerts/all_alerts.*");
+	Httpd_RegisterRoute("GET", "/alerts/last-time/:ts/:file");
 }
 
 Alertracker::~Alertracker() {
@@ -264,6 +271,15 @@ int Alertracker::RaiseAlert(int in_ref, kis_packet *in_pack,
 		acomp->alert_vec.push_back(info);
 	}
 
+	if (eventstream != NULL && eventstream->HasSubscribers(KIS_EVENTSTREAM_TOPIC_ALERT)) {
+		shared_ptr<tracked_alert> ta(new tracked_alert(globalreg, alert_entry_id));
+		ta->from_alert_info(info);
+		eventstream->Publish(KIS_EVENTSTREAM_TOPIC_ALERT, ta);
+	}
+
+	if (httpd != NULL)
+		httpd->NotifyLongPoll("alerts");
+
 	// Send the text info
 	_MSG(info->header + " " + info->text, MSGFLAG_ALERT);
 
@@ -407,6 +423,35 @@ bool Alertracker::Httpd_VerifyPath(const char *path, const char *method) {
     return false;
 }
 
+string Alertracker::Httpd_LongPollTopic(const char *url, const char *method) {
+    if (strcmp(method, "GET") != 0)
+        return "";
+
+    vector<string> tokenurl = StrTokenize(url, "/");
+
+    if (tokenurl.size() == 5 && tokenurl[1] == "alerts" && 
+            tokenurl[2] == "last-time")
+        return "alerts";
+
+    return "";
+}
+
+bool Alertracker::Httpd_LongPollReady(const char *url) {
+    vector<string> tokenurl = StrTokenize(url, "/");
+
+    long lastts;
+    if (tokenurl.size() < 4 || sscanf(tokenurl[3].c_str(), "%ld", &lastts) != 1)
+        return true;
+
+    local_locker lock(&alert_mutex);
+
+    // The backlog is in time order
+    if (alert_backlog.size() == 0)
+        return false;
+
+    return alert_backlog[alert_backlog.size() - 1]->tm.tv_sec > lastts;
+}
+
 void Alertracker::Httpd_CreateStreamResponse(
         Kis_Net_Httpd *httpd __attribute__((unused)),
         Kis_Net_Httpd_Connection *connection,
@@ -290,6 +290,8 @@ protected:
 
 typedef shared_ptr<tracked_alert_definition> shared_alert_def;
 
+class Kis_Httpd_Eventstream;
+
 class Alertracker : public Kis_Net_Httpd_Stream_Handler, public LifetimeGlobal {
 public:
 	// Simple struct from reading config lines
@@ -350,12 +352,19 @@ public:
             const char *url, const char *method, const char *upload_data,
             size_t *upload_data_size, std::stringstream &stream);
 
+    // Requests for alerts since a timestamp can wait for a new alert
+    virtual string Httpd_LongPollTopic(const char *url, const char *method);
+    virtual bool Httpd_LongPollReady(const char *url);
+
 protected:
     pthread_mutex_t alert_mutex;
 
     shared_ptr<Packetchain> packetchain;
     shared_ptr<EntryTracker> entrytracker;
 
+    // Alerts are pushed to event stream subscribers as they're raised
+    shared_ptr<Kis_Httpd_Eventstream> eventstream;
+
     int alert_vec_id, alert_entry_id, alert_timestamp_id, alert_def_id;
 
     // Check and age times
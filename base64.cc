@@ -32,6 +32,45 @@ void Base64::decodeblock(unsigned char *in, unsigned char *out) {
     out[3] = 0;
 }
 
+string Base64::encode(string in_str) {
+    string out;
+    unsigned int i;
+    uint32_t block;
+
+    out.reserve(((in_str.length() + 2) / 3) * 4);
+
+    for (i = 0; i + 2 < in_str.length(); i += 3) {
+        block = ((unsigned char) in_str[i] << 16) |
+            ((unsigned char) in_str[i + 1] << 8) |
+            (unsigned char) in_str[i + 2];
+
+        out += b64_values[(block >> 18) & 0x3F];
+        out += b64_values[(block >> 12) & 0x3F];
+        out += b64_values[(block >> 6) & 0x3F];
+        out += b64_values[block & 0x3F];
+    }
+
+    // Pad the remaining 1 or 2 bytes
+    if (i < in_str.length()) {
+        block = (unsigned char) in_str[i] << 16;
+
+        if (i + 1 < in_str.length())
+            block |= (unsigned char) in_str[i + 1] << 8;
+
+        out += b64_values[(block >> 18) & 0x3F];
+        out += b64_values[(block >> 12) & 0x3F];
+
+        if (i + 1 < in_str.length())
+            out += b64_values[(block >> 6) & 0x3F];
+        else
+            out += '=';
+
+        out += '=';
+    }
+
+    return out;
+}
+
 string Base64::decode(string in_str) {
     string out;
     unsigned char obuf[4], ibuf[4];
@@ -33,6 +33,9 @@ public:
     /* Decode a string; return raw data if it was valid */
     static string decode(string in_str);
 
+    /* Encode raw data, with padding */
+    static string encode(string in_str);
+
     // Convert 4 6-bit b64 characters into 3 8-bit standard bytes.
     // In and out must be able to hold the appropriate amount of data.
     static void decodeblock(unsigned char *in, unsigned char *out);
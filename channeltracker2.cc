@@ -57,6 +57,8 @@ Channeltracker_V2::Channeltracker_V2(GlobalRegistry *in_globalreg) :
         globalreg->timetracker->RegisterTimer(0, &trigger_tm, 0, this);
 
     pthread_mutex_init(&lock, NULL);
+
+    Httpd_RegisterRoute("GET", "/channels/channels.*");
 }
 
 Channeltracker_V2::~Channeltracker_V2() {
@@ -98,6 +100,14 @@ bool Channeltracker_V2::Httpd_VerifyPath(const char *path, const char *method) {
     return false;
 }
 
+uint64_t Channeltracker_V2::Httpd_ContentGeneration(const char *path, 
+        const char *method) {
+    if (!Httpd_VerifyPath(path, method))
+        return 0;
+
+    return globalreg->timestamp.tv_sec;
+}
+
 void Channeltracker_V2::Httpd_CreateStreamResponse(
         Kis_Net_Httpd *httpd __attribute__((unused)),
         Kis_Net_Httpd_Connection *connection __attribute__((unused)),
@@ -57,7 +57,7 @@ public:
         return SharedTrackerElement(new Channeltracker_V2_Channel(globalreg, get_id()));
     }
 
-    __Proxy(channel, string, string, string, channel);
+    __ProxyInterned(channel, channel);
     __Proxy(frequency, double, double, double, frequency);
 
     typedef kis_tracked_rrd<> uint64_rrd;
@@ -183,6 +183,9 @@ public:
             const char *url, const char *method, const char *upload_data,
             size_t *upload_data_size, std::stringstream &stream);
 
+    // Channel records are kept at one second resolution
+    virtual uint64_t Httpd_ContentGeneration(const char *url, const char *method);
+
     // Timetracker API
     virtual int timetracker_event(int event_id);
 
@@ -155,6 +155,9 @@ Datasourcetracker::Datasourcetracker(GlobalRegistry *in_globalreg) :
     error_vec =
         entrytracker->RegisterAndGetField("kismet.Datasourcetracker.errordatasources",
                 TrackerVector, "Errored Datasources");
+
+    Httpd_RegisterRoute("GET", "/datasource/all_sources.msgpack");
+    Httpd_RegisterRoute("GET", "/datasource/supported_sources.msgpack");
 }
 
 Datasourcetracker::~Datasourcetracker() {
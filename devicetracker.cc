@@ -31,6 +31,7 @@
 #include <string>
 #include <sstream>
 #include <pthread.h>
+#include <unistd.h>
 
 #include "globalregistry.h"
 #include "util.h"
@@ -38,6 +39,7 @@
 #include "messagebus.h"
 #include "packetchain.h"
 #include "devicetracker.h"
+#include "kis_httpd_eventstream.h"
 #include "packet.h"
 #include "gps_manager.h"
 #include "alertracker.h"
@@ -58,15 +60,16 @@ int Devicetracker_packethook_commontracker(CHAINCALL_PARMS) {
 	return ((Devicetracker *) auxdata)->CommonTracker(in_pack);
 }
 
+// Runs after every tracker, so that phy-specific changes to a device are 
+// complete before cached responses are invalidated
+int Devicetracker_packethook_generation(CHAINCALL_PARMS) {
+    ((Devicetracker *) auxdata)->BumpContentGeneration();
+    return 1;
+}
+
 Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
     Kis_Net_Httpd_Stream_Handler(in_globalreg) {
 
-    // Initialize as recursive to allow multiple locks in a single thread
-    pthread_mutexattr_t mutexattr;
-    pthread_mutexattr_init(&mutexattr);
-    pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_RECURSIVE);
-	pthread_mutex_init(&devicelist_mutex, &mutexattr);
-
 	globalreg = in_globalreg;
 
     entrytracker =
@@ -97,6 +100,12 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
     device_update_timestamp_id =
         entrytracker->RegisterField("kismet.devicelist.timestamp",
                 TrackerInt64, "device list timestamp");
+    device_update_generation_id =
+        entrytracker->RegisterField("kismet.devicelist.generation",
+                TrackerUInt64, "device list update generation");
+    device_delta_map_id =
+        entrytracker->RegisterField("kismet.devicelist.delta",
+                TrackerStringMap, "changed device fields, by device key");
 
     // These need unique IDs to be put in the map for serialization.
     // They also need unique field names, we can rename them with setlocalname
@@ -148,6 +157,11 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 	globalreg->packetchain->RegisterHandler(&Devicetracker_packethook_commontracker,
 											this, CHAINPOS_TRACKER, -100);
 
+    content_generation = 1;
+
+    globalreg->packetchain->RegisterHandler(&Devicetracker_packethook_generation,
+                                            this, CHAINPOS_LOGGING, -100);
+
 	// Create the global kistxt and kisxml logfiles
 	// new Dumpfile_Devicetracker(globalreg, "kistxt", "text");
 	// new Dumpfile_Devicetracker(globalreg, "kisxml", "xml");
@@ -179,6 +193,9 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
         device_idle_timer = -1;
     }
 
+    device_arena =
+        globalreg->kismet_config->FetchOptBoolean("tracker_device_arena", 0);
+
 	max_num_devices =
 		globalreg->kismet_config->FetchOptUInt("tracker_max_devices", 0);
 
@@ -197,19 +214,63 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 	}
 
     full_refresh_time = globalreg->timestamp.tv_sec;
+    full_refresh_generation = TrackerElement::current_generation();
+
+    newest_device_time = 0;
+
+    eventstream =
+        static_pointer_cast<Kis_Httpd_Eventstream>(globalreg->FetchGlobal("HTTPD_EVENTSTREAM"));
+    eventstream_generation = TrackerElement::next_generation();
+
+    if (eventstream != NULL)
+        eventstream_timer =
+            globalreg->timetracker->RegisterTimer(SERVER_TIMESLICES_SEC, NULL, 1, this);
+    else
+        eventstream_timer = -1;
+
+    // Default to one serialization thread per core
+    unsigned int serialize_threads =
+        globalreg->kismet_config->FetchOptUInt("tracker_serialize_threads", 0);
+
+    if (serialize_threads == 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        serialize_threads = ncpus > 0 ? ncpus : 1;
+    }
+
+    if (serialize_threads > 1)
+        serialize_pool = new devicetracker_serialize_pool(serialize_threads);
+    else
+        serialize_pool = NULL;
+
+    Httpd_RegisterRoute("GET", "/devices/all_devices.*");
+    Httpd_RegisterRoute("GET", "/devices/all_devices_dt.*");
+    Httpd_RegisterRoute("GET", "/phy/all_phys.*");
+    Httpd_RegisterRoute("GET", "/phy/all_phys_dt.*");
+    Httpd_RegisterRoute("GET", "/devices/by-key/:key/device.*/*");
+    Httpd_RegisterRoute("GET", "/devices/by-mac/:mac/:file");
+    Httpd_RegisterRoute("GET", "/devices/last-time/:ts/:file");
+    Httpd_RegisterRoute("GET", "/devices/delta/:gen/:file");
+    Httpd_RegisterRoute("GET", "/devices/columnar/devices.msgpack");
+    Httpd_RegisterRoute("POST", "/devices/summary/:file");
+    Httpd_RegisterRoute("POST", "/devices/columnar/devices.msgpack");
+    Httpd_RegisterRoute("POST", "/devices/last-time/:ts/:file");
+    Httpd_RegisterRoute("POST", "/devices/by-key/:key/set_name.*");
 }
 
 Devicetracker::~Devicetracker() {
-    pthread_mutex_lock(&devicelist_mutex);
+    devicelist_lock.lock();
 
     globalreg->devicetracker = NULL;
     globalreg->RemoveGlobal("DEVICE_TRACKER");
 
 	globalreg->packetchain->RemoveHandler(&Devicetracker_packethook_commontracker,
 										  CHAINPOS_TRACKER);
+    globalreg->packetchain->RemoveHandler(&Devicetracker_packethook_generation,
+                                          CHAINPOS_LOGGING);
 
     globalreg->timetracker->RemoveTimer(device_idle_timer);
 	globalreg->timetracker->RemoveTimer(max_devices_timer);
+    globalreg->timetracker->RemoveTimer(eventstream_timer);
 
     // TODO broken for now
     /*
@@ -224,7 +285,9 @@ Devicetracker::~Devicetracker() {
 
     tracked_vec.clear();
 
-    pthread_mutex_destroy(&devicelist_mutex);
+    delete(serialize_pool);
+
+    devicelist_lock.unlock();
 }
 
 void Devicetracker::SaveTags() {
@@ -278,7 +341,7 @@ string Devicetracker::FetchPhyName(int in_phy) {
 }
 
 int Devicetracker::FetchNumDevices(int in_phy) {
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
 	int r = 0;
 
@@ -371,10 +434,26 @@ int Devicetracker::RegisterPhyHandler(Kis_Phy_Handler *in_weak_handler) {
 
 void Devicetracker::UpdateFullRefresh() {
     full_refresh_time = globalreg->timestamp.tv_sec;
+    full_refresh_generation = TrackerElement::current_generation();
+    BumpContentGeneration();
+
+    if (httpd != NULL)
+        httpd->NotifyLongPoll("devices");
+}
+
+void Devicetracker::UpdateNewestDeviceTime(time_t in_time) {
+    // Only wake long-polling clients once per second of new activity
+    if (in_time <= newest_device_time)
+        return;
+
+    newest_device_time = in_time;
+
+    if (httpd != NULL)
+        httpd->NotifyLongPoll("devices");
 }
 
 shared_ptr<kis_tracked_device_base> Devicetracker::FetchDevice(uint64_t in_key) {
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
 	device_itr i = tracked_map.find(in_key);
 
@@ -390,7 +469,7 @@ shared_ptr<kis_tracked_device_base> Devicetracker::FetchDevice(mac_addr in_devic
 }
 
 int Devicetracker::CommonTracker(kis_packet *in_pack) {
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
 	kis_common_info *pack_common =
 		(kis_common_info *) in_pack->fetch(pack_comp_common);
@@ -486,7 +565,7 @@ int Devicetracker::CommonTracker(kis_packet *in_pack) {
 shared_ptr<kis_tracked_device_base> Devicetracker::UpdateCommonDevice(mac_addr in_mac,
         int in_phy, kis_packet *in_pack, unsigned int in_flags) {
 
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
     stringstream sstr;
 
@@ -512,7 +591,17 @@ shared_ptr<kis_tracked_device_base> Devicetracker::UpdateCommonDevice(mac_addr i
     key = DevicetrackerKey::MakeKey(in_mac, in_phy);
 
 	if ((device = FetchDevice(key)) == NULL) {
-        device.reset(new kis_tracked_device_base(globalreg, device_base_id));
+        TrackerArena *arena = NULL;
+
+        if (device_arena)
+            arena = TrackerArena::create();
+
+        {
+            TrackerArenaScope scope(arena);
+            device.reset(new kis_tracked_device_base(globalreg, device_base_id));
+        }
+
+        device->set_arena(arena);
 
         device->set_key(key);
         device->set_macaddr(in_mac);
@@ -528,6 +617,7 @@ shared_ptr<kis_tracked_device_base> Devicetracker::UpdateCommonDevice(mac_addr i
     }
 
     device->set_last_time(in_pack->ts.tv_sec);
+    UpdateNewestDeviceTime(in_pack->ts.tv_sec);
 
     if (in_flags & UCD_UPDATE_PACKETS) {
         device->inc_packets();
@@ -618,7 +708,7 @@ shared_ptr<kis_tracked_device_base> Devicetracker::UpdateCommonDevice(mac_addr i
 int Devicetracker::PopulateCommon(shared_ptr<kis_tracked_device_base> device, 
         kis_packet *in_pack) {
 
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
 	kis_common_info *pack_common =
 		(kis_common_info *) in_pack->fetch(pack_comp_common);
@@ -657,6 +747,7 @@ int Devicetracker::PopulateCommon(shared_ptr<kis_tracked_device_base> device,
     device->get_packets_rrd()->add_sample(1, globalreg->timestamp.tv_sec);
 
     device->set_last_time(in_pack->ts.tv_sec);
+    UpdateNewestDeviceTime(in_pack->ts.tv_sec);
 
 	if (pack_common->error)
         device->inc_error_packets();
@@ -1669,7 +1760,7 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                     return false;
                 }
 
-                local_locker lock(&devicelist_mutex);
+                devicelist_scope_locker lock(this);
 
                 uint64_t key = 0;
                 std::stringstream ss(tokenurl[3]);
@@ -1706,7 +1797,7 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                 if (tokenurl.size() < 5)
                     return false;
 
-                local_locker lock(&devicelist_mutex);
+                devicelist_scope_locker lock(this);
 
                 if (!Httpd_CanSerialize(tokenurl[4]))
                     return false;
@@ -1737,6 +1828,20 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                 }
 
                 return Httpd_CanSerialize(tokenurl[4]);
+            } else if (tokenurl[2] == "delta") {
+                if (tokenurl.size() < 5) {
+                    return false;
+                }
+
+                unsigned long long gen;
+                if (sscanf(tokenurl[3].c_str(), "%llu", &gen) != 1) {
+                    return false;
+                }
+
+                return Httpd_CanSerialize(tokenurl[4]);
+            } else if (tokenurl[2] == "columnar") {
+                // Columnar export is only available as msgpack
+                return tokenurl.size() == 4 && tokenurl[3] == "devices.msgpack";
             }
         }
     } else if (strcmp(method, "POST") == 0) {
@@ -1751,6 +1856,8 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
 
             } else if (tokenurl[2] == "summary") {
                 return Httpd_CanSerialize(tokenurl[3]);
+            } else if (tokenurl[2] == "columnar") {
+                return tokenurl[3] == "devices.msgpack";
             } else if (tokenurl[2] == "last-time") {
                 if (tokenurl.size() < 5) {
                     return false;
@@ -1767,7 +1874,7 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                     return false;
                 }
 
-                local_locker lock(&devicelist_mutex);
+                devicelist_scope_locker lock(this);
 
                 uint64_t key = 0;
                 std::stringstream ss(tokenurl[3]);
@@ -1827,9 +1934,10 @@ void Devicetracker::httpd_all_phys(string path, std::stringstream &stream,
 void Devicetracker::httpd_device_summary(string url, std::stringstream &stream, 
         shared_ptr<TrackerElementVector> subvec, 
         vector<SharedElementSummary> summary_vec,
-        string in_wrapper_key) {
+        string in_wrapper_key,
+        const devicetracker_projection *projection) {
 
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
     SharedTrackerElement devvec =
         globalreg->entrytracker->GetTrackedInstance(device_summary_base_id);
@@ -1847,9 +1955,14 @@ void Devicetracker::httpd_device_summary(string url, std::stringstream &stream,
         wrapper = devvec;
     }
 
+    if (projection != NULL && projection->empty())
+        projection = NULL;
+
     if (subvec == NULL) {
         for (unsigned int x = 0; x < tracked_vec.size(); x++) {
-            if (summary_vec.size() == 0) {
+            if (summary_vec.size() == 0 && projection != NULL) {
+                devvec->add_vector(projection->apply(tracked_vec[x], rename_map));
+            } else if (summary_vec.size() == 0) {
                 devvec->add_vector(tracked_vec[x]);
             } else {
                 SharedTrackerElement simple;
@@ -1863,7 +1976,9 @@ void Devicetracker::httpd_device_summary(string url, std::stringstream &stream,
     } else {
         for (TrackerElementVector::const_iterator x = subvec->begin();
                 x != subvec->end(); ++x) {
-            if (summary_vec.size() == 0) {
+            if (summary_vec.size() == 0 && projection != NULL) {
+                devvec->add_vector(projection->apply(*x, rename_map));
+            } else if (summary_vec.size() == 0) {
                 devvec->add_vector(*x);
             } else {
                 SharedTrackerElement simple;
@@ -1879,8 +1994,405 @@ void Devicetracker::httpd_device_summary(string url, std::stringstream &stream,
     Httpd_Serialize(url, stream, wrapper, &rename_map);
 }
 
+uint64_t Devicetracker::Httpd_ContentGeneration(const char *url, const char *method) {
+    if (strcmp(method, "GET") != 0)
+        return 0;
+
+    string stripped = Httpd_StripSuffix(url);
+
+    if (stripped == "/devices/all_devices" || stripped == "/devices/all_devices_dt" ||
+            stripped == "/phy/all_phys" || stripped == "/phy/all_phys_dt")
+        return content_generation;
+
+    return 0;
+}
+
+int Devicetracker::Httpd_RequestClass(const char *url, const char *method) {
+    string stripped = Httpd_StripSuffix(url);
+
+    if (stripped == "/devices/all_devices" || stripped == "/devices/all_devices_dt" ||
+            stripped == "/phy/all_phys" || stripped == "/phy/all_phys_dt")
+        return KIS_HTTPD_CLASS_HEAVY;
+
+    // Last-time requests are left light; they're the normal way to poll for
+    // changes and may be held open waiting for new devices
+    vector<string> tokenurl = StrTokenize(url, "/");
+
+    if (tokenurl.size() >= 3 && tokenurl[1] == "devices") {
+        if (tokenurl[2] == "delta" || tokenurl[2] == "columnar")
+            return KIS_HTTPD_CLASS_HEAVY;
+
+        if (tokenurl[2] == "summary" && strcmp(method, "POST") == 0)
+            return KIS_HTTPD_CLASS_HEAVY;
+    }
+
+    return KIS_HTTPD_CLASS_LIGHT;
+}
+
+string Devicetracker::Httpd_LongPollTopic(const char *url, const char *method) {
+    if (strcmp(method, "GET") != 0)
+        return "";
+
+    vector<string> tokenurl = StrTokenize(url, "/");
+
+    if (tokenurl.size() == 5 && tokenurl[1] == "devices" && 
+            tokenurl[2] == "last-time")
+        return "devices";
+
+    return "";
+}
+
+bool Devicetracker::Httpd_LongPollReady(const char *url) {
+    vector<string> tokenurl = StrTokenize(url, "/");
+
+    long lastts;
+    if (tokenurl.size() < 4 || sscanf(tokenurl[3].c_str(), "%ld", &lastts) != 1)
+        return true;
+
+    return newest_device_time > lastts || full_refresh_time > lastts;
+}
+
+bool Devicetracker::Httpd_StreamingResponse(const char *url, const char *method) {
+    if (strcmp(method, "GET") != 0)
+        return false;
+
+    if (Httpd_StripSuffix(url) != "/devices/all_devices")
+        return false;
+
+    shared_ptr<TrackerElementSerializer> serializer =
+        entrytracker->GetSerializer(Httpd_GetSuffix(url));
+
+    return serializer != NULL && serializer->can_stream_vector();
+}
+
+void Devicetracker::Httpd_CreateStreamingResponse(string url,
+        map<string, string> args, Kis_Net_Httpd_Buffer_Stream *stream) {
+
+    shared_ptr<TrackerElementSerializer> serializer =
+        entrytracker->GetSerializer(Httpd_GetSuffix(url));
+
+    if (serializer == NULL)
+        return;
+
+    devicetracker_projection projection(entrytracker);
+    projection.parse(args);
+
+    // Take a snapshot of the device list; the records stay valid even if
+    // they're removed from the tracker while we're sending them
+    vector<shared_ptr<kis_tracked_device_base> > devices;
+
+    {
+        devicelist_scope_locker lock(this);
+        devices = tracked_vec;
+    }
+
+    // Devices are serialized straight into the chunk which is handed to the
+    // response; it's cleared, not reallocated, between writes
+    string chunk;
+
+    serializer->stream_vector_open(chunk, devices.size());
+
+    // Large lists are split into ranges serialized concurrently by the pool,
+    // one window of ranges at a time, and written to the response in order
+    if (serialize_pool != NULL && devices.size() > DEVICETRACKER_SERIALIZE_RANGE) {
+        unsigned int nthreads = serialize_pool->get_num_threads();
+
+        vector<devicetracker_serialize_pool::job> jobs(nthreads);
+        vector<devicetracker_serialize_pool::job *> window;
+
+        size_t pos = 0;
+
+        while (pos < devices.size()) {
+            window.clear();
+
+            for (unsigned int t = 0; t < nthreads && pos < devices.size(); t++) {
+                jobs[t].serializer = serializer;
+                jobs[t].devices = &devices;
+                jobs[t].device_lock = &devicelist_lock;
+                jobs[t].projection = &projection;
+                jobs[t].start = pos;
+                jobs[t].end = std::min(pos + DEVICETRACKER_SERIALIZE_RANGE, 
+                        devices.size());
+                jobs[t].buffer.clear();
+                jobs[t].failed = false;
+
+                window.push_back(&(jobs[t]));
+
+                pos = jobs[t].end;
+            }
+
+            // Workers share the read side of the device list lock per device,
+            // so they run alongside each other and packet processing only
+            // waits for the devices in flight
+            serialize_pool->run(window);
+
+            if (chunk.length() != 0) {
+                if (!stream->write(chunk))
+                    return;
+
+                chunk.clear();
+            }
+
+            for (unsigned int w = 0; w < window.size(); w++) {
+                if (window[w]->failed)
+                    throw std::runtime_error("failed to serialize device list");
+
+                if (!stream->write(window[w]->buffer))
+                    return;
+            }
+
+            if (!stream->wait_drain())
+                return;
+        }
+    } else {
+        for (unsigned int x = 0; x < devices.size(); x++) {
+            if (x != 0)
+                serializer->stream_vector_separator(chunk);
+
+            // Only hold the device list for the duration of a single device, and
+            // never while waiting on the client
+            {
+                devicelist_scope_locker lock(this);
+
+                if (projection.empty()) {
+                    serializer->stream_serialize(devices[x], chunk);
+                } else {
+                    TrackerElementSerializer::rename_map rename_map;
+                    serializer->stream_serialize(projection.apply(devices[x], rename_map), 
+                            chunk, &rename_map);
+                }
+            }
+
+            if (!stream->write(chunk))
+                return;
+
+            chunk.clear();
+
+            if (!stream->wait_drain())
+                return;
+        }
+    }
+
+    serializer->stream_vector_close(chunk);
+
+    stream->write(chunk);
+}
+
+// Columns returned by a GET of the columnar export
+static const char *columnar_default_fields =
+    "[\"kismet.device.base.key\", "
+    "\"kismet.device.base.macaddr\", "
+    "\"kismet.device.base.phyname\", "
+    "\"kismet.device.base.first_time\", "
+    "\"kismet.device.base.last_time\", "
+    "\"kismet.device.base.packets.total\", "
+    "\"kismet.device.base.signal/kismet.common.signal.last_signal_dbm\", "
+    "\"kismet.device.base.channel\", "
+    "\"kismet.device.base.manuf\"]";
+
+// Width in bytes of a column of this type, or 0 if it can't be a column
+static unsigned int columnar_width(TrackerType in_type) {
+    switch (in_type) {
+        case TrackerInt8:
+        case TrackerUInt8:
+            return 1;
+        case TrackerInt16:
+        case TrackerUInt16:
+            return 2;
+        case TrackerInt32:
+        case TrackerUInt32:
+        case TrackerFloat:
+            return 4;
+        case TrackerInt64:
+        case TrackerUInt64:
+        case TrackerDouble:
+        case TrackerMac:
+            return 8;
+        case TrackerString:
+        case TrackerUuid:
+            // Index into the string dictionary
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// Append a little-endian value to a column
+static void columnar_put(string &in_col, uint64_t in_val, unsigned int in_width) {
+    for (unsigned int b = 0; b < in_width; b++)
+        in_col.push_back((char) ((in_val >> (b * 8)) & 0xFF));
+}
+
+void Devicetracker::httpd_columnar_export(std::stringstream &stream,
+        const vector<SharedElementSummary> &summary_vec) {
+
+    vector<TrackerType> col_types;
+    vector<unsigned int> col_widths;
+    vector<string> col_names;
+
+    for (unsigned int c = 0; c < summary_vec.size(); c++) {
+        const vector<int> &path = summary_vec[c]->resolved_path;
+
+        // Name errors after what was asked for; field_name is only known when
+        // the path resolved
+        string req_name = summary_vec[c]->path_name;
+        if (req_name.length() == 0)
+            req_name = summary_vec[c]->rename;
+
+        if (path.size() == 0 || 
+                std::find_if(path.begin(), path.end(), 
+                    [](int i) { return i < 0; }) != path.end())
+            throw std::runtime_error("Unknown field " + req_name);
+
+        TrackerType col_type = entrytracker->GetFieldType(path.back());
+
+        if (columnar_width(col_type) == 0)
+            throw std::runtime_error("Field " + req_name + 
+                    " can not be exported as a column");
+
+        col_types.push_back(col_type);
+        col_widths.push_back(columnar_width(col_type));
+
+        if (summary_vec[c]->rename.length() != 0)
+            col_names.push_back(summary_vec[c]->rename);
+        else
+            col_names.push_back(summary_vec[c]->field_name);
+    }
+
+    vector<string> col_data(summary_vec.size());
+
+    // Strings are stored once and referenced by index
+    map<string, uint32_t> dict_map;
+    vector<string> dict;
+
+    // Take a snapshot of the device list and only hold the lock while each
+    // device is read, the same as the streaming device list
+    vector<shared_ptr<kis_tracked_device_base> > devices;
+
+    {
+        devicelist_scope_locker lock(this);
+        devices = tracked_vec;
+    }
+
+    unsigned int nrows = devices.size();
+
+    for (unsigned int c = 0; c < col_data.size(); c++)
+        col_data[c].reserve(nrows * col_widths[c]);
+
+    for (unsigned int d = 0; d < nrows; d++) {
+        devicelist_scope_locker lock(this);
+
+        for (unsigned int c = 0; c < col_data.size(); c++) {
+            SharedTrackerElement e = 
+                GetTrackerElementPath(summary_vec[c]->resolved_path, devices[d]);
+
+            // Missing values are 0, or no dictionary entry for strings
+            if (e == NULL || e->get_type() != col_types[c]) {
+                if (col_types[c] == TrackerString || col_types[c] == TrackerUuid)
+                    columnar_put(col_data[c], (uint32_t) -1, 4);
+                else
+                    columnar_put(col_data[c], 0, col_widths[c]);
+                continue;
+            }
+
+            string sval;
+            float fval;
+            double dval;
+            uint32_t u32;
+            uint64_t u64;
+            map<string, uint32_t>::iterator di;
+
+            switch (col_types[c]) {
+                case TrackerInt8:
+                    columnar_put(col_data[c], GetTrackerValue<int8_t>(e), 1);
+                    break;
+                case TrackerUInt8:
+                    columnar_put(col_data[c], GetTrackerValue<uint8_t>(e), 1);
+                    break;
+                case TrackerInt16:
+                    columnar_put(col_data[c], GetTrackerValue<int16_t>(e), 2);
+                    break;
+                case TrackerUInt16:
+                    columnar_put(col_data[c], GetTrackerValue<uint16_t>(e), 2);
+                    break;
+                case TrackerInt32:
+                    columnar_put(col_data[c], GetTrackerValue<int32_t>(e), 4);
+                    break;
+                case TrackerUInt32:
+                    columnar_put(col_data[c], GetTrackerValue<uint32_t>(e), 4);
+                    break;
+                case TrackerInt64:
+                    columnar_put(col_data[c], GetTrackerValue<int64_t>(e), 8);
+                    break;
+                case TrackerUInt64:
+                    columnar_put(col_data[c], GetTrackerValue<uint64_t>(e), 8);
+                    break;
+                case TrackerFloat:
+                    fval = GetTrackerValue<float>(e);
+                    memcpy(&u32, &fval, 4);
+                    columnar_put(col_data[c], u32, 4);
+                    break;
+                case TrackerDouble:
+                    dval = GetTrackerValue<double>(e);
+                    memcpy(&u64, &dval, 8);
+                    columnar_put(col_data[c], u64, 8);
+                    break;
+                case TrackerMac:
+                    columnar_put(col_data[c], GetTrackerValue<mac_addr>(e).longmac, 8);
+                    break;
+                case TrackerString:
+                case TrackerUuid:
+                    if (col_types[c] == TrackerString)
+                        sval = GetTrackerValue<string>(e);
+                    else
+                        sval = GetTrackerValue<uuid>(e).UUID2String();
+
+                    di = dict_map.find(sval);
+                    if (di == dict_map.end()) {
+                        di = dict_map.insert(std::make_pair(sval, 
+                                    (uint32_t) dict.size())).first;
+                        dict.push_back(sval);
+                    }
+
+                    columnar_put(col_data[c], di->second, 4);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    MsgpackAdapter::MsgpackBuffer buffer;
+    msgpack::packer<MsgpackAdapter::MsgpackBuffer> o(buffer);
+
+    o.pack_map(3);
+
+    o.pack(string("kismet.columnar.rows"));
+    o.pack(nrows);
+
+    o.pack(string("kismet.columnar.dictionary"));
+    o.pack(dict);
+
+    o.pack(string("kismet.columnar.columns"));
+    o.pack_array(col_data.size());
+    for (unsigned int c = 0; c < col_data.size(); c++) {
+        o.pack_map(4);
+        o.pack(string("name"));
+        o.pack(col_names[c]);
+        o.pack(string("type"));
+        o.pack((int) col_types[c]);
+        o.pack(string("width"));
+        o.pack(col_widths[c]);
+        o.pack(string("data"));
+        o.pack_bin(col_data[c].length());
+        o.pack_bin_body(col_data[c].data(), col_data[c].length());
+    }
+
+    stream.write(buffer.str().data(), buffer.str().length());
+}
+
 void Devicetracker::httpd_xml_device_summary(std::stringstream &stream) {
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
     SharedTrackerElement devvec =
         globalreg->entrytracker->GetTrackedInstance(device_summary_base_id);
@@ -1961,14 +2473,24 @@ void Devicetracker::Httpd_CreateStreamResponse(
 
     string stripped = Httpd_StripSuffix(path);
 
+    // Field selection and exclusion from the query string
+    map<string, string> args;
+    Kis_Net_Httpd::GetArguments(connection, args);
+
+    devicetracker_projection projection(entrytracker);
+    projection.parse(args);
+
+    TrackerElementSerializer::rename_map rename_map;
+
     if (stripped == "/devices/all_devices") {
-        httpd_device_summary(path, stream, NULL, vector<SharedElementSummary>());
+        httpd_device_summary(path, stream, NULL, vector<SharedElementSummary>(),
+                "", &projection);
         return;
     }
 
     if (stripped == "/devices/all_devices_dt") {
         httpd_device_summary(path, stream, NULL, 
-                vector<SharedElementSummary>(), "aaData");
+                vector<SharedElementSummary>(), "aaData", &projection);
         return;
     }
 
@@ -2003,7 +2525,7 @@ void Devicetracker::Httpd_CreateStreamResponse(
             if (!Httpd_CanSerialize(tokenurl[4]))
                 return;
 
-            local_locker lock(&devicelist_mutex);
+            devicelist_scope_locker lock(this);
 
             uint64_t key = 0;
             std::stringstream ss(tokenurl[3]);
@@ -2044,7 +2566,8 @@ void Devicetracker::Httpd_CreateStreamResponse(
                     return;
                 }
 
-                Httpd_Serialize(tokenurl[4], stream, tmi->second);
+                Httpd_Serialize(tokenurl[4], stream, 
+                        projection.apply(tmi->second, rename_map), &rename_map);
 
                 return;
             } else {
@@ -2057,7 +2580,7 @@ void Devicetracker::Httpd_CreateStreamResponse(
             if (!Httpd_CanSerialize(tokenurl[4]))
                 return;
 
-            local_locker lock(&devicelist_mutex);
+            devicelist_scope_locker lock(this);
 
             mac_addr mac = mac_addr(tokenurl[3]);
 
@@ -2071,11 +2594,11 @@ void Devicetracker::Httpd_CreateStreamResponse(
             vector<shared_ptr<kis_tracked_device_base> >::iterator vi;
             for (vi = tracked_vec.begin(); vi != tracked_vec.end(); ++vi) {
                 if ((*vi)->get_macaddr() == mac) {
-                    devvec->add_vector((*vi));
+                    devvec->add_vector(projection.apply(*vi, rename_map));
                 }
             }
 
-            Httpd_Serialize(tokenurl[4], stream, devvec);
+            Httpd_Serialize(tokenurl[4], stream, devvec, &rename_map);
 
             return;
         } else if (tokenurl[2] == "last-time") {
@@ -2090,7 +2613,7 @@ void Devicetracker::Httpd_CreateStreamResponse(
             if (!Httpd_CanSerialize(tokenurl[4]))
                 return;
 
-            local_locker lock(&devicelist_mutex);
+            devicelist_scope_locker lock(this);
 
             SharedTrackerElement wrapper(new TrackerElement(TrackerMap));
 
@@ -2120,10 +2643,82 @@ void Devicetracker::Httpd_CreateStreamResponse(
             vector<shared_ptr<kis_tracked_device_base> >::iterator vi;
             for (vi = tracked_vec.begin(); vi != tracked_vec.end(); ++vi) {
                 if ((*vi)->get_last_time() > lastts)
-                    devvec->add_vector((*vi));
+                    devvec->add_vector(projection.apply(*vi, rename_map));
+            }
+
+            Httpd_Serialize(tokenurl[4], stream, wrapper, &rename_map);
+
+            return;
+        } else if (tokenurl[2] == "delta") {
+            if (tokenurl.size() < 5)
+                return;
+
+            // Generation token from the previous delta; 0 fetches everything
+            unsigned long long since;
+            if (sscanf(tokenurl[3].c_str(), "%llu", &since) != 1)
+                return;
+
+            if (!Httpd_CanSerialize(tokenurl[4]))
+                return;
+
+            devicelist_scope_locker lock(this);
+
+            // Take the token for the next request before looking at anything; 
+            // changes which race the serialization are sent again next time
+            uint64_t gen = TrackerElement::next_generation();
+
+            // A token from the future would filter out the wrapper itself
+            if (since >= gen)
+                since = gen - 1;
+
+            SharedTrackerElement wrapper(new TrackerElement(TrackerMap));
+
+            SharedTrackerElement refresh =
+                globalreg->entrytracker->GetTrackedInstance(device_update_required_id);
+
+            // Removed devices can't be expressed as a delta
+            if (since != 0 && since <= full_refresh_generation) {
+                refresh->set((uint8_t) 1);
+            } else {
+                refresh->set((uint8_t) 0);
+            }
+
+            wrapper->add_map(refresh);
+
+            SharedTrackerElement updategen =
+                globalreg->entrytracker->GetTrackedInstance(device_update_generation_id);
+            updategen->set((uint64_t) gen);
+
+            wrapper->add_map(updategen);
+
+            SharedTrackerElement devmap =
+                globalreg->entrytracker->GetTrackedInstance(device_delta_map_id);
+
+            wrapper->add_map(devmap);
+
+            vector<shared_ptr<kis_tracked_device_base> >::iterator vi;
+            for (vi = tracked_vec.begin(); vi != tracked_vec.end(); ++vi) {
+                if (since == 0 || (*vi)->modified_since(since))
+                    devmap->add_stringmap(ULongToString((*vi)->get_key()), 
+                            projection.apply(*vi, rename_map));
             }
 
-            Httpd_Serialize(tokenurl[4], stream, wrapper);
+            Httpd_SerializeDelta(tokenurl[4], stream, wrapper, since, &rename_map);
+
+            return;
+        } else if (tokenurl[2] == "columnar") {
+            vector<SharedElementSummary> summary_vec;
+
+            try {
+                SharedStructured fields(new StructuredJson(columnar_default_fields));
+                entrytracker->CompileSummaryFields(fields, summary_vec);
+                httpd_columnar_export(stream, summary_vec);
+            } catch (const std::exception& e) {
+                stream.str("");
+                stream << "Invalid request: " << e.what();
+                connection->httpcode = 400;
+                connection->response_headers["Content-Type"] = "text/plain";
+            }
 
             return;
         }
@@ -2132,7 +2727,7 @@ void Devicetracker::Httpd_CreateStreamResponse(
 }
 
 int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
     // Split URL and process
     vector<string> tokenurl = StrTokenize(concls->url, "/");
@@ -2219,29 +2814,7 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
         } else if (tokenurl[2] == "summary") {
             try {
                 SharedStructured fields = structdata->getStructuredByKey("fields");
-                StructuredData::structured_vec fvec = fields->getStructuredArray();
-
-                for (StructuredData::structured_vec::iterator i = fvec.begin(); 
-                        i != fvec.end(); ++i) {
-                    if ((*i)->isString()) {
-                        SharedElementSummary s(new TrackerElementSummary((*i)->getString(), entrytracker));
-                        summary_vec.push_back(s);
-                    } else if ((*i)->isArray()) {
-                        StructuredData::string_vec mapvec = (*i)->getStringVec();
-
-                        if (mapvec.size() != 2) {
-                            // fprintf(stderr, "debug - malformed rename pair\n");
-                            concls->response_stream << "Invalid request: "
-                                "Expected field, rename";
-                            concls->httpcode = 400;
-                            return 1;
-                        }
-
-                        SharedElementSummary s(new TrackerElementSummary(mapvec[0], 
-                                    mapvec[1], entrytracker));
-                        summary_vec.push_back(s);
-                    }
-                }
+                entrytracker->CompileSummaryFields(fields, summary_vec);
 
                 // Get the wrapper, if one exists, default to empty if it doesn't
                 wrapper_name = structdata->getKeyAsString("wrapper", "");
@@ -2566,6 +3139,20 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
             Httpd_Serialize(tokenurl[3], concls->response_stream, wrapper, &rename_map);
             return 1;
 
+        } else if (tokenurl[2] == "columnar") {
+            try {
+                SharedStructured fields = structdata->getStructuredByKey("fields");
+                entrytracker->CompileSummaryFields(fields, summary_vec);
+                httpd_columnar_export(concls->response_stream, summary_vec);
+            } catch (const std::exception& e) {
+                concls->response_stream.str("");
+                concls->response_stream << "Invalid request: ";
+                concls->response_stream << e.what();
+                concls->httpcode = 400;
+                concls->response_headers["Content-Type"] = "text/plain";
+            }
+
+            return MHD_YES;
         } else if (tokenurl[2] == "last-time") {
             if (tokenurl.size() < 5) {
                 // fprintf(stderr, "debug - couldn't parse ts\n");
@@ -2668,7 +3255,7 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
 }
 
 void Devicetracker::MatchOnDevices(DevicetrackerFilterWorker *worker) {
-    local_locker lock(&devicelist_mutex);
+    devicelist_scope_locker lock(this);
 
     map<uint64_t, shared_ptr<kis_tracked_device_base> >::iterator tmi;
 
@@ -2696,7 +3283,7 @@ bool devicetracker_sort_lastseen(shared_ptr<kis_tracked_device_base> a,
 
 int Devicetracker::timetracker_event(int eventid) {
     if (eventid == device_idle_timer) {
-        local_locker lock(&devicelist_mutex);
+        devicelist_scope_locker lock(this);
 
         time_t ts_now = globalreg->timestamp.tv_sec;
         bool purged = false;
@@ -2724,7 +3311,7 @@ int Devicetracker::timetracker_event(int eventid) {
             UpdateFullRefresh();
 
     } else if (eventid == max_devices_timer) {
-		local_locker lock(&devicelist_mutex);
+		devicelist_scope_locker lock(this);
 
 		// Do nothing if we don't care
 		if (max_num_devices <= 0)
@@ -2755,12 +3342,233 @@ int Devicetracker::timetracker_event(int eventid) {
 
 		// Clear them out of the vector
 		tracked_vec.erase(tracked_vec.begin(), tracked_vec.begin() + drop);
-	}
+	} else if (eventid == eventstream_timer) {
+        // Nobody is listening; just move the window forward so a new client
+        // doesn't get a backlog of every change since the last one left
+        if (!eventstream->HasSubscribers(KIS_EVENTSTREAM_TOPIC_DEVICE)) {
+            eventstream_generation = TrackerElement::next_generation();
+            eventstream_pending.clear();
+            return 1;
+        }
+
+        devicelist_scope_locker lock(this);
+
+        // Only look for new changes once everything from the last scan has
+        // gone out; until then they build up against the old generation and
+        // a device changed twice is only queued once
+        if (eventstream_pending.size() == 0) {
+            uint64_t since = eventstream_generation;
+            eventstream_generation = TrackerElement::next_generation();
+
+            for (unsigned int x = 0; x < tracked_vec.size(); x++) {
+                if (tracked_vec[x]->modified_since(since))
+                    eventstream_pending.push_back(tracked_vec[x]);
+            }
+        }
+
+        // Serializing happens on the main thread with the list locked, so
+        // cap it per tick instead of sending every change at once
+        SharedTrackerElement devvec =
+            globalreg->entrytracker->GetTrackedInstance(device_list_base_id);
+
+        for (unsigned int x = 0; x < DEVICETRACKER_EVENTSTREAM_BATCH && 
+                eventstream_pending.size() != 0; x++) {
+            devvec->add_vector(eventstream_pending.front());
+            eventstream_pending.pop_front();
+        }
+
+        if (TrackerElementVector(devvec).size() != 0)
+            eventstream->Publish(KIS_EVENTSTREAM_TOPIC_DEVICE, devvec, true);
+    }
 
     // Loop
     return 1;
 }
 
+void devicetracker_projection::parse(const map<string, string> &in_args) {
+    map<string, string>::const_iterator ai;
+
+    ai = in_args.find("fields");
+    if (ai != in_args.end()) {
+        vector<string> paths = StrTokenize(ai->second, ",");
+
+        for (unsigned int x = 0; x < paths.size(); x++) {
+            string p = StrStrip(paths[x]);
+
+            if (p.length() == 0)
+                continue;
+
+            SharedElementSummary s(new TrackerElementSummary(p, entrytracker));
+
+            // Skip paths which are only separators
+            if (s->resolved_path.size() == 0)
+                continue;
+
+            fields.push_back(s);
+        }
+    }
+
+    ai = in_args.find("exclude");
+    if (ai != in_args.end()) {
+        vector<string> paths = StrTokenize(ai->second, ",");
+
+        for (unsigned int x = 0; x < paths.size(); x++) {
+            vector<string> path = StrTokenize(StrStrip(paths[x]), "/");
+            vector<int> resolved;
+
+            for (unsigned int p = 0; p < path.size(); p++) {
+                if (path[p].length() == 0)
+                    continue;
+
+                int id = entrytracker->GetFieldId(path[p]);
+
+                // Unknown fields can't be present in the record anyway
+                if (id < 0) {
+                    resolved.clear();
+                    break;
+                }
+
+                resolved.push_back(id);
+            }
+
+            if (resolved.size() != 0)
+                exclude.push_back(resolved);
+        }
+    }
+}
+
+SharedTrackerElement devicetracker_projection::apply(SharedTrackerElement in_device,
+        TrackerElementSerializer::rename_map &rename_map) const {
+    SharedTrackerElement ret = ProjectTrackerElement(in_device, exclude);
+
+    if (fields.size() != 0) {
+        SharedTrackerElement simple;
+
+        // Selected fields are taken from the record with exclusions removed
+        SummarizeTrackerElement(entrytracker, ret, fields, simple, rename_map);
+
+        ret = simple;
+    }
+
+    return ret;
+}
+
+devicetracker_serialize_pool::devicetracker_serialize_pool(unsigned int in_threads) {
+    pthread_mutex_init(&pool_mutex, NULL);
+    pthread_cond_init(&work_cond, NULL);
+    pthread_cond_init(&done_cond, NULL);
+
+    shutdown = false;
+
+    for (unsigned int x = 0; x < in_threads; x++) {
+        pthread_t t;
+
+        if (pthread_create(&t, NULL, devicetracker_serialize_pool::worker_thread, 
+                    this) != 0)
+            break;
+
+        threads.push_back(t);
+    }
+}
+
+devicetracker_serialize_pool::~devicetracker_serialize_pool() {
+    pthread_mutex_lock(&pool_mutex);
+    shutdown = true;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (unsigned int x = 0; x < threads.size(); x++)
+        pthread_join(threads[x], NULL);
+
+    pthread_cond_destroy(&done_cond);
+    pthread_cond_destroy(&work_cond);
+    pthread_mutex_destroy(&pool_mutex);
+}
+
+void devicetracker_serialize_pool::run(vector<job *> &in_jobs) {
+    unsigned int remaining = in_jobs.size();
+
+    // If we couldn't start any workers do it all ourselves
+    if (threads.size() == 0) {
+        for (unsigned int x = 0; x < in_jobs.size(); x++)
+            process(in_jobs[x]);
+        return;
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+
+    for (unsigned int x = 0; x < in_jobs.size(); x++) {
+        in_jobs[x]->remaining = &remaining;
+        job_queue.push_back(in_jobs[x]);
+    }
+
+    pthread_cond_broadcast(&work_cond);
+
+    while (remaining > 0)
+        pthread_cond_wait(&done_cond, &pool_mutex);
+
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void devicetracker_serialize_pool::process(job *in_job) {
+    try {
+        for (size_t x = in_job->start; x < in_job->end; x++) {
+            if (x != 0)
+                in_job->serializer->stream_vector_separator(in_job->buffer);
+
+            // The snapshot keeps the record alive; the shared lock keeps it
+            // from changing while we serialize it, without excluding the
+            // other workers
+            local_shared_locker lock(in_job->device_lock);
+
+            if (in_job->projection == NULL || in_job->projection->empty()) {
+                in_job->serializer->stream_serialize((*(in_job->devices))[x], 
+                        in_job->buffer);
+            } else {
+                TrackerElementSerializer::rename_map rename_map;
+
+                in_job->serializer->stream_serialize(
+                        in_job->projection->apply((*(in_job->devices))[x], rename_map),
+                        in_job->buffer, &rename_map);
+            }
+        }
+    } catch (std::exception& e) {
+        in_job->failed = true;
+    }
+}
+
+void *devicetracker_serialize_pool::worker_thread(void *arg) {
+    devicetracker_serialize_pool *pool = (devicetracker_serialize_pool *) arg;
+
+    pthread_mutex_lock(&pool->pool_mutex);
+
+    while (1) {
+        while (!pool->shutdown && pool->job_queue.size() == 0)
+            pthread_cond_wait(&pool->work_cond, &pool->pool_mutex);
+
+        if (pool->shutdown)
+            break;
+
+        job *j = pool->job_queue.front();
+        pool->job_queue.pop_front();
+
+        pthread_mutex_unlock(&pool->pool_mutex);
+
+        pool->process(j);
+
+        pthread_mutex_lock(&pool->pool_mutex);
+
+        (*(j->remaining))--;
+
+        if (*(j->remaining) == 0)
+            pthread_cond_broadcast(&pool->done_cond);
+    }
+
+    pthread_mutex_unlock(&pool->pool_mutex);
+
+    return NULL;
+}
+
 void Devicetracker::usage(const char *name __attribute__((unused))) {
     printf("\n");
 	printf(" *** Device Tracking Options ***\n");
@@ -2769,22 +3577,11 @@ void Devicetracker::usage(const char *name __attribute__((unused))) {
 }
 
 void Devicetracker::lock_devicelist() {
-#ifdef HAVE_PTHREAD_TIMELOCK
-        struct timespec t;
-
-        clock_gettime(CLOCK_REALTIME , &t); 
-        t.tv_sec += 5; \
-
-        if (pthread_mutex_timedlock(&devicelist_mutex, &t) != 0) {
-            throw(std::runtime_error("mutex not available w/in 5 seconds"));
-        }
-#else
-        pthread_mutex_lock(&devicelist_mutex);
-#endif
+    devicelist_lock.lock();
 }
 
 void Devicetracker::unlock_devicelist() {
-    pthread_mutex_unlock(&devicelist_mutex);
+    devicelist_lock.unlock();
 }
 
 devicetracker_stringmatch_worker::devicetracker_stringmatch_worker(GlobalRegistry *in_globalreg,
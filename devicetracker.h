@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <time.h>
 #include <list>
+#include <deque>
 #include <map>
 #include <vector>
 #include <algorithm>
@@ -34,6 +35,7 @@
 #include <pthread.h>
 
 #include <stdexcept>
+#include <atomic>
 
 #ifdef HAVE_LIBPCRE
 #include <pcre.h>
@@ -65,6 +67,14 @@
 #define KIS_PHY_ANY	-1
 #define KIS_PHY_UNKNOWN -2
 
+// Number of devices serialized by one worker in a single job when exporting
+// device lists in parallel
+#define DEVICETRACKER_SERIALIZE_RANGE   256
+
+// Most changed devices pushed to event stream clients in one second; the rest
+// of a busy second goes out in the following ones
+#define DEVICETRACKER_EVENTSTREAM_BATCH 512
+
 // Helper for making keys
 //
 // Device keys are phy and runtime specific.
@@ -144,73 +154,92 @@ public:
     kis_tracked_device_base(GlobalRegistry *in_globalreg, int in_id) :
         tracker_component(in_globalreg, in_id) {
 
+        arena = NULL;
+
         register_fields();
         reserve_fields(NULL);
     }
 
     kis_tracked_device_base(GlobalRegistry *in_globalreg, int in_id,
             SharedTrackerElement e) : tracker_component(in_globalreg, in_id) {
+
+        arena = NULL;
         
         register_fields();
         reserve_fields(e);
     }
 
     virtual ~kis_tracked_device_base() {
+        if (arena != NULL)
+            arena->unref();
+    }
+
+    // Allocation arena this device was built in, if any.  Phy handlers building
+    // sub-records for the device should do so inside a TrackerArenaScope on it
+    // so the whole record stays together.
+    TrackerArena *get_arena() {
+        return arena;
+    }
 
+    // Takes over the caller's reference to the arena
+    void set_arena(TrackerArena *in_arena) {
+        if (arena != NULL)
+            arena->unref();
+        arena = in_arena;
     }
 
     virtual SharedTrackerElement clone_type() {
         return SharedTrackerElement(new kis_tracked_device_base(globalreg, get_id()));
     }
 
-    __Proxy(key, uint64_t, uint64_t, uint64_t, key);
+    __ProxyTyped(key, uint64_t, uint64_t, key);
 
-    __Proxy(macaddr, mac_addr, mac_addr, mac_addr, macaddr);
+    __ProxyTyped(macaddr, mac_addr, mac_addr, macaddr);
 
-    __Proxy(phyname, string, string, string, phyname);
+    __ProxyInterned(phyname, phyname);
 
     __Proxy(devicename, string, string, string, devicename);
     __Proxy(username, string, string, string, username);
 
-    __Proxy(type_string, string, string, string, type_string);
+    __ProxyInterned(type_string, type_string);
 
     __Proxy(basic_type_set, uint64_t, uint64_t, uint64_t, basic_type_set);
     __ProxyBitset(basic_type_set, uint64_t, basic_type_set);
 
-    __Proxy(crypt_string, string, string, string, crypt_string);
+    __ProxyInterned(crypt_string, crypt_string);
 
     __Proxy(basic_crypt_set, uint64_t, uint64_t, uint64_t, basic_crypt_set);
     void add_basic_crypt(uint64_t in) { (*basic_crypt_set) |= in; }
 
-    __Proxy(first_time, uint64_t, time_t, time_t, first_time);
-    __Proxy(last_time, uint64_t, time_t, time_t, last_time);
+    __ProxyTyped(first_time, time_t, time_t, first_time);
+    __ProxyTyped(last_time, time_t, time_t, last_time);
 
-    __Proxy(packets, uint64_t, uint64_t, uint64_t, packets);
-    __ProxyIncDec(packets, uint64_t, uint64_t, packets);
+    __ProxyTyped(packets, uint64_t, uint64_t, packets);
+    __ProxyTypedIncDec(packets, uint64_t, packets);
 
-    __Proxy(rx_packets, uint64_t, uint64_t, uint64_t, rx_packets);
-    __ProxyIncDec(rx_packets, uint64_t, uint64_t, rx_packets);
+    __ProxyTyped(rx_packets, uint64_t, uint64_t, rx_packets);
+    __ProxyTypedIncDec(rx_packets, uint64_t, rx_packets);
 
-    __Proxy(tx_packets, uint64_t, uint64_t, uint64_t, tx_packets);
-    __ProxyIncDec(tx_packets, uint64_t, uint64_t, tx_packets);
+    __ProxyTyped(tx_packets, uint64_t, uint64_t, tx_packets);
+    __ProxyTypedIncDec(tx_packets, uint64_t, tx_packets);
 
-    __Proxy(llc_packets, uint64_t, uint64_t, uint64_t, llc_packets);
-    __ProxyIncDec(llc_packets, uint64_t, uint64_t, llc_packets);
+    __ProxyTyped(llc_packets, uint64_t, uint64_t, llc_packets);
+    __ProxyTypedIncDec(llc_packets, uint64_t, llc_packets);
 
-    __Proxy(error_packets, uint64_t, uint64_t, uint64_t, error_packets);
-    __ProxyIncDec(error_packets, uint64_t, uint64_t, error_packets);
+    __ProxyTyped(error_packets, uint64_t, uint64_t, error_packets);
+    __ProxyTypedIncDec(error_packets, uint64_t, error_packets);
 
-    __Proxy(data_packets, uint64_t, uint64_t, uint64_t, data_packets);
-    __ProxyIncDec(data_packets, uint64_t, uint64_t, data_packets);
+    __ProxyTyped(data_packets, uint64_t, uint64_t, data_packets);
+    __ProxyTypedIncDec(data_packets, uint64_t, data_packets);
 
-    __Proxy(crypt_packets, uint64_t, uint64_t, uint64_t, crypt_packets);
-    __ProxyIncDec(crypt_packets, uint64_t, uint64_t, crypt_packets);
+    __ProxyTyped(crypt_packets, uint64_t, uint64_t, crypt_packets);
+    __ProxyTypedIncDec(crypt_packets, uint64_t, crypt_packets);
 
-    __Proxy(filter_packets, uint64_t, uint64_t, uint64_t, filter_packets);
-    __ProxyIncDec(filter_packets, uint64_t, uint64_t, filter_packets);
+    __ProxyTyped(filter_packets, uint64_t, uint64_t, filter_packets);
+    __ProxyTypedIncDec(filter_packets, uint64_t, filter_packets);
 
-    __Proxy(datasize, uint64_t, uint64_t, uint64_t, datasize);
-    __ProxyIncDec(datasize, uint64_t, uint64_t, datasize);
+    __ProxyTyped(datasize, uint64_t, uint64_t, datasize);
+    __ProxyTypedIncDec(datasize, uint64_t, datasize);
 
     typedef kis_tracked_rrd<> rrdt;
     __ProxyTrackable(packets_rrd, rrdt, packets_rrd);
@@ -230,10 +259,10 @@ public:
     __ProxyDynamicTrackable(packet_rrd_bin_jumbo, mrrdt, packet_rrd_bin_jumbo,
             packet_rrd_bin_jumbo_id);
 
-    __Proxy(channel, string, string, string, channel);
+    __ProxyInterned(channel, channel);
     __Proxy(frequency, double, double, double, frequency);
 
-    __Proxy(manuf, string, string, string, manuf);
+    __ProxyInterned(manuf, manuf);
 
     __Proxy(num_alerts, uint32_t, unsigned int, unsigned int, alert);
 
@@ -300,10 +329,10 @@ protected:
     virtual void register_fields() {
         tracker_component::register_fields();
 
-        RegisterField("kismet.device.base.key", TrackerUInt64,
+        RegisterField("kismet.device.base.key",
                 "unique integer key", &key);
 
-        RegisterField("kismet.device.base.macaddr", TrackerMac,
+        RegisterField("kismet.device.base.macaddr",
                 "mac address", &macaddr);
 
         RegisterField("kismet.device.base.phyname", TrackerString,
@@ -327,29 +356,29 @@ protected:
         RegisterField("kismet.device.base.basic_crypt_set", TrackerUInt64,
                 "bitset of basic encryption", &basic_crypt_set);
 
-        RegisterField("kismet.device.base.first_time", TrackerUInt64,
+        RegisterField("kismet.device.base.first_time",
                 "first time seen time_t", &first_time);
-        RegisterField("kismet.device.base.last_time", TrackerUInt64,
+        RegisterField("kismet.device.base.last_time",
                 "last time seen time_t", &last_time);
 
-        RegisterField("kismet.device.base.packets.total", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.total",
                 "total packets seen of all types", &packets);
-        RegisterField("kismet.device.base.packets.rx", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.rx",
                 "observed packets sent to device", &rx_packets);
-        RegisterField("kismet.device.base.packets.tx", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.tx",
                 "observed packets from device", &tx_packets);
-        RegisterField("kismet.device.base.packets.llc", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.llc",
                 "observed protocol control packets", &llc_packets);
-        RegisterField("kismet.device.base.packets.error", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.error",
                 "corrupt/error packets", &error_packets);
-        RegisterField("kismet.device.base.packets.data", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.data",
                 "data packets", &data_packets);
-        RegisterField("kismet.device.base.packets.crypt", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.crypt",
                 "data packets using encryption", &crypt_packets);
-        RegisterField("kismet.device.base.packets.filtered", TrackerUInt64,
+        RegisterField("kismet.device.base.packets.filtered",
                 "packets dropped by filter", &filter_packets);
 
-        RegisterField("kismet.device.base.datasize", TrackerUInt64,
+        RegisterField("kismet.device.base.datasize",
                 "transmitted data in bytes", &datasize);
 
         shared_ptr<kis_tracked_rrd<> > packets_rrd_builder(new kis_tracked_rrd<>(globalreg, 0));
@@ -472,11 +501,13 @@ protected:
         add_map(packet_rrd_bin_jumbo_id, packet_rrd_bin_jumbo);
     }
 
+    TrackerArena *arena;
+
     // Unique key
-    SharedTrackerElement key;
+    TrackedUInt64 key;
 
     // Mac address (probably the key, but could be different)
-    SharedTrackerElement macaddr;
+    TrackedMac macaddr;
 
     // Phy type (integer index)
     SharedTrackerElement phyname;
@@ -505,10 +536,11 @@ protected:
     SharedTrackerElement basic_crypt_set;
 
     // First and last seen
-    SharedTrackerElement first_time, last_time;
+    TrackedUInt64 first_time, last_time;
 
-    // Packet counts
-    SharedTrackerElement packets, tx_packets, rx_packets,
+    // Packet counts; these are updated for every packet so they're held as 
+    // typed values
+    TrackedUInt64 packets, tx_packets, rx_packets,
                    // link-level packets
                    llc_packets,
                    // known-bad packets
@@ -521,7 +553,7 @@ protected:
                    filter_packets;
 
     // Data seen in bytes
-    SharedTrackerElement datasize;
+    TrackedUInt64 datasize;
 
     // Packets and data RRDs
     int packets_rrd_id;
@@ -608,6 +640,89 @@ protected:
     pthread_mutex_t worker_mutex;
 };
 
+// Field selection and exclusion requested for a device endpoint, resolved to
+// field IDs once per request and applied to each device before serialization
+class devicetracker_projection {
+public:
+    devicetracker_projection(shared_ptr<EntryTracker> in_entrytracker) {
+        entrytracker = in_entrytracker;
+    }
+
+    // Parse the 'fields' and 'exclude' GET arguments, each a comma separated
+    // list of field paths
+    void parse(const map<string, string> &in_args);
+
+    bool empty() const {
+        return fields.size() == 0 && exclude.size() == 0;
+    }
+
+    // Produce the record to serialize in place of in_device; fields selected
+    // by path may be renamed, so the rename map has to be passed to the
+    // serializer
+    SharedTrackerElement apply(SharedTrackerElement in_device,
+            TrackerElementSerializer::rename_map &rename_map) const;
+
+    vector<SharedElementSummary> fields;
+    vector<vector<int> > exclude;
+
+protected:
+    shared_ptr<EntryTracker> entrytracker;
+};
+
+// Fixed pool of threads which serialize ranges of a device list into their own
+// buffers.  Workers take the read side of the job's device lock around each
+// device they serialize, so they run concurrently and the list is never held
+// for a whole range.
+class devicetracker_serialize_pool {
+public:
+    devicetracker_serialize_pool(unsigned int in_threads);
+    ~devicetracker_serialize_pool();
+
+    unsigned int get_num_threads() { return threads.size(); }
+
+    struct job {
+        job() : devices(NULL), device_lock(NULL), projection(NULL), start(0), 
+            end(0), failed(false), remaining(NULL) { }
+
+        shared_ptr<TrackerElementSerializer> serializer;
+        const vector<shared_ptr<kis_tracked_device_base> > *devices;
+
+        // Held shared while each device is serialized
+        kis_recursive_rwlock *device_lock;
+
+        const devicetracker_projection *projection;
+
+        // Range of devices [start, end) to serialize
+        size_t start, end;
+
+        // Devices in the range, each preceded by the serializer vector
+        // separator unless it's the first in the list, ready to be written
+        // to the response as-is
+        string buffer;
+        bool failed;
+
+        // Outstanding jobs in the batch this job belongs to
+        unsigned int *remaining;
+    };
+
+    // Run a batch of jobs, blocking until all of them have finished
+    void run(vector<job *> &in_jobs);
+
+protected:
+    static void *worker_thread(void *arg);
+    void process(job *in_job);
+
+    pthread_mutex_t pool_mutex;
+    pthread_cond_t work_cond, done_cond;
+
+    vector<pthread_t> threads;
+    deque<job *> job_queue;
+
+    bool shutdown;
+};
+
+class Kis_Httpd_Eventstream;
+
 class Devicetracker : public Kis_Net_Httpd_Stream_Handler,
     public TimetrackerEvent, public LifetimeGlobal {
 public:
@@ -717,6 +832,26 @@ public:
             size_t *upload_data_size, std::stringstream &stream);
 
     virtual int Httpd_PostComplete(Kis_Net_Httpd_Connection *concls);
+
+    // Device and phy lists change with every tracked packet
+    virtual uint64_t Httpd_ContentGeneration(const char *url, const char *method);
+
+    // Note that tracked devices have changed, invalidating cached responses
+    void BumpContentGeneration() {
+        content_generation++;
+    }
+
+    // Whole-list, summary, and columnar requests walk every device
+    virtual int Httpd_RequestClass(const char *url, const char *method);
+
+    // Requests for devices seen since a timestamp can wait for one to show up
+    virtual string Httpd_LongPollTopic(const char *url, const char *method);
+    virtual bool Httpd_LongPollReady(const char *url);
+
+    // The complete device list is streamed to the client one device at a time
+    virtual bool Httpd_StreamingResponse(const char *url, const char *method);
+    virtual void Httpd_CreateStreamingResponse(string url,
+            map<string, string> args, Kis_Net_Httpd_Buffer_Stream *stream);
     
     // Generate a list of all phys, serialized appropriately.  If specified,
     // wrap it in a dictionary and name it with the key in in_wrapper, which
@@ -727,15 +862,25 @@ public:
     // Generate a device summary, serialized.  Optionally provide an existing
     // vector to generate a summary of devices matching a given criteria via
     // a worker.  Also optionally, wrap the results in a dictionary named via
-    // the in_wrapper key, which is required for some js libs like datatables
+    // the in_wrapper key, which is required for some js libs like datatables.
+    // Without a summary, complete devices are sent through the projection, if
+    // there is one.
     void httpd_device_summary(string url, std::stringstream &stream, 
             shared_ptr<TrackerElementVector> subvec, 
             vector<SharedElementSummary> summary_vec,
-            string in_wrapper_key = "");
+            string in_wrapper_key = "",
+            const devicetracker_projection *projection = NULL);
 
     // TODO merge this into a normal serializer call
     void httpd_xml_device_summary(std::stringstream &stream);
 
+    // Export fields of all devices as columns of fixed-width values, in 
+    // msgpack.  Fields are resolved before walking the device list and no
+    // per-device records are built.
+    // MAY THROW std::runtime_error if a field can't be represented as a column
+    void httpd_columnar_export(std::stringstream &stream,
+            const vector<SharedElementSummary> &summary_vec);
+
     // Timetracker event handler
     virtual int timetracker_event(int eventid);
 
@@ -755,6 +900,7 @@ protected:
     int device_list_base_id, device_base_id, phy_base_id, phy_entry_id;
     int device_summary_base_id;
     int device_update_required_id, device_update_timestamp_id;
+    int device_update_generation_id, device_delta_map_id;
 
     int dt_length_id, dt_filter_id, dt_draw_id;
 
@@ -782,9 +928,35 @@ protected:
     unsigned int max_num_devices;
     int max_devices_timer;
 
+    // Devices changed since the last scan are queued and sent to event stream
+    // clients a batch a second; the next scan waits until the queue is empty
+    shared_ptr<Kis_Httpd_Eventstream> eventstream;
+    int eventstream_timer;
+    uint64_t eventstream_generation;
+    deque<shared_ptr<kis_tracked_device_base> > eventstream_pending;
+
+    // Build each new device record in its own TrackerArena
+    bool device_arena;
+
     // Timestamp for the last time we removed a device
     time_t full_refresh_time;
 
+    // Update generation of the last time we removed a device; delta clients
+    // holding an older token have to re-fetch the complete list
+    uint64_t full_refresh_generation;
+
+    // Generation of the device and phy list contents, for response caching
+    std::atomic<uint64_t> content_generation;
+
+    // Most recent last_time of any device, so long-polling clients can be
+    // woken when a device newer than they've seen appears
+    std::atomic<time_t> newest_device_time;
+    void UpdateNewestDeviceTime(time_t in_time);
+
+    // Workers for serializing large device lists, or NULL to serialize them
+    // in the requesting thread
+    devicetracker_serialize_pool *serialize_pool;
+
 	// Common device component
 	int devcomp_ref_common;
 
@@ -815,7 +987,10 @@ protected:
 	// Populate the common components of a device
 	int PopulateCommon(shared_ptr<kis_tracked_device_base> device, kis_packet *in_pack);
 
-    pthread_mutex_t devicelist_mutex;
+    // Writers, which is everything that touches the list or the devices
+    // except the serialize pool, take this exclusively and recursively
+    // through lock_devicelist; pool workers share the read side
+    kis_recursive_rwlock devicelist_lock;
 };
 
 class kis_tracked_phy : public tracker_component {
@@ -839,7 +1014,7 @@ public:
     }
 
     __Proxy(phy_id, int32_t, int32_t, int32_t, phy_id);
-    __Proxy(phy_name, string, string, string, phy_name);
+    __ProxyInterned(phy_name, phy_name);
     __Proxy(num_devices, uint64_t, uint64_t, uint64_t, num_devices);
     __Proxy(num_packets, uint64_t, uint64_t, uint64_t, num_packets);
     __Proxy(num_data_packets, uint64_t, uint64_t, uint64_t, num_data_packets);
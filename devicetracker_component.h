@@ -300,8 +300,10 @@ public:
         Aggregator agg;
 
         // printf("debug - rrd - preserialize\n");
-        // Update the averages
+        // Update the averages.  Catching up isn't a change to the record, so
+        // don't let serializing it make it look modified to delta readers
         if (update_first) {
+            TrackerElement::quiet_scope quiet;
             add_sample(agg.default_val(), globalreg->timestamp.tv_sec);
         }
     }
@@ -506,6 +508,7 @@ public:
         Aggregator agg;
 
         if (update_first) {
+            TrackerElement::quiet_scope quiet;
             add_sample(agg.default_val(), globalreg->timestamp.tv_sec);
         }
     }
@@ -1017,66 +1020,66 @@ public:
         if (lay1.signal_type == kis_l1_signal_type_dbm) {
             if (lay1.signal_dbm != 0) {
 
-                last_signal_dbm->set((int32_t) lay1.signal_dbm);
+                last_signal_dbm.set((int32_t) lay1.signal_dbm);
 
-                if ((*min_signal_dbm) == (int32_t) 0 ||
-                        (*min_signal_dbm) > (int32_t) lay1.signal_dbm) {
-                    min_signal_dbm->set((int32_t) lay1.signal_dbm);
+                if (min_signal_dbm.get() == (int32_t) 0 ||
+                        min_signal_dbm.get() > (int32_t) lay1.signal_dbm) {
+                    min_signal_dbm.set((int32_t) lay1.signal_dbm);
                 }
 
-                if ((*max_signal_dbm) == (int32_t) 0 ||
-                        (*max_signal_dbm) < (int32_t) lay1.signal_dbm) {
-                    max_signal_dbm->set((int32_t) lay1.signal_dbm);
+                if (max_signal_dbm.get() == (int32_t) 0 ||
+                        max_signal_dbm.get() < (int32_t) lay1.signal_dbm) {
+                    max_signal_dbm.set((int32_t) lay1.signal_dbm);
                 }
             }
 
             if (lay1.noise_dbm != 0) {
-                last_noise_dbm->set((int32_t) lay1.noise_dbm);
+                last_noise_dbm.set((int32_t) lay1.noise_dbm);
 
-                if ((*min_noise_dbm) == (int32_t) 0 ||
-                        (*min_noise_dbm) > (int32_t) lay1.noise_dbm) {
-                    min_noise_dbm->set((int32_t) lay1.noise_dbm);
+                if (min_noise_dbm.get() == (int32_t) 0 ||
+                        min_noise_dbm.get() > (int32_t) lay1.noise_dbm) {
+                    min_noise_dbm.set((int32_t) lay1.noise_dbm);
                 }
 
-                if ((*max_noise_dbm) == (int32_t) 0 ||
-                        (*max_noise_dbm) < (int32_t) lay1.noise_dbm) {
-                    max_noise_dbm->set((int32_t) lay1.noise_dbm);
+                if (max_noise_dbm.get() == (int32_t) 0 ||
+                        max_noise_dbm.get() < (int32_t) lay1.noise_dbm) {
+                    max_noise_dbm.set((int32_t) lay1.noise_dbm);
                 }
             }
         } else if (lay1.signal_type == kis_l1_signal_type_rssi) {
             if (lay1.signal_rssi != 0) {
-                last_signal_rssi->set((int32_t) lay1.signal_rssi);
+                last_signal_rssi.set((int32_t) lay1.signal_rssi);
 
-                if ((*min_signal_rssi) == (int32_t) 0 ||
-                        (*min_signal_rssi) > (int32_t) lay1.signal_rssi) {
-                    min_signal_dbm->set((int32_t) lay1.signal_rssi);
+                if (min_signal_rssi.get() == (int32_t) 0 ||
+                        min_signal_rssi.get() > (int32_t) lay1.signal_rssi) {
+                    min_signal_dbm.set((int32_t) lay1.signal_rssi);
                 }
 
-                if ((*max_signal_rssi) == (int32_t) 0 ||
-                        (*max_signal_rssi) < (int32_t) lay1.signal_rssi) {
-                    max_signal_rssi->set((int32_t) lay1.signal_rssi);
+                if (max_signal_rssi.get() == (int32_t) 0 ||
+                        max_signal_rssi.get() < (int32_t) lay1.signal_rssi) {
+                    max_signal_rssi.set((int32_t) lay1.signal_rssi);
                 }
             }
 
             if (lay1.noise_rssi != 0) {
-                last_noise_rssi->set((int32_t) lay1.noise_rssi);
+                last_noise_rssi.set((int32_t) lay1.noise_rssi);
 
-                if ((*min_noise_rssi) == (int32_t) 0 ||
-                        (*min_noise_rssi) > (int32_t) lay1.noise_rssi) {
-                    min_noise_rssi->set((int32_t) lay1.noise_rssi);
+                if (min_noise_rssi.get() == (int32_t) 0 ||
+                        min_noise_rssi.get() > (int32_t) lay1.noise_rssi) {
+                    min_noise_rssi.set((int32_t) lay1.noise_rssi);
                 }
 
-                if ((*max_noise_rssi) == (int32_t) 0 ||
-                        (*max_noise_rssi) < (int32_t) lay1.noise_rssi) {
-                    max_noise_rssi->set((int32_t) lay1.noise_rssi);
+                if (max_noise_rssi.get() == (int32_t) 0 ||
+                        max_noise_rssi.get() < (int32_t) lay1.noise_rssi) {
+                    max_noise_rssi.set((int32_t) lay1.noise_rssi);
                 }
             }
 
-            (*carrierset) |= (uint64_t) lay1.carrier;
-            (*encodingset) |= (uint64_t) lay1.encoding;
+            carrierset |= (uint64_t) lay1.carrier;
+            encodingset |= (uint64_t) lay1.encoding;
 
-            if ((*maxseenrate) < (double) lay1.datarate) {
-                maxseenrate->set((double) lay1.datarate);
+            if (maxseenrate.get() < (double) lay1.datarate) {
+                maxseenrate.set((double) lay1.datarate);
             }
         }
 
@@ -1088,16 +1091,16 @@ public:
             if (in.lay1->signal_type == kis_l1_signal_type_dbm) {
                 if (in.lay1->signal_dbm != 0) {
 
-                    last_signal_dbm->set((int32_t) in.lay1->signal_dbm);
+                    last_signal_dbm.set((int32_t) in.lay1->signal_dbm);
 
-                    if ((*min_signal_dbm) == (int32_t) 0 ||
-                            (*min_signal_dbm) > (int32_t) in.lay1->signal_dbm) {
-                        min_signal_dbm->set((int32_t) in.lay1->signal_dbm);
+                    if (min_signal_dbm.get() == (int32_t) 0 ||
+                            min_signal_dbm.get() > (int32_t) in.lay1->signal_dbm) {
+                        min_signal_dbm.set((int32_t) in.lay1->signal_dbm);
                     }
 
-                    if ((*max_signal_dbm) == (int32_t) 0 ||
-                            (*max_signal_dbm) < (int32_t) in.lay1->signal_dbm) {
-                        max_signal_dbm->set((int32_t) in.lay1->signal_dbm);
+                    if (max_signal_dbm.get() == (int32_t) 0 ||
+                            max_signal_dbm.get() < (int32_t) in.lay1->signal_dbm) {
+                        max_signal_dbm.set((int32_t) in.lay1->signal_dbm);
 
                         if (in.gps != NULL) {
                             get_peak_loc()->set(in.gps->lat, in.gps->lon, in.gps->alt, 
@@ -1110,30 +1113,30 @@ public:
                 }
 
                 if (in.lay1->noise_dbm != 0) {
-                    last_noise_dbm->set((int32_t) in.lay1->noise_dbm);
+                    last_noise_dbm.set((int32_t) in.lay1->noise_dbm);
 
-                    if ((*min_noise_dbm) == (int32_t) 0 ||
-                            (*min_noise_dbm) > (int32_t) in.lay1->noise_dbm) {
-                        min_noise_dbm->set((int32_t) in.lay1->noise_dbm);
+                    if (min_noise_dbm.get() == (int32_t) 0 ||
+                            min_noise_dbm.get() > (int32_t) in.lay1->noise_dbm) {
+                        min_noise_dbm.set((int32_t) in.lay1->noise_dbm);
                     }
 
-                    if ((*max_noise_dbm) == (int32_t) 0 ||
-                            (*max_noise_dbm) < (int32_t) in.lay1->noise_dbm) {
-                        max_noise_dbm->set((int32_t) in.lay1->noise_dbm);
+                    if (max_noise_dbm.get() == (int32_t) 0 ||
+                            max_noise_dbm.get() < (int32_t) in.lay1->noise_dbm) {
+                        max_noise_dbm.set((int32_t) in.lay1->noise_dbm);
                     }
                 }
             } else if (in.lay1->signal_type == kis_l1_signal_type_rssi) {
                 if (in.lay1->signal_rssi != 0) {
-                    last_signal_rssi->set((int32_t) in.lay1->signal_rssi);
+                    last_signal_rssi.set((int32_t) in.lay1->signal_rssi);
 
-                    if ((*min_signal_rssi) == (int32_t) 0 ||
-                            (*min_signal_rssi) > (int32_t) in.lay1->signal_rssi) {
-                        min_signal_dbm->set((int32_t) in.lay1->signal_rssi);
+                    if (min_signal_rssi.get() == (int32_t) 0 ||
+                            min_signal_rssi.get() > (int32_t) in.lay1->signal_rssi) {
+                        min_signal_dbm.set((int32_t) in.lay1->signal_rssi);
                     }
 
-                    if ((*max_signal_rssi) == (int32_t) 0 ||
-                            (*max_signal_rssi) < (int32_t) in.lay1->signal_rssi) {
-                        max_signal_rssi->set((int32_t) in.lay1->signal_rssi);
+                    if (max_signal_rssi.get() == (int32_t) 0 ||
+                            max_signal_rssi.get() < (int32_t) in.lay1->signal_rssi) {
+                        max_signal_rssi.set((int32_t) in.lay1->signal_rssi);
 
                         if (in.gps != NULL) {
                             get_peak_loc()->set(in.gps->lat, in.gps->lon, in.gps->alt, 
@@ -1146,51 +1149,51 @@ public:
                 }
 
                 if (in.lay1->noise_rssi != 0) {
-                    last_noise_rssi->set((int32_t) in.lay1->noise_rssi);
+                    last_noise_rssi.set((int32_t) in.lay1->noise_rssi);
 
-                    if ((*min_noise_rssi) == (int32_t) 0 ||
-                            (*min_noise_rssi) > (int32_t) in.lay1->noise_rssi) {
-                        min_noise_rssi->set((int32_t) in.lay1->noise_rssi);
+                    if (min_noise_rssi.get() == (int32_t) 0 ||
+                            min_noise_rssi.get() > (int32_t) in.lay1->noise_rssi) {
+                        min_noise_rssi.set((int32_t) in.lay1->noise_rssi);
                     }
 
-                    if ((*max_noise_rssi) == (int32_t) 0 ||
-                            (*max_noise_rssi) < (int32_t) in.lay1->noise_rssi) {
-                        max_noise_rssi->set((int32_t) in.lay1->noise_rssi);
+                    if (max_noise_rssi.get() == (int32_t) 0 ||
+                            max_noise_rssi.get() < (int32_t) in.lay1->noise_rssi) {
+                        max_noise_rssi.set((int32_t) in.lay1->noise_rssi);
                     }
                 }
 
             }
 
-            (*carrierset) |= (uint64_t) in.lay1->carrier;
-            (*encodingset) |= (uint64_t) in.lay1->encoding;
+            carrierset |= (uint64_t) in.lay1->carrier;
+            encodingset |= (uint64_t) in.lay1->encoding;
 
-            if ((*maxseenrate) < (double) in.lay1->datarate) {
-                maxseenrate->set((double) in.lay1->datarate);
+            if (maxseenrate.get() < (double) in.lay1->datarate) {
+                maxseenrate.set((double) in.lay1->datarate);
             }
 		}
 
 		return *this;
 	}
 
-    __ProxyGet(last_signal_dbm, int32_t, int, last_signal_dbm);
-    __ProxyGet(min_signal_dbm, int32_t, int, min_signal_dbm);
-    __ProxyGet(max_signal_dbm, int32_t, int, max_signal_dbm);
+    __ProxyTypedGet(last_signal_dbm, int, last_signal_dbm);
+    __ProxyTypedGet(min_signal_dbm, int, min_signal_dbm);
+    __ProxyTypedGet(max_signal_dbm, int, max_signal_dbm);
 
-    __ProxyGet(last_noise_dbm, int32_t, int, last_noise_dbm);
-    __ProxyGet(min_noise_dbm, int32_t, int, min_noise_dbm);
-    __ProxyGet(max_noise_dbm, int32_t, int, max_noise_dbm);
+    __ProxyTypedGet(last_noise_dbm, int, last_noise_dbm);
+    __ProxyTypedGet(min_noise_dbm, int, min_noise_dbm);
+    __ProxyTypedGet(max_noise_dbm, int, max_noise_dbm);
 
-    __ProxyGet(last_signal_rssi, int32_t, int, last_signal_rssi);
-    __ProxyGet(min_signal_rssi, int32_t, int, min_signal_rssi);
-    __ProxyGet(max_signal_rssi, int32_t, int, max_signal_rssi);
+    __ProxyTypedGet(last_signal_rssi, int, last_signal_rssi);
+    __ProxyTypedGet(min_signal_rssi, int, min_signal_rssi);
+    __ProxyTypedGet(max_signal_rssi, int, max_signal_rssi);
 
-    __ProxyGet(last_noise_rssi, int32_t, int, last_noise_rssi);
-    __ProxyGet(min_noise_rssi, int32_t, int, min_noise_rssi);
-    __ProxyGet(max_noise_rssi, int32_t, int, max_noise_rssi);
+    __ProxyTypedGet(last_noise_rssi, int, last_noise_rssi);
+    __ProxyTypedGet(min_noise_rssi, int, min_noise_rssi);
+    __ProxyTypedGet(max_noise_rssi, int, max_noise_rssi);
 
-    __ProxyGet(maxseenrate, double, double, maxseenrate);
-    __ProxyGet(encodingset, uint64_t, uint64_t, encodingset);
-    __ProxyGet(carrierset, uint64_t, uint64_t, carrierset);
+    __ProxyTypedGet(maxseenrate, double, maxseenrate);
+    __ProxyTypedGet(encodingset, uint64_t, encodingset);
+    __ProxyTypedGet(carrierset, uint64_t, carrierset);
 
     typedef kis_tracked_minute_rrd<kis_tracked_rrd_peak_signal_aggregator> msig_rrd;
     __ProxyDynamicTrackable(signal_min_rrd, msig_rrd, signal_min_rrd, signal_min_rrd_id);
@@ -1202,34 +1205,34 @@ protected:
     virtual void register_fields() {
         tracker_component::register_fields();
 
-        RegisterField("kismet.common.signal.last_signal_dbm", TrackerInt32,
+        RegisterField("kismet.common.signal.last_signal_dbm",
                 "most recent signal (dBm)", &last_signal_dbm);
-        RegisterField("kismet.common.signal.last_noise_dbm", TrackerInt32,
+        RegisterField("kismet.common.signal.last_noise_dbm",
                 "most recent noise (dBm)", &last_noise_dbm);
 
-        RegisterField("kismet.common.signal.min_signal_dbm", TrackerInt32,
+        RegisterField("kismet.common.signal.min_signal_dbm",
                 "minimum signal (dBm)", &min_signal_dbm);
-        RegisterField("kismet.common.signal.min_noise_dbm", TrackerInt32,
+        RegisterField("kismet.common.signal.min_noise_dbm",
                 "minimum noise (dBm)", &min_noise_dbm);
 
-        RegisterField("kismet.common.signal.max_signal_dbm", TrackerInt32,
+        RegisterField("kismet.common.signal.max_signal_dbm",
                 "maximum signal (dBm)", &max_signal_dbm);
-        RegisterField("kismet.common.signal.max_noise_dbm", TrackerInt32,
+        RegisterField("kismet.common.signal.max_noise_dbm",
                 "maximum noise (dBm)", &max_noise_dbm);
 
-        RegisterField("kismet.common.signal.last_signal_rssi", TrackerInt32,
+        RegisterField("kismet.common.signal.last_signal_rssi",
                 "most recent signal (RSSI)", &last_signal_rssi);
-        RegisterField("kismet.common.signal.last_noise_rssi", TrackerInt32,
+        RegisterField("kismet.common.signal.last_noise_rssi",
                 "most recent noise (RSSI)", &last_noise_rssi);
 
-        RegisterField("kismet.common.signal.min_signal_rssi", TrackerInt32,
+        RegisterField("kismet.common.signal.min_signal_rssi",
                 "minimum signal (rssi)", &min_signal_rssi);
-        RegisterField("kismet.common.signal.min_noise_rssi", TrackerInt32,
+        RegisterField("kismet.common.signal.min_noise_rssi",
                 "minimum noise (RSSI)", &min_noise_rssi);
 
-        RegisterField("kismet.common.signal.max_signal_rssi", TrackerInt32,
+        RegisterField("kismet.common.signal.max_signal_rssi",
                 "maximum signal (RSSI)", &max_signal_rssi);
-        RegisterField("kismet.common.signal.max_noise_rssi", TrackerInt32,
+        RegisterField("kismet.common.signal.max_noise_rssi",
                 "maximum noise (RSSI)", &max_noise_rssi);
 
 
@@ -1239,11 +1242,11 @@ protected:
             RegisterComplexField("kismet.common.signal.peak_loc", loc_builder,
                     "location of strongest signal");
 
-        RegisterField("kismet.common.signal.maxseenrate", TrackerDouble,
+        RegisterField("kismet.common.signal.maxseenrate",
                 "maximum observed data rate (phy dependent)", &maxseenrate);
-        RegisterField("kismet.common.signal.encodingset", TrackerUInt64,
+        RegisterField("kismet.common.signal.encodingset",
                 "bitset of observed encodings", &encodingset);
-        RegisterField("kismet.common.signal.carrierset", TrackerUInt64,
+        RegisterField("kismet.common.signal.carrierset",
                 "bitset of observed carrier types", &carrierset);
 
         shared_ptr<kis_tracked_minute_rrd<kis_tracked_rrd_peak_signal_aggregator> >
@@ -1268,18 +1271,20 @@ protected:
         add_map(signal_min_rrd_id, signal_min_rrd);
     }
 
-    SharedTrackerElement last_signal_dbm, last_noise_dbm;
-    SharedTrackerElement min_signal_dbm, min_noise_dbm;
-    SharedTrackerElement max_signal_dbm, max_noise_dbm;
+    // Signal levels are updated for every packet so they're held as typed values
+    TrackedInt32 last_signal_dbm, last_noise_dbm;
+    TrackedInt32 min_signal_dbm, min_noise_dbm;
+    TrackedInt32 max_signal_dbm, max_noise_dbm;
 
-    SharedTrackerElement last_signal_rssi, last_noise_rssi;
-    SharedTrackerElement min_signal_rssi, min_noise_rssi;
-    SharedTrackerElement max_signal_rssi, max_noise_rssi;
+    TrackedInt32 last_signal_rssi, last_noise_rssi;
+    TrackedInt32 min_signal_rssi, min_noise_rssi;
+    TrackedInt32 max_signal_rssi, max_noise_rssi;
 
     int peak_loc_id;
     shared_ptr<kis_tracked_location_triplet> peak_loc;
 
-    SharedTrackerElement maxseenrate, encodingset, carrierset;
+    TrackedDouble maxseenrate;
+    TrackedUInt64 encodingset, carrierset;
 
     // Signal record over the past minute, either rssi or dbm.  Devices
     // should not mix rssi and dbm signal reporting.
@@ -0,0 +1,77 @@
+/* test harness for device update generations
+ *
+ * Serializing a device has to leave it unmodified as far as delta readers
+ * (/devices/delta and the eventstream) are concerned, even when parts of it,
+ * like the RRDs, catch up to the current time before they're sent.
+ *
+ * # build kismet
+ * make
+ *
+ * # build test harness
+ * g++ -o devicetracker_delta_test.o -c devicetracker_delta_test.cc
+ * g++ -o devicetracker_delta_test devicetracker_delta_test.o trackedelement.o \
+ *     entrytracker.o globalregistry.o util.o msgpack_adapter.o json_adapter.o \
+ *     messagebus.o kis_net_microhttpd.o configfile.o timetracker.o \
+ *     -lmicrohttpd -lz -lpthread
+ *
+ * ./devicetracker_delta_test
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <sstream>
+
+#include "globalregistry.h"
+#include "entrytracker.h"
+#include "devicetracker.h"
+#include "msgpack_adapter.h"
+
+static int failures = 0;
+
+static void check(bool in_ok, const char *in_test) {
+    printf("%s: %s\n", in_ok ? "PASS" : "FAIL", in_test);
+
+    if (!in_ok)
+        failures++;
+}
+
+int main(void) {
+    GlobalRegistry *globalreg = new GlobalRegistry();
+    gettimeofday(&(globalreg->timestamp), NULL);
+
+    shared_ptr<EntryTracker> entrytracker =
+        EntryTracker::create_entrytracker(globalreg);
+
+    int device_id =
+        entrytracker->RegisterField("kismet.device.base",
+                shared_ptr<kis_tracked_device_base>(new kis_tracked_device_base(globalreg, 0)),
+                "core device record");
+
+    shared_ptr<kis_tracked_device_base> device(new kis_tracked_device_base(globalreg,
+                device_id));
+
+    device->get_packets_rrd()->add_sample(10, globalreg->timestamp.tv_sec);
+
+    uint64_t since = TrackerElement::next_generation();
+
+    check(!device->modified_since(since), "device is unmodified after taking a token");
+
+    // Move time along so the RRD has seconds to fill in when it's serialized
+    globalreg->timestamp.tv_sec += 5;
+
+    std::stringstream stream;
+    MsgpackAdapter::Pack(globalreg, stream, device);
+
+    check(stream.str().length() != 0, "device serialized");
+    check(!device->modified_since(since), "serializing leaves the device unmodified");
+
+    device->get_packets_rrd()->add_sample(10, globalreg->timestamp.tv_sec);
+
+    check(device->modified_since(since), "a new sample modifies the device");
+
+    return failures == 0 ? 0 : 1;
+}
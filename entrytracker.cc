@@ -18,11 +18,13 @@
 
 #include <string>
 #include <sstream>
+#include <msgpack.hpp>
 
 #include "util.h"
 
 #include "entrytracker.h"
 #include "messagebus.h"
+#include "json_adapter.h"
 
 EntryTracker::EntryTracker(GlobalRegistry *in_globalreg) :
     Kis_Net_Httpd_Stream_Handler(in_globalreg) {
@@ -35,6 +37,13 @@ EntryTracker::EntryTracker(GlobalRegistry *in_globalreg) :
 	pthread_mutex_init(&entry_mutex, &mutexattr);
 
     next_field_num = 1;
+
+    for (unsigned int x = 0; x < ENTRYTRACKER_TOKEN_CHUNKS; x++)
+        token_chunks[x].store(NULL);
+
+    token_overflow_reported.store(false);
+
+    Httpd_RegisterRoute("GET", "/system/tracked_fields.html");
 }
 
 EntryTracker::~EntryTracker() {
@@ -42,6 +51,60 @@ EntryTracker::~EntryTracker() {
 
     field_name_map.clear();
     field_id_map.clear();
+    summary_cache.clear();
+
+    for (unsigned int x = 0; x < ENTRYTRACKER_TOKEN_CHUNKS; x++) {
+        token_chunk *chunk = token_chunks[x].load();
+
+        if (chunk == NULL)
+            continue;
+
+        for (unsigned int t = 0; t < ENTRYTRACKER_TOKEN_CHUNK; t++)
+            delete(chunk->tokens[t].load());
+
+        delete(chunk);
+    }
+}
+
+void EntryTracker::PublishFieldToken(int in_id, string in_name) {
+    if (in_id < 0 || in_id >= ENTRYTRACKER_TOKEN_CHUNK * ENTRYTRACKER_TOKEN_CHUNKS) {
+        // Fields past the table still work, they just look up their name each
+        // time they're serialized; only say so once
+        if (!token_overflow_reported.exchange(true))
+            _MSG("Too many tracked fields to cache all of their names (field " +
+                    in_name + " and later), serializing will be slower", 
+                    MSGFLAG_ERROR);
+        return;
+    }
+
+    local_locker lock(&entry_mutex);
+
+    token_chunk *chunk = token_chunks[in_id / ENTRYTRACKER_TOKEN_CHUNK].load();
+
+    if (chunk == NULL) {
+        chunk = new token_chunk();
+
+        for (unsigned int x = 0; x < ENTRYTRACKER_TOKEN_CHUNK; x++)
+            chunk->tokens[x].store(NULL);
+
+        token_chunks[in_id / ENTRYTRACKER_TOKEN_CHUNK].store(chunk, 
+                std::memory_order_release);
+    }
+
+    TrackerFieldToken *token = new TrackerFieldToken();
+
+    token->name = in_name;
+    token->lower_name = StrLower(in_name);
+    token->json_key = "\"" + JsonAdapter::SanitizeString(in_name) + "\": ";
+
+    std::stringstream mpstream;
+    msgpack::packer<std::stringstream> packer(mpstream);
+    packer.pack(in_name);
+    token->msgpack_key = mpstream.str();
+
+    // Field ids are never re-used, so there is no previous token to replace
+    chunk->tokens[in_id % ENTRYTRACKER_TOKEN_CHUNK].store(token, 
+            std::memory_order_release);
 }
 
 int EntryTracker::RegisterField(string in_name, TrackerType in_type, string in_desc) {
@@ -83,6 +146,8 @@ int EntryTracker::RegisterField(string in_name, TrackerType in_type, string in_d
     field_name_map[mod_name] = definition;
     field_id_map[definition->field_id] = definition;
 
+    PublishFieldToken(definition->field_id, in_name);
+
     return definition->field_id;
 }
 
@@ -119,6 +184,8 @@ int EntryTracker::RegisterField(string in_name, shared_ptr<TrackerElement> in_bu
     field_name_map[mod_name] = definition;
     field_id_map[definition->field_id] = definition;
 
+    PublishFieldToken(definition->field_id, in_name);
+
     // Set the builders ID now that we know it
     definition->builder->set_id(definition->field_id);
 
@@ -140,6 +207,11 @@ int EntryTracker::GetFieldId(string in_name) {
 }
 
 string EntryTracker::GetFieldName(int in_id) {
+    const TrackerFieldToken *token = GetFieldToken(in_id);
+
+    if (token != NULL)
+        return token->name;
+
     local_locker lock(&entry_mutex);
 
     id_itr iter = field_id_map.find(in_id);
@@ -202,6 +274,20 @@ shared_ptr<TrackerElement> EntryTracker::GetTrackedInstance(int in_id) {
         return definition->builder->clone_type(definition->field_id);
 }
 
+TrackerType EntryTracker::GetFieldType(int in_id) {
+    local_locker lock(&entry_mutex);
+
+    id_itr iter = field_id_map.find(in_id);
+
+    if (iter == field_id_map.end())
+        return TrackerUnassigned;
+
+    if (iter->second->builder == NULL)
+        return iter->second->track_type;
+
+    return iter->second->builder->get_type();
+}
+
 shared_ptr<TrackerElement> EntryTracker::GetTrackedInstance(string in_name) {
     local_locker lock(&entry_mutex);
 
@@ -320,6 +406,17 @@ bool EntryTracker::CanSerialize(string in_name) {
     return false;
 }
 
+shared_ptr<TrackerElementSerializer> EntryTracker::GetSerializer(string in_name) {
+    local_locker lock(&entry_mutex);
+
+    serial_itr i = serializer_map.find(in_name);
+
+    if (i == serializer_map.end())
+        return NULL;
+
+    return i->second;
+}
+
 bool EntryTracker::Serialize(string in_name, std::stringstream &stream,
         SharedTrackerElement e,
         TrackerElementSerializer::rename_map *name_map) {
@@ -335,4 +432,109 @@ bool EntryTracker::Serialize(string in_name, std::stringstream &stream,
     return true;
 }
 
+void EntryTracker::CompileSummaryFields(SharedStructured in_fields,
+        vector<SharedElementSummary> &ret_vec) {
+    StructuredData::structured_vec fvec = in_fields->getStructuredArray();
+
+    // Build the cache key from the field spec; paths and renames can't
+    // contain control characters so they make safe separators
+    string key;
+    vector<StructuredData::string_vec> specs;
+
+    for (StructuredData::structured_vec::iterator i = fvec.begin(); 
+            i != fvec.end(); ++i) {
+        if ((*i)->isString()) {
+            StructuredData::string_vec spec;
+            spec.push_back((*i)->getString());
+
+            key += spec[0] + "\n";
+            specs.push_back(spec);
+        } else if ((*i)->isArray()) {
+            StructuredData::string_vec mapvec = (*i)->getStringVec();
+
+            if (mapvec.size() != 2)
+                throw StructuredDataUnsuitable("Expected field, rename");
+
+            key += mapvec[0] + "\t" + mapvec[1] + "\n";
+            specs.push_back(mapvec);
+        }
+    }
+
+    if (FetchSummaryCache(key, ret_vec))
+        return;
+
+    ret_vec.clear();
+
+    shared_ptr<EntryTracker> self = 
+        static_pointer_cast<EntryTracker>(globalreg->FetchGlobal("ENTRY_TRACKER"));
+
+    for (vector<StructuredData::string_vec>::iterator i = specs.begin();
+            i != specs.end(); ++i) {
+        SharedElementSummary s;
+
+        if (i->size() == 1)
+            s.reset(new TrackerElementSummary((*i)[0], self));
+        else
+            s.reset(new TrackerElementSummary((*i)[0], (*i)[1], self));
+
+        // A path of only separators ("/", "//") names nothing
+        if (s->resolved_path.size() == 0)
+            throw StructuredDataUnsuitable("Empty field path '" + (*i)[0] + "'");
+
+        ret_vec.push_back(s);
+    }
+
+    StoreSummaryCache(key, ret_vec);
+}
+
+bool EntryTracker::FetchSummaryCache(string in_key, 
+        vector<SharedElementSummary> &ret_vec) {
+    local_locker lock(&entry_mutex);
+
+    summary_itr i = summary_cache.find(in_key);
+
+    if (i == summary_cache.end())
+        return false;
+
+    ret_vec = i->second;
+
+    return true;
+}
+
+void EntryTracker::StoreSummaryCache(string in_key, 
+        vector<SharedElementSummary> in_vec) {
+    for (vector<SharedElementSummary>::iterator i = in_vec.begin();
+            i != in_vec.end(); ++i) {
+        for (vector<int>::iterator p = (*i)->resolved_path.begin();
+                p != (*i)->resolved_path.end(); ++p) {
+            if (*p < 0)
+                return;
+        }
+    }
+
+    local_locker lock(&entry_mutex);
+
+    // Queries come from a handful of UI views; if something is generating 
+    // endless unique queries just start over
+    if (summary_cache.size() >= ENTRYTRACKER_SUMMARY_CACHE_MAX)
+        summary_cache.clear();
+
+    summary_cache[in_key] = in_vec;
+}
+
+bool EntryTracker::SerializeDelta(string in_name, std::stringstream &stream,
+        SharedTrackerElement e, uint64_t since,
+        TrackerElementSerializer::rename_map *name_map) {
+    local_locker lock(&entry_mutex);
+
+    serial_itr i = serializer_map.find(in_name);
+
+    if (i == serializer_map.end())
+        return false;
+
+    i->second->serialize_delta(e, stream, since, name_map);
+
+    return true;
+}
+
 
@@ -27,13 +27,37 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <atomic>
 
 #include <pthread.h>
 
 #include "globalregistry.h"
 #include "trackedelement.h"
+#include "structured.h"
 #include "kis_net_microhttpd.h"
 
+// Maximum number of compiled summary specifications to keep
+#define ENTRYTRACKER_SUMMARY_CACHE_MAX 128
+
+// Field name tokens are stored in fixed size chunks so the table can grow
+// without moving entries readers may be looking at
+#define ENTRYTRACKER_TOKEN_CHUNK    1024
+#define ENTRYTRACKER_TOKEN_CHUNKS   256
+
+// Pre-rendered forms of a field name.  Tokens are built once when the field
+// is registered and are never modified or freed while the tracker exists, so
+// serializers can copy them directly without locking
+class TrackerFieldToken {
+public:
+    string name;
+    // Lowercased name, for case-insensitive lookups
+    string lower_name;
+    // Quoted and escaped JSON key, including the ': ' separator
+    string json_key;
+    // msgpack str header followed by the name
+    string msgpack_key;
+};
+
 // Allocate and track named fields and give each one a custom int
 class EntryTracker : public Kis_Net_Httpd_Stream_Handler, public LifetimeGlobal {
 public:
@@ -79,17 +103,50 @@ public:
     int GetFieldId(string in_name);
     string GetFieldName(int in_id);
 
+    // Lock-free lookup of the pre-rendered name tokens of a field
+    // Return: NULL if unknown
+    const TrackerFieldToken *GetFieldToken(int in_id) {
+        if (in_id < 0 || in_id >= ENTRYTRACKER_TOKEN_CHUNK * ENTRYTRACKER_TOKEN_CHUNKS)
+            return NULL;
+
+        token_chunk *chunk = 
+            token_chunks[in_id / ENTRYTRACKER_TOKEN_CHUNK].load(std::memory_order_acquire);
+
+        if (chunk == NULL)
+            return NULL;
+
+        return chunk->tokens[in_id % ENTRYTRACKER_TOKEN_CHUNK].load(std::memory_order_acquire);
+    }
+
     // Get a field instance
     // Return: NULL if unknown
     shared_ptr<TrackerElement> GetTrackedInstance(string in_name);
     shared_ptr<TrackerElement> GetTrackedInstance(int in_id);
 
+    // Get the type of a field without building an instance of it
+    // Return: TrackerUnassigned if unknown
+    TrackerType GetFieldType(int in_id);
+
     // Register a serializer for auto-serialization based on type
     void RegisterSerializer(string type, shared_ptr<TrackerElementSerializer> in_ser);
     void RemoveSerializer(string type);
     bool CanSerialize(string type);
+    // Fetch the serializer for a type, for callers which drive it directly
+    // Return: NULL if unknown
+    shared_ptr<TrackerElementSerializer> GetSerializer(string type);
     bool Serialize(string type, std::stringstream &stream, SharedTrackerElement elem,
             TrackerElementSerializer::rename_map *name_map = NULL);
+    // Serialize only what changed at or after generation 'since'
+    bool SerializeDelta(string type, std::stringstream &stream, SharedTrackerElement elem,
+            uint64_t since, TrackerElementSerializer::rename_map *name_map = NULL);
+
+    // Compile a structured field specification (an array of field paths or 
+    // [path, rename] pairs) into resolved summaries.  Compiled lists are cached 
+    // by the text of the specification, so repeated identical queries skip 
+    // parsing and name resolution.
+    // MAY THROW StructuredDataException on a malformed specification
+    void CompileSummaryFields(SharedStructured in_fields, 
+            vector<SharedElementSummary> &ret_vec);
 
     // HTTP api
     virtual bool Httpd_VerifyPath(const char *path, const char *method);
@@ -130,6 +187,27 @@ protected:
     map<string, shared_ptr<TrackerElementSerializer> > serializer_map;
     typedef map<string, shared_ptr<TrackerElementSerializer> >::iterator serial_itr;
 
+    // Append-only field id to token table.  Entries are only ever published
+    // while holding entry_mutex, and readers don't lock at all
+    struct token_chunk {
+        std::atomic<TrackerFieldToken *> tokens[ENTRYTRACKER_TOKEN_CHUNK];
+    };
+
+    std::atomic<token_chunk *> token_chunks[ENTRYTRACKER_TOKEN_CHUNKS];
+
+    // We've warned about fields which don't fit in the token table
+    std::atomic<bool> token_overflow_reported;
+
+    void PublishFieldToken(int in_id, string in_name);
+
+    map<string, vector<SharedElementSummary> > summary_cache;
+    typedef map<string, vector<SharedElementSummary> >::iterator summary_itr;
+
+    // Lists which contain unresolved fields are not cached, since they may 
+    // resolve once the field is registered
+    bool FetchSummaryCache(string in_key, vector<SharedElementSummary> &ret_vec);
+    void StoreSummaryCache(string in_key, vector<SharedElementSummary> in_vec);
+
 };
 
 #endif
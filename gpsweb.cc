@@ -59,6 +59,7 @@ int GPSWeb::OpenGps(string in_opts) {
 
     // Call the http stream handler init to bind to the webserver
     Bind_Httpd_Server(globalreg);
+    Httpd_RegisterRoute("POST", "/gps/web/update.cmd");
 
     return 1;
 }
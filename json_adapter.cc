@@ -25,6 +25,7 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <string.h>
 
 #include "globalregistry.h"
 #include "trackedelement.h"
@@ -35,17 +36,145 @@
 #include "json_adapter.h"
 
 
+// Escape table; 0 for characters passed through, otherwise the character
+// following the backslash, or 'u' for a \u00XX escape
+static const char json_escape_table[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+static const char json_hex_digits[] = "0123456789ABCDEF";
+
+// Append the escaped form of in_data to out in a single pass, copying runs of
+// characters which don't need escaping in bulk
+static void json_escape_append(string &out, const char *in_data, size_t in_len) {
+    size_t run = 0;
+
+    for (size_t x = 0; x < in_len; x++) {
+        char esc = json_escape_table[(uint8_t) in_data[x]];
+
+        if (esc == 0)
+            continue;
+
+        out.append(in_data + run, x - run);
+        run = x + 1;
+
+        out.push_back('\\');
+        out.push_back(esc);
+
+        if (esc == 'u') {
+            out.append("00", 2);
+            out.push_back(json_hex_digits[(in_data[x] >> 4) & 0x0F]);
+            out.push_back(json_hex_digits[in_data[x] & 0x0F]);
+        }
+    }
+
+    out.append(in_data + run, in_len - run);
+}
+
 string JsonAdapter::SanitizeString(string in) {
-    string itr = MultiReplaceAll(in, "\\", "\\\\");
-    itr = MultiReplaceAll(itr, "\"", "\\\"");
-    return itr;
+    string ret;
+    ret.reserve(in.length());
+    json_escape_append(ret, in.data(), in.length());
+    return ret;
+}
+
+JsonAdapter::JsonWriter::JsonWriter(GlobalRegistry *in_globalreg) :
+    buffer(own_buffer) {
+    globalreg = in_globalreg;
+    buffer.reserve(4096);
+}
+
+JsonAdapter::JsonWriter::JsonWriter(GlobalRegistry *in_globalreg, string &in_target) :
+    buffer(in_target) {
+    globalreg = in_globalreg;
+}
+
+void JsonAdapter::JsonWriter::put_string(const char *in_data, size_t in_len) {
+    buffer.push_back('"');
+    json_escape_append(buffer, in_data, in_len);
+    buffer.push_back('"');
+}
+
+void JsonAdapter::JsonWriter::put_uint(uint64_t in_val) {
+    char digits[20];
+    size_t pos = sizeof(digits);
+
+    do {
+        digits[--pos] = '0' + (in_val % 10);
+        in_val /= 10;
+    } while (in_val != 0);
+
+    buffer.append(digits + pos, sizeof(digits) - pos);
+}
+
+void JsonAdapter::JsonWriter::put_int(int64_t in_val) {
+    if (in_val < 0) {
+        buffer.push_back('-');
+        // Negate as unsigned so INT64_MIN doesn't overflow
+        put_uint(~((uint64_t) in_val) + 1);
+    } else {
+        put_uint((uint64_t) in_val);
+    }
+}
+
+void JsonAdapter::JsonWriter::put_double(double in_val) {
+    char num[64];
+
+    int len = snprintf(num, sizeof(num), "%f", in_val);
+
+    // Huge values don't fit the fixed notation buffer; fall back to the
+    // shortest form which does
+    if (len < 0 || len >= (int) sizeof(num))
+        len = snprintf(num, sizeof(num), "%g", in_val);
+
+    buffer.append(num, len);
+}
+
+void JsonAdapter::JsonWriter::put_hex(const uint8_t *in_data, size_t in_len) {
+    buffer.push_back('"');
+
+    for (size_t x = 0; x < in_len; x++) {
+        buffer.push_back(json_hex_digits[(in_data[x] >> 4) & 0x0F]);
+        buffer.push_back(json_hex_digits[in_data[x] & 0x0F]);
+    }
+
+    buffer.push_back('"');
+}
+
+void JsonAdapter::JsonWriter::put_field_key(int in_id) {
+    const TrackerFieldToken *token = globalreg->entrytracker->GetFieldToken(in_id);
+
+    if (token != NULL) {
+        buffer.append(token->json_key);
+        return;
+    }
+
+    put_string(globalreg->entrytracker->GetFieldName(in_id));
+    buffer.append(": ", 2);
 }
 
 void JsonAdapter::Pack(GlobalRegistry *globalreg, std::stringstream &stream,
-    SharedTrackerElement e, TrackerElementSerializer::rename_map *name_map) {
+    SharedTrackerElement e, TrackerElementSerializer::rename_map *name_map,
+    uint64_t since) {
+
+    JsonWriter writer(globalreg);
+
+    Pack(globalreg, writer, e, name_map, since);
+
+    stream.write(writer.str().data(), writer.str().length());
+}
+
+void JsonAdapter::Pack(GlobalRegistry *globalreg, JsonWriter &writer,
+    SharedTrackerElement e, TrackerElementSerializer::rename_map *name_map,
+    uint64_t since) {
 
     if (e == NULL) {
-        stream << "0";
+        writer.put('0');
         return;
     }
 
@@ -80,173 +209,190 @@ void JsonAdapter::Pack(GlobalRegistry *globalreg, std::stringstream &stream,
     TrackerElement::tracked_double_map *tdoublemap;
     TrackerElement::double_map_iterator double_map_iter;
 
-    mac_addr mac;
-    uuid euuid;
-
-    string tname;
-
     shared_ptr<uint8_t> bytes;
 
-    size_t sz;
-    ios::fmtflags fflags;
+    bool first;
 
     switch (e->get_type()) {
         case TrackerString:
-            stream << "\"" << SanitizeString(GetTrackerValue<string>(e)) << "\"";
+            writer.put_string(GetTrackerValue<string>(e));
             break;
         case TrackerInt8:
-            stream << (int) GetTrackerValue<int8_t>(e);
+            writer.put_int(GetTrackerValue<int8_t>(e));
             break;
         case TrackerUInt8:
-            stream << (unsigned int) GetTrackerValue<uint8_t>(e);
+            writer.put_uint(GetTrackerValue<uint8_t>(e));
             break;
         case TrackerInt16:
-            stream << (int) GetTrackerValue<int16_t>(e);
+            writer.put_int(GetTrackerValue<int16_t>(e));
             break;
         case TrackerUInt16:
-            stream << (unsigned int) GetTrackerValue<uint16_t>(e);
+            writer.put_uint(GetTrackerValue<uint16_t>(e));
             break;
         case TrackerInt32:
-            stream << GetTrackerValue<int32_t>(e);
+            writer.put_int(GetTrackerValue<int32_t>(e));
             break;
         case TrackerUInt32:
-            stream << GetTrackerValue<uint32_t>(e);
+            writer.put_uint(GetTrackerValue<uint32_t>(e));
             break;
         case TrackerInt64:
-            stream << GetTrackerValue<int64_t>(e);
+            writer.put_int(GetTrackerValue<int64_t>(e));
             break;
         case TrackerUInt64:
-            stream << GetTrackerValue<uint64_t>(e);
+            writer.put_uint(GetTrackerValue<uint64_t>(e));
             break;
         case TrackerFloat:
-            stream << fixed << GetTrackerValue<float>(e);
+            writer.put_double(GetTrackerValue<float>(e));
             break;
         case TrackerDouble:
-            stream << fixed << GetTrackerValue<double>(e);
+            writer.put_double(GetTrackerValue<double>(e));
             break;
         case TrackerMac:
-            mac = GetTrackerValue<mac_addr>(e);
             // Mac is quoted as a string value
-            stream << "\"" << mac.MacFull2String() << "\"";
+            writer.put_string(GetTrackerValue<mac_addr>(e).MacFull2String());
             break;
         case TrackerUuid:
-            euuid = GetTrackerValue<uuid>(e);
             // UUID is quoted as a string value
-            stream << "\"" << euuid.UUID2String() << "\"";
+            writer.put_string(GetTrackerValue<uuid>(e).UUID2String());
             break;
         case TrackerVector:
             tvec = e->get_vector();
-            stream << "[";
+            writer.put('[');
             for (vec_iter = tvec->begin(); vec_iter != tvec->end(); /* */ ) {
-                JsonAdapter::Pack(globalreg, stream, *vec_iter, name_map);
+                JsonAdapter::Pack(globalreg, writer, *vec_iter, name_map, since);
                 if (++vec_iter != tvec->end())
-                    stream << ",";
+                    writer.put(',');
             }
-            stream << "]";
+            writer.put(']');
             break;
         case TrackerMap:
             tmap = e->get_map();
-            stream << "{";
-            for (map_iter = tmap->begin(); map_iter != tmap->end(); /* */) {
+            writer.put('{');
+            first = true;
+            for (map_iter = tmap->begin(); map_iter != tmap->end(); ++map_iter) {
+                if (TrackerElementSerializer::delta_skip(map_iter->second, since))
+                    continue;
+
+                if (!first)
+                    writer.put(',');
+                first = false;
+
                 bool named = false;
 
                 if (name_map != NULL) {
                     TrackerElementSerializer::rename_map::iterator nmi = 
                         name_map->find(map_iter->second);
                     if (nmi != name_map->end() && nmi->second->rename.length() != 0) {
-                        tname = nmi->second->rename;
+                        writer.put_string(nmi->second->rename);
+                        writer.put(": ", 2);
                         named = true;
                     }
                 }
 
                 if (!named) {
-                    if (map_iter->second == NULL) {
-                        tname = globalreg->entrytracker->GetFieldName(map_iter->first);
+                    if (map_iter->second != NULL && 
+                            map_iter->second->get_local_name() != "") {
+                        writer.put_string(map_iter->second->get_local_name());
+                        writer.put(": ", 2);
                     } else {
-                        if ((tname = map_iter->second->get_local_name()) == "")
-                            tname = 
-                                globalreg->entrytracker->GetFieldName(map_iter->first);
+                        writer.put_field_key(map_iter->first);
                     }
                 }
 
-                tname = SanitizeString(tname);
-
-                stream << "\"" << 
-                    tname <<
-                    "\": ";
-                JsonAdapter::Pack(globalreg, stream, map_iter->second, name_map);
-                if (++map_iter != tmap->end()) // Increment iter in loop
-                    stream << ",";
+                JsonAdapter::Pack(globalreg, writer, map_iter->second, name_map, since);
             }
-            stream << "}";
+            writer.put('}');
             break;
         case TrackerIntMap:
             tintmap = e->get_intmap();
-            stream << "{";
-            for (int_map_iter = tintmap->begin(); int_map_iter != tintmap->end(); /* */) {
+            writer.put('{');
+            first = true;
+            for (int_map_iter = tintmap->begin(); int_map_iter != tintmap->end(); 
+                    ++int_map_iter) {
+                if (TrackerElementSerializer::delta_skip(int_map_iter->second, since))
+                    continue;
+
+                if (!first)
+                    writer.put(',');
+                first = false;
+
                 // Integer dictionary keys in json are still quoted as strings
-                stream << "\"" << int_map_iter->first << "\": ";
-                JsonAdapter::Pack(globalreg, stream, int_map_iter->second, name_map);
-                if (++int_map_iter != tintmap->end()) // Increment iter in loop
-                    stream << ",";
+                writer.put('"');
+                writer.put_int(int_map_iter->first);
+                writer.put("\": ", 3);
+                JsonAdapter::Pack(globalreg, writer, int_map_iter->second, name_map, 
+                        since);
             }
-            stream << "}";
+            writer.put('}');
             break;
         case TrackerMacMap:
             tmacmap = e->get_macmap();
-            stream << "{";
+            writer.put('{');
+            first = true;
             for (mac_map_iter = tmacmap->begin(); 
-                    mac_map_iter != tmacmap->end(); /* */) {
+                    mac_map_iter != tmacmap->end(); ++mac_map_iter) {
+                if (TrackerElementSerializer::delta_skip(mac_map_iter->second, since))
+                    continue;
+
+                if (!first)
+                    writer.put(',');
+                first = false;
+
                 // Mac keys are strings and we push only the mac not the mask */
-                stream << "\"" << mac_map_iter->first.Mac2String() << "\": ";
-                JsonAdapter::Pack(globalreg, stream, mac_map_iter->second, name_map);
-                if (++mac_map_iter != tmacmap->end())
-                    stream << ",";
+                writer.put_string(mac_map_iter->first.Mac2String());
+                writer.put(": ", 2);
+                JsonAdapter::Pack(globalreg, writer, mac_map_iter->second, name_map, 
+                        since);
             }
-            stream << "}";
+            writer.put('}');
             break;
         case TrackerStringMap:
             tstringmap = e->get_stringmap();
-            stream << "{";
+            writer.put('{');
+            first = true;
             for (string_map_iter = tstringmap->begin();
-                    string_map_iter != tstringmap->end(); /* */) {
-                stream << "\"" << string_map_iter->first << "\": ";
-                JsonAdapter::Pack(globalreg, stream, string_map_iter->second, name_map);
-                if (++string_map_iter != tstringmap->end())
-                    stream << ",";
+                    string_map_iter != tstringmap->end(); ++string_map_iter) {
+                if (TrackerElementSerializer::delta_skip(string_map_iter->second, since))
+                    continue;
+
+                if (!first)
+                    writer.put(',');
+                first = false;
+
+                writer.put_string(string_map_iter->first);
+                writer.put(": ", 2);
+                JsonAdapter::Pack(globalreg, writer, string_map_iter->second, name_map, 
+                        since);
             }
-            stream << "}";
+            writer.put('}');
             break;
         case TrackerDoubleMap:
             tdoublemap = e->get_doublemap();
-            stream << "{";
+            writer.put('{');
+            first = true;
             for (double_map_iter = tdoublemap->begin();
-                    double_map_iter != tdoublemap->end(); /* */) {
+                    double_map_iter != tdoublemap->end(); ++double_map_iter) {
+                if (TrackerElementSerializer::delta_skip(double_map_iter->second, since))
+                    continue;
+
+                if (!first)
+                    writer.put(',');
+                first = false;
+
                 // Double keys are handled as strings in json
-                stream << "\"" << fixed << double_map_iter->first << "\": ";
-                JsonAdapter::Pack(globalreg, stream, double_map_iter->second, name_map);
-                if (++double_map_iter != tdoublemap->end())
-                    stream << ",";
+                writer.put('"');
+                writer.put_double(double_map_iter->first);
+                writer.put("\": ", 3);
+                JsonAdapter::Pack(globalreg, writer, double_map_iter->second, name_map, 
+                        since);
             }
-            stream << "}";
+            writer.put('}');
             break;
         case TrackerByteArray:
             bytes = e->get_bytearray();
-            sz = e->get_bytearray_size();
-           
-            fflags = stream.flags();
-
-            stream << "\"";
-            for (size_t szx = 0; szx < sz; szx++) {
-                stream << std::uppercase << std::setfill('0') << std::setw(2) 
-                    << std::hex << (int) (bytes.get()[szx] & 0xFF);
-            }
-            stream << "\"";
-            stream.flags(fflags);
-
+            writer.put_hex(bytes.get(), e->get_bytearray_size());
             break;
 
-
         default:
             break;
     }
@@ -28,9 +28,71 @@
 
 namespace JsonAdapter {
 
+// Contiguous output buffer for JSON generation.  Values are formatted and 
+// escaped directly into the buffer instead of going through ostream
+// formatting, and field names are copied from the pre-rendered entry tracker
+// tokens.
+class JsonWriter {
+public:
+    JsonWriter(GlobalRegistry *in_globalreg);
+
+    // Append to the caller's string instead, such as the chunk handed to a
+    // streaming response
+    JsonWriter(GlobalRegistry *in_globalreg, string &in_target);
+
+    void put(char c) {
+        buffer.push_back(c);
+    }
+
+    void put(const char *in_data, size_t in_len) {
+        buffer.append(in_data, in_len);
+    }
+
+    void put(const string &in_str) {
+        buffer.append(in_str);
+    }
+
+    // Quoted and escaped string value
+    void put_string(const char *in_data, size_t in_len);
+    void put_string(const string &in_str) {
+        put_string(in_str.data(), in_str.length());
+    }
+
+    void put_int(int64_t in_val);
+    void put_uint(uint64_t in_val);
+    // Doubles are written in fixed notation, matching std::fixed
+    void put_double(double in_val);
+    // Quoted uppercase hex of a byte array
+    void put_hex(const uint8_t *in_data, size_t in_len);
+
+    // Write the quoted, escaped key of a field id, followed by the separator
+    void put_field_key(int in_id);
+
+    const string &str() {
+        return buffer;
+    }
+
+    void clear() {
+        buffer.clear();
+    }
+
+protected:
+    GlobalRegistry *globalreg;
+
+    string own_buffer;
+    string &buffer;
+};
+
+// Pack an element into an existing writer
+void Pack(GlobalRegistry *globalreg, JsonWriter &writer, SharedTrackerElement e,
+        TrackerElementSerializer::rename_map *name_map = NULL, uint64_t since = 0);
+
+// Pack an element as JSON.  When since is non-zero, keyed maps only include
+// children modified at or after that generation
 void Pack(GlobalRegistry *globalreg, std::stringstream &stream, SharedTrackerElement e,
-        TrackerElementSerializer::rename_map *name_map = NULL);
+        TrackerElementSerializer::rename_map *name_map = NULL, uint64_t since = 0);
 
+// Escape a string for inclusion in a JSON string value
 string SanitizeString(string in);
 
 class Serializer : public TrackerElementSerializer {
@@ -42,6 +104,34 @@ public:
             rename_map *name_map = NULL) {
         Pack(globalreg, stream, in_elem, name_map);
     }
+
+    virtual void serialize_delta(SharedTrackerElement in_elem, std::stringstream &stream,
+            uint64_t since, rename_map *name_map = NULL) {
+        Pack(globalreg, stream, in_elem, name_map, since);
+    }
+
+    virtual bool can_stream_vector() {
+        return true;
+    }
+
+    virtual void stream_serialize(SharedTrackerElement in_elem, string &out,
+            rename_map *name_map = NULL) {
+        JsonWriter writer(globalreg, out);
+        Pack(globalreg, writer, in_elem, name_map);
+    }
+
+    virtual void stream_vector_open(string &out, 
+            size_t in_size __attribute__((unused))) {
+        out.push_back('[');
+    }
+
+    virtual void stream_vector_separator(string &out) {
+        out.push_back(',');
+    }
+
+    virtual void stream_vector_close(string &out) {
+        out.push_back(']');
+    }
 };
 
 }
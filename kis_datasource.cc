@@ -149,84 +149,142 @@ void KisDataSource::register_fields() {
                 "number of packtes/device reports", &num_reports);
 }
 
-void KisDataSource::BufferAvailable(size_t in_amt) {
+void KisDataSource::BufferAvailable(size_t in_amt __attribute__((unused))) {
     simple_cap_proto_t *frame_header;
     uint8_t *buf;
+    size_t buf_sz;
     uint32_t frame_sz;
     uint32_t frame_checksum, calc_checksum;
 
-    if (in_amt < sizeof(simple_cap_proto_t)) {
-        return;
-    }
+    // in_amt is only what was just added; handle every complete frame which is
+    // buffered, in place
+    while (1) {
+        buf_sz = ipchandler->ZeroCopyPeekReadBufferData((void **) &buf,
+                ipchandler->GetReadBufferUsed());
 
-    // Peek the buffer
-    buf = new uint8_t[in_amt];
-    ipchandler->PeekReadBufferData(buf, in_amt);
+        if (buf_sz < sizeof(simple_cap_proto_t)) {
+            return;
+        }
 
-    frame_header = (simple_cap_proto_t *) buf;
+        frame_header = (simple_cap_proto_t *) buf;
 
-    if (kis_ntoh32(frame_header->signature) != KIS_CAP_SIMPLE_PROTO_SIG) {
-        // TODO kill connection or seek for valid
-        delete[] buf;
-        return;
-    }
+        // Without a signature we don't know where a frame starts, and
+        // waiting for more data won't find one
+        if (kis_ntoh32(frame_header->signature) != KIS_CAP_SIMPLE_PROTO_SIG) {
+            {
+                local_locker lock(&source_lock);
+                inc_ipc_errors(1);
+            }
 
-    frame_sz = kis_ntoh32(frame_header->packet_sz);
+            BufferError("Datasource sent a frame with an invalid signature, "
+                    "closing the source");
+            return;
+        }
 
-    if (frame_sz > in_amt) {
-        // Nothing we can do right now, not enough data to make up a
-        // complete packet.
-        delete[] buf;
-        return;
-    }
+        frame_sz = kis_ntoh32(frame_header->packet_sz);
 
-    // Get the checksum
-    frame_checksum = kis_ntoh32(frame_header->checksum);
+        // A frame can't be smaller than its header; the framing is lost and
+        // nothing after it can be trusted, so give up on the source
+        if (frame_sz < sizeof(simple_cap_proto_t)) {
+            {
+                local_locker lock(&source_lock);
+                inc_ipc_errors(1);
+            }
 
-    // Zero the checksum field in the packet
-    frame_header->checksum = 0x00000000;
+            BufferError("Datasource sent a frame too small to hold its header, "
+                    "closing the source");
+            return;
+        }
 
-    // Calc the checksum of the rest
-    calc_checksum = Adler32Checksum((const char *) buf, frame_sz);
+        if (frame_sz > buf_sz) {
+            // Nothing we can do right now, not enough data to make up a
+            // complete packet.
+            return;
+        }
 
-    // Compare to the saved checksum
-    if (calc_checksum != frame_checksum) {
-        // TODO report invalid checksum and disconnect
-        delete[] buf;
-        return;
-    }
+        // Get the checksum
+        frame_checksum = kis_ntoh32(frame_header->checksum);
 
-    // Consume the packet in the ringbuf 
-    ipchandler->GetReadBufferData(NULL, frame_sz);
+        // Zero the checksum field in the packet; it's ours to change, nothing
+        // else reads the buffer
+        frame_header->checksum = 0x00000000;
 
-    // Extract the kv pairs
-    KVmap kv_map;
+        // Calc the checksum of the rest
+        calc_checksum = Adler32Checksum((const char *) buf, frame_sz);
 
-    ssize_t data_offt = 0;
-    for (unsigned int kvn = 0; kvn < kis_ntoh32(frame_header->num_kv_pairs); kvn++) {
-        simple_cap_proto_kv *pkv =
-            (simple_cap_proto_kv *) &((frame_header->data)[data_offt]);
+        // Compare to the saved checksum; the field is already zeroed in the
+        // buffer so there's no retrying this frame
+        if (calc_checksum != frame_checksum) {
+            {
+                local_locker lock(&source_lock);
+                inc_ipc_errors(1);
+            }
 
-        data_offt = 
-            sizeof(simple_cap_proto_kv_h_t) +
-            kis_ntoh32(pkv->header.obj_sz);
+            BufferError("Datasource sent a frame with an invalid checksum, "
+                    "closing the source");
+            return;
+        }
 
-        KisDataSource_CapKeyedObject *kv =
-            new KisDataSource_CapKeyedObject(pkv);
+        // Reference the kv pairs where they sit, data follows the header of
+        // each pair
+        frame_kvpairs.clear();
 
-        kv_map[StrLower(kv->key)] = kv;
-    }
+        uint8_t *data = (uint8_t *) &(frame_header->data);
+        uint8_t *frame_end = buf + frame_sz;
+        uint32_t num_kv = kis_ntoh32(frame_header->num_kv_pairs);
+        bool kv_error = false;
 
-    char ctype[17];
-    snprintf(ctype, 17, "%s", frame_header->type);
-    handle_packet(ctype, kv_map);
+        for (unsigned int kvn = 0; kvn < num_kv; kvn++) {
+            simple_cap_proto_kv *pkv = (simple_cap_proto_kv *) data;
 
-    for (KVmap::iterator i = kv_map.begin(); i != kv_map.end(); ++i) {
-        delete i->second;
+            if (data + sizeof(simple_cap_proto_kv_h_t) > frame_end) {
+                kv_error = true;
+                break;
+            }
+
+            KisDataSource_CapKeyedRef kv;
+
+            kv.key = pkv->header.key;
+            kv.key_len = strnlen(pkv->header.key, sizeof(pkv->header.key));
+            kv.object = (const char *) &(pkv->object);
+            kv.size = kis_ntoh32(pkv->header.obj_sz);
+
+            if (kv.size > (size_t) (frame_end - (uint8_t *) kv.object)) {
+                kv_error = true;
+                break;
+            }
+
+            frame_kvpairs.push_back(kv);
+
+            data = (uint8_t *) kv.object + kv.size;
+        }
+
+        if (kv_error) {
+            local_locker lock(&source_lock);
+            inc_ipc_errors(1);
+        } else {
+            char ctype[17];
+            snprintf(ctype, 17, "%.16s", frame_header->type);
+            handle_packet(ctype, frame_kvpairs);
+        }
+
+        // Consume the packet in the ringbuf only once we're done with it
+        frame_kvpairs.clear();
+        ipchandler->ConsumeReadBufferData(frame_sz);
     }
+}
+
+KisDataSource_CapKeyedRef *KisDataSource::find_kv(KVrefs &in_kvpairs,
+        const char *in_key) {
+    size_t key_len = strlen(in_key);
 
-    delete[] buf;
+    for (unsigned int x = 0; x < in_kvpairs.size(); x++) {
+        if (in_kvpairs[x].key_len == key_len &&
+                strncasecmp(in_kvpairs[x].key, in_key, key_len) == 0)
+            return &(in_kvpairs[x]);
+    }
 
+    return NULL;
 }
 
 void KisDataSource::BufferError(string in_error) {
@@ -520,28 +578,28 @@ void KisDataSource::set_channel_hop(vector<string> in_channel_list,
     queue_ipc_command("CONFIGURE", kvmap);
 }
 
-void KisDataSource::handle_packet(string in_type, KVmap in_kvmap) {
+void KisDataSource::handle_packet(string in_type, KVrefs &in_kvpairs) {
     string ltype = StrLower(in_type);
 
     if (ltype == "status")
-        handle_packet_status(in_kvmap);
+        handle_packet_status(in_kvpairs);
     else if (ltype == "proberesp")
-        handle_packet_probe_resp(in_kvmap);
+        handle_packet_probe_resp(in_kvpairs);
     else if (ltype == "openresp")
-        handle_packet_open_resp(in_kvmap);
+        handle_packet_open_resp(in_kvpairs);
     else if (ltype == "error")
-        handle_packet_error(in_kvmap);
+        handle_packet_error(in_kvpairs);
     else if (ltype == "message")
-        handle_packet_message(in_kvmap);
+        handle_packet_message(in_kvpairs);
     else if (ltype == "data")
-        handle_packet_data(in_kvmap);
+        handle_packet_data(in_kvpairs);
 }
 
-void KisDataSource::handle_packet_status(KVmap in_kvpairs) {
-    KVmap::iterator i;
+void KisDataSource::handle_packet_status(KVrefs &in_kvpairs) {
+    KisDataSource_CapKeyedRef *i;
     
-    if ((i = in_kvpairs.find("message")) != in_kvpairs.end()) {
-        handle_kv_message(i->second);
+    if ((i = find_kv(in_kvpairs, "message")) != NULL) {
+        handle_kv_message(i);
     }
 
     // If we just launched, this lets us know we're awake and can 
@@ -549,27 +607,27 @@ void KisDataSource::handle_packet_status(KVmap in_kvpairs) {
 
 }
 
-void KisDataSource::handle_packet_probe_resp(KVmap in_kvpairs) {
-    KVmap::iterator i;
+void KisDataSource::handle_packet_probe_resp(KVrefs &in_kvpairs) {
+    KisDataSource_CapKeyedRef *i;
 
     // Process any messages
-    if ((i = in_kvpairs.find("message")) != in_kvpairs.end()) {
-        handle_kv_message(i->second);
+    if ((i = find_kv(in_kvpairs, "message")) != NULL) {
+        handle_kv_message(i);
     }
 
     // Process channels list if we got one
-    if ((i = in_kvpairs.find("channels")) != in_kvpairs.end()) {
-        if (!handle_kv_channels(i->second))
+    if ((i = find_kv(in_kvpairs, "channels")) != NULL) {
+        if (!handle_kv_channels(i))
             return;
     }
 
     // Process success value and callback
-    if ((i = in_kvpairs.find("success")) != in_kvpairs.end()) {
+    if ((i = find_kv(in_kvpairs, "success")) != NULL) {
         local_locker lock(&source_lock);
 
         if (probe_callback != NULL) {
             (*probe_callback)(shared_ptr<KisDataSource>(this), probe_aux, 
-                    handle_kv_success(i->second));
+                    handle_kv_success(i));
         }
     } else {
         // ProbeResp with no success value?  ehh.
@@ -582,27 +640,27 @@ void KisDataSource::handle_packet_probe_resp(KVmap in_kvpairs) {
     source_ipc->close_ipc();
 }
 
-void KisDataSource::handle_packet_open_resp(KVmap in_kvpairs) {
-    KVmap::iterator i;
+void KisDataSource::handle_packet_open_resp(KVrefs &in_kvpairs) {
+    KisDataSource_CapKeyedRef *i;
 
     // Process any messages
-    if ((i = in_kvpairs.find("message")) != in_kvpairs.end()) {
-        handle_kv_message(i->second);
+    if ((i = find_kv(in_kvpairs, "message")) != NULL) {
+        handle_kv_message(i);
     }
 
     // Process channels list if we got one
-    if ((i = in_kvpairs.find("channels")) != in_kvpairs.end()) {
-        if (!handle_kv_channels(i->second))
+    if ((i = find_kv(in_kvpairs, "channels")) != NULL) {
+        if (!handle_kv_channels(i))
             return;
     }
 
     // Process success value and callback
-    if ((i = in_kvpairs.find("success")) != in_kvpairs.end()) {
+    if ((i = find_kv(in_kvpairs, "success")) != NULL) {
         local_locker lock(&source_lock);
 
         if (open_callback != NULL) {
             (*open_callback)(shared_ptr<KisDataSource>(this), 
-                    open_aux, handle_kv_success(i->second));
+                    open_aux, handle_kv_success(i));
         }
     } else {
         // OpenResp with no success value?  ehh.
@@ -613,12 +671,12 @@ void KisDataSource::handle_packet_open_resp(KVmap in_kvpairs) {
 
 }
 
-void KisDataSource::handle_packet_error(KVmap in_kvpairs) {
-    KVmap::iterator i;
+void KisDataSource::handle_packet_error(KVrefs &in_kvpairs) {
+    KisDataSource_CapKeyedRef *i;
 
     // Process any messages
-    if ((i = in_kvpairs.find("message")) != in_kvpairs.end()) {
-        handle_kv_message(i->second);
+    if ((i = find_kv(in_kvpairs, "message")) != NULL) {
+        handle_kv_message(i);
     }
 
     // Lock only after handling messages
@@ -637,43 +695,43 @@ void KisDataSource::handle_packet_error(KVmap in_kvpairs) {
 }
 
 
-void KisDataSource::handle_packet_message(KVmap in_kvpairs) {
-    KVmap::iterator i;
+void KisDataSource::handle_packet_message(KVrefs &in_kvpairs) {
+    KisDataSource_CapKeyedRef *i;
 
     // Process any messages
-    if ((i = in_kvpairs.find("message")) != in_kvpairs.end()) {
-        handle_kv_message(i->second);
+    if ((i = find_kv(in_kvpairs, "message")) != NULL) {
+        handle_kv_message(i);
     }
 }
 
-void KisDataSource::handle_packet_data(KVmap in_kvpairs) {
-    KVmap::iterator i;
+void KisDataSource::handle_packet_data(KVrefs &in_kvpairs) {
+    KisDataSource_CapKeyedRef *i;
 
     kis_packet *packet = NULL;
     kis_layer1_packinfo *siginfo = NULL;
     kis_gps_packinfo *gpsinfo = NULL;
 
     // Process any messages
-    if ((i = in_kvpairs.find("message")) != in_kvpairs.end()) {
-        handle_kv_message(i->second);
+    if ((i = find_kv(in_kvpairs, "message")) != NULL) {
+        handle_kv_message(i);
     }
 
     // Do we have a packet?
-    if ((i = in_kvpairs.find("packet")) != in_kvpairs.end()) {
-        packet = handle_kv_packet(i->second);
+    if ((i = find_kv(in_kvpairs, "packet")) != NULL) {
+        packet = handle_kv_packet(i);
     }
 
     if (packet == NULL)
         return;
 
     // Gather signal data
-    if ((i = in_kvpairs.find("signal")) != in_kvpairs.end()) {
-        siginfo = handle_kv_signal(i->second);
+    if ((i = find_kv(in_kvpairs, "signal")) != NULL) {
+        siginfo = handle_kv_signal(i);
     }
     
     // Gather GPS data
-    if ((i = in_kvpairs.find("gps")) != in_kvpairs.end()) {
-        gpsinfo = handle_kv_gps(i->second);
+    if ((i = find_kv(in_kvpairs, "gps")) != NULL) {
+        gpsinfo = handle_kv_gps(i);
     }
 
     // Add them to the packet
@@ -694,7 +752,7 @@ void KisDataSource::handle_packet_data(KVmap in_kvpairs) {
 
 }
 
-bool KisDataSource::handle_kv_success(KisDataSource_CapKeyedObject *in_obj) {
+bool KisDataSource::handle_kv_success(KisDataSource_CapKeyedRef *in_obj) {
     // Not a msgpacked object, just a single byte
     if (in_obj->size != 1) {
         local_locker lock(&source_lock);
@@ -705,7 +763,7 @@ bool KisDataSource::handle_kv_success(KisDataSource_CapKeyedObject *in_obj) {
     return in_obj->object[0];
 }
 
-bool KisDataSource::handle_kv_message(KisDataSource_CapKeyedObject *in_obj) {
+bool KisDataSource::handle_kv_message(KisDataSource_CapKeyedRef *in_obj) {
     // Unpack the dictionary
     MsgpackAdapter::MsgpackStrMap dict;
     msgpack::unpacked result;
@@ -751,7 +809,7 @@ bool KisDataSource::handle_kv_message(KisDataSource_CapKeyedObject *in_obj) {
 
 }
 
-bool KisDataSource::handle_kv_channels(KisDataSource_CapKeyedObject *in_obj) {
+bool KisDataSource::handle_kv_channels(KisDataSource_CapKeyedRef *in_obj) {
     // Unpack the dictionary
     MsgpackAdapter::MsgpackStrMap dict;
     msgpack::unpacked result;
@@ -794,7 +852,7 @@ bool KisDataSource::handle_kv_channels(KisDataSource_CapKeyedObject *in_obj) {
     return true;
 }
 
-kis_layer1_packinfo *KisDataSource::handle_kv_signal(KisDataSource_CapKeyedObject *in_obj) {
+kis_layer1_packinfo *KisDataSource::handle_kv_signal(KisDataSource_CapKeyedRef *in_obj) {
     kis_layer1_packinfo *siginfo = new kis_layer1_packinfo();
 
     // Unpack the dictionary
@@ -858,7 +916,7 @@ kis_layer1_packinfo *KisDataSource::handle_kv_signal(KisDataSource_CapKeyedObjec
     return siginfo;
 }
 
-kis_gps_packinfo *KisDataSource::handle_kv_gps(KisDataSource_CapKeyedObject *in_obj) {
+kis_gps_packinfo *KisDataSource::handle_kv_gps(KisDataSource_CapKeyedRef *in_obj) {
     kis_gps_packinfo *gpsinfo = new kis_gps_packinfo();
 
     // Unpack the dictionary
@@ -925,7 +983,15 @@ kis_gps_packinfo *KisDataSource::handle_kv_gps(KisDataSource_CapKeyedObject *in_
 
 }
 
-kis_packet *KisDataSource::handle_kv_packet(KisDataSource_CapKeyedObject *in_obj) {
+// Leave binary blobs where they are in the frame instead of copying them into
+// the unpacking zone
+static bool kv_reference_bin(msgpack::type::object_type type, 
+        std::size_t size __attribute__((unused)), 
+        void *user_data __attribute__((unused))) {
+    return type == msgpack::type::BIN;
+}
+
+kis_packet *KisDataSource::handle_kv_packet(KisDataSource_CapKeyedRef *in_obj) {
     kis_packet *packet = packetchain->GeneratePacket();
     kis_datachunk *datachunk = new kis_datachunk();
 
@@ -935,7 +1001,7 @@ kis_packet *KisDataSource::handle_kv_packet(KisDataSource_CapKeyedObject *in_obj
     MsgpackAdapter::MsgpackStrMap::iterator obj_iter;
 
     try {
-        msgpack::unpack(result, in_obj->object, in_obj->size);
+        msgpack::unpack(result, in_obj->object, in_obj->size, kv_reference_bin);
         msgpack::object deserialized = result.get();
         dict = deserialized.as<MsgpackAdapter::MsgpackStrMap>();
 
@@ -976,7 +1042,9 @@ kis_packet *KisDataSource::handle_kv_packet(KisDataSource_CapKeyedObject *in_obj
             throw std::runtime_error(string("packet size did not match data size"));
         }
 
-        datachunk->copy_data((const uint8_t *) rawdata.via.bin.ptr, size);
+        // The frame stays in the read buffer until the packet has been 
+        // through the packetchain, so the data is used where it is
+        datachunk->set_data((uint8_t *) rawdata.via.bin.ptr, size, false);
 
     } catch (const std::exception& e) {
         // Something went wrong with msgpack unpacking
@@ -1083,21 +1151,11 @@ KisDataSource_QueuedCommand::KisDataSource_QueuedCommand(string in_cmd,
     insert_time = in_time;
 }
 
-KisDataSource_CapKeyedObject::KisDataSource_CapKeyedObject(simple_cap_proto_kv *in_kp) {
-    char ckey[17];
-
-    snprintf(ckey, 17, "%s", in_kp->header.key);
-    key = string(ckey);
-
-    size = kis_ntoh32(in_kp->header.obj_sz);
-    object = new char[size];
-    memcpy(object, in_kp->object, size);
-}
-
 KisDataSource_CapKeyedObject::KisDataSource_CapKeyedObject(string in_key,
         const char *in_object, ssize_t in_len) {
 
     key = in_key.substr(0, 16);
+    size = in_len;
     object = new char[in_len];
     memcpy(object, in_object, in_len);
 }
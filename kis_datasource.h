@@ -57,6 +57,10 @@
  * Data sources derive from trackable elements so they can be easily 
  * serialized for status
  *
+ * Received frames are parsed in place in the read buffer; every complete
+ * frame is handled each time data arrives, and the kv pairs of a frame
+ * point into the buffer until the frame has been handled and consumed.
+ *
  */
 
 /* DST forward ref */
@@ -65,6 +69,18 @@ class DatasourceTracker;
 /* Keypair object from cap proto */
 class KisDataSource_CapKeyedObject;
 
+/* Keypair of a received frame, referenced in place in the read buffer; only
+ * valid while the frame is being handled */
+class KisDataSource_CapKeyedRef {
+public:
+    // Key, nul padded, not necessarily nul terminated
+    const char *key;
+    size_t key_len;
+
+    const char *object;
+    size_t size;
+};
+
 // Queued command/data
 class KisDataSource_QueuedCommand;
 
@@ -208,10 +224,13 @@ public:
     virtual void BufferAvailable(size_t in_amt);
     virtual void BufferError(string in_error);
 
-    // KV pair map
+    // KV pair map, for commands we send
     typedef map<string, KisDataSource_CapKeyedObject *> KVmap;
     typedef pair<string, KisDataSource_CapKeyedObject *> KVpair;
 
+    // KV pairs of a frame we received
+    typedef vector<KisDataSource_CapKeyedRef> KVrefs;
+
 protected:
     GlobalRegistry *globalreg;
 
@@ -303,6 +322,12 @@ protected:
     IPCRemoteV2 *source_ipc;
     RingbufferHandler *ipchandler;
 
+    // KV pairs of the frame being handled, kept to reuse the allocation
+    KVrefs frame_kvpairs;
+
+    // Find a kv pair by key, case insensitive, or NULL
+    KisDataSource_CapKeyedRef *find_kv(KVrefs &in_kvpairs, const char *in_key);
+
     // Commands waiting to be sent
     vector<KisDataSource_QueuedCommand *> pending_commands;
 
@@ -314,23 +339,25 @@ protected:
     virtual bool write_ipc_packet(string in_type, KVmap *in_kvpairs);
 
     // Top-level packet handler
-    virtual void handle_packet(string in_type, KVmap in_kvmap);
+    virtual void handle_packet(string in_type, KVrefs &in_kvpairs);
 
     // Standard packet types
-    virtual void handle_packet_status(KVmap in_kvpairs);
-    virtual void handle_packet_probe_resp(KVmap in_kvpairs);
-    virtual void handle_packet_open_resp(KVmap in_kvpairs);
-    virtual void handle_packet_error(KVmap in_kvpairs);
-    virtual void handle_packet_message(KVmap in_kvpairs);
-    virtual void handle_packet_data(KVmap in_kvpairs);
+    virtual void handle_packet_status(KVrefs &in_kvpairs);
+    virtual void handle_packet_probe_resp(KVrefs &in_kvpairs);
+    virtual void handle_packet_open_resp(KVrefs &in_kvpairs);
+    virtual void handle_packet_error(KVrefs &in_kvpairs);
+    virtual void handle_packet_message(KVrefs &in_kvpairs);
+    virtual void handle_packet_data(KVrefs &in_kvpairs);
 
     // Common message kv pair
-    virtual bool handle_kv_success(KisDataSource_CapKeyedObject *in_obj);
-    virtual bool handle_kv_message(KisDataSource_CapKeyedObject *in_obj);
-    virtual bool handle_kv_channels(KisDataSource_CapKeyedObject *in_obj);
-    virtual kis_gps_packinfo *handle_kv_gps(KisDataSource_CapKeyedObject *in_obj);
-    virtual kis_layer1_packinfo *handle_kv_signal(KisDataSource_CapKeyedObject *in_obj);
-    virtual kis_packet *handle_kv_packet(KisDataSource_CapKeyedObject *in_obj);
+    virtual bool handle_kv_success(KisDataSource_CapKeyedRef *in_obj);
+    virtual bool handle_kv_message(KisDataSource_CapKeyedRef *in_obj);
+    virtual bool handle_kv_channels(KisDataSource_CapKeyedRef *in_obj);
+    virtual kis_gps_packinfo *handle_kv_gps(KisDataSource_CapKeyedRef *in_obj);
+    virtual kis_layer1_packinfo *handle_kv_signal(KisDataSource_CapKeyedRef *in_obj);
+    // The packet references the frame in the read buffer, and must be 
+    // processed before the frame is consumed
+    virtual kis_packet *handle_kv_packet(KisDataSource_CapKeyedRef *in_obj);
 
     // Spawn an IPC process, using the source_ipc_bin.  If the IPC system is running
     // already, issue a kill
@@ -350,7 +377,6 @@ public:
 
 class KisDataSource_CapKeyedObject {
 public:
-    KisDataSource_CapKeyedObject(simple_cap_proto_kv *in_kp);
     KisDataSource_CapKeyedObject(string in_key, const char *in_object, ssize_t in_len);
     ~KisDataSource_CapKeyedObject();
 
@@ -0,0 +1,286 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <map>
+#include <sstream>
+
+#include "util.h"
+#include "messagebus.h"
+#include "entrytracker.h"
+#include "json_adapter.h"
+#include "kis_httpd_eventstream.h"
+
+kis_eventstream_subscriber::kis_eventstream_subscriber(Kis_Httpd_Eventstream *in_eventstream,
+        shared_ptr<EntryTracker> in_entrytracker) :
+    projection(in_entrytracker) {
+
+    eventstream = in_eventstream;
+    buffer = new Kis_Net_Httpd_Buffer_Stream(KIS_HTTPD_EVENTSTREAM_QUEUESZ);
+    overflowed = false;
+}
+
+kis_eventstream_subscriber::~kis_eventstream_subscriber() {
+    delete(buffer);
+}
+
+static ssize_t eventstream_reader(void *cls, uint64_t pos __attribute__((unused)),
+        char *buf, size_t max) {
+    kis_eventstream_subscriber *sub = (kis_eventstream_subscriber *) cls;
+
+    return sub->buffer->read(buf, max);
+}
+
+// Guards the subscribers' back-pointers to the eventstream.  It has to outlive
+// the eventstream, whose own subscriber_mutex is gone by the time the
+// webserver frees a connection it was ending.
+static pthread_mutex_t eventstream_backref_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void eventstream_free_callback(void *cls) {
+    kis_eventstream_subscriber *sub = (kis_eventstream_subscriber *) cls;
+
+    {
+        local_locker lock(&eventstream_backref_mutex);
+
+        if (sub->eventstream != NULL)
+            sub->eventstream->RemoveSubscriber(sub);
+    }
+
+    delete(sub);
+}
+
+Kis_Httpd_Eventstream::Kis_Httpd_Eventstream(GlobalRegistry *in_globalreg) :
+    Kis_Net_Httpd_Stream_Handler(in_globalreg) {
+
+    globalreg = in_globalreg;
+
+    entrytracker =
+        static_pointer_cast<EntryTracker>(globalreg->FetchGlobal("ENTRY_TRACKER"));
+
+    pthread_mutex_init(&subscriber_mutex, NULL);
+
+    keepalive_timer =
+        globalreg->timetracker->RegisterTimer(SERVER_TIMESLICES_SEC *
+                KIS_HTTPD_EVENTSTREAM_KEEPALIVE, NULL, 1, this);
+
+    Httpd_RegisterRoute("GET", "/eventstream/events");
+}
+
+Kis_Httpd_Eventstream::~Kis_Httpd_Eventstream() {
+    globalreg->RemoveGlobal("HTTPD_EVENTSTREAM");
+
+    globalreg->timetracker->RemoveTimer(keepalive_timer);
+
+    {
+        local_locker backref_lock(&eventstream_backref_mutex);
+        local_locker lock(&subscriber_mutex);
+
+        // The connections outlive us; end them and let the webserver free the
+        // subscribers when it closes them
+        for (unsigned int x = 0; x < subscriber_vec.size(); x++) {
+            subscriber_vec[x]->eventstream = NULL;
+            subscriber_vec[x]->buffer->complete();
+        }
+
+        subscriber_vec.clear();
+    }
+
+    pthread_mutex_destroy(&subscriber_mutex);
+}
+
+bool Kis_Httpd_Eventstream::Httpd_VerifyPath(const char *path, const char *method) {
+    if (strcmp(method, "GET") != 0)
+        return false;
+
+    if (strcmp(path, "/eventstream/events") == 0)
+        return true;
+
+    return false;
+}
+
+int Kis_Httpd_Eventstream::Httpd_HandleRequest(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection,
+        const char *url, const char *method __attribute__((unused)),
+        const char *upload_data __attribute__((unused)),
+        size_t *upload_data_size __attribute__((unused))) {
+
+    map<string, string> args;
+    Kis_Net_Httpd::GetArguments(connection, args);
+
+    kis_eventstream_subscriber *sub =
+        new kis_eventstream_subscriber(this, entrytracker);
+
+    map<string, string>::iterator ai = args.find("topics");
+
+    if (ai != args.end()) {
+        vector<string> topics = StrTokenize(ai->second, ",");
+
+        for (unsigned int x = 0; x < topics.size(); x++)
+            sub->topics.insert(StrLower(StrStrip(topics[x])));
+    } else {
+        sub->topics.insert(KIS_EVENTSTREAM_TOPIC_DEVICE);
+        sub->topics.insert(KIS_EVENTSTREAM_TOPIC_ALERT);
+        sub->topics.insert(KIS_EVENTSTREAM_TOPIC_MESSAGE);
+    }
+
+    sub->projection.parse(args);
+
+    if (args.find("fields") != args.end())
+        sub->projection_key += args["fields"];
+    sub->projection_key += "|";
+    if (args.find("exclude") != args.end())
+        sub->projection_key += args["exclude"];
+
+    if (httpd->UsingThreadPool())
+        sub->buffer->set_suspend_connection(connection->connection);
+
+    // Tell the browser how long to wait before reconnecting
+    sub->buffer->write("retry: 5000\n\n");
+
+    struct MHD_Response *response =
+        MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4096,
+                &eventstream_reader, sub, &eventstream_free_callback);
+
+    if (response == NULL) {
+        delete(sub);
+        return MHD_NO;
+    }
+
+    connection->response_headers[MHD_HTTP_HEADER_CONTENT_TYPE] = "text/event-stream";
+    connection->response_headers[MHD_HTTP_HEADER_CACHE_CONTROL] = "no-cache";
+
+    Kis_Net_Httpd::AppendStandardHeaders(httpd, connection, response, url);
+
+    {
+        local_locker lock(&subscriber_mutex);
+        subscriber_vec.push_back(sub);
+    }
+
+    int ret = MHD_queue_response(connection->connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+
+    return ret;
+}
+
+int Kis_Httpd_Eventstream::timetracker_event(int eventid) {
+    if (eventid != keepalive_timer)
+        return 1;
+
+    // Idle streams need traffic to keep proxies from closing them, and so that
+    // we notice clients which have gone away
+    local_locker lock(&subscriber_mutex);
+
+    for (unsigned int x = 0; x < subscriber_vec.size(); x++)
+        QueueEvent(subscriber_vec[x], ": keepalive\n\n");
+
+    return 1;
+}
+
+bool Kis_Httpd_Eventstream::HasSubscribers(string in_topic) {
+    local_locker lock(&subscriber_mutex);
+
+    for (unsigned int x = 0; x < subscriber_vec.size(); x++) {
+        if (subscriber_vec[x]->topics.find(in_topic) != subscriber_vec[x]->topics.end())
+            return true;
+    }
+
+    return false;
+}
+
+void Kis_Httpd_Eventstream::RemoveSubscriber(kis_eventstream_subscriber *in_sub) {
+    local_locker lock(&subscriber_mutex);
+
+    for (unsigned int x = 0; x < subscriber_vec.size(); x++) {
+        if (subscriber_vec[x] == in_sub) {
+            subscriber_vec.erase(subscriber_vec.begin() + x);
+            break;
+        }
+    }
+}
+
+void Kis_Httpd_Eventstream::QueueEvent(kis_eventstream_subscriber *in_sub,
+        const string &in_event) {
+
+    if (in_sub->buffer->get_pending() + in_event.length() >
+            KIS_HTTPD_EVENTSTREAM_QUEUESZ) {
+        in_sub->overflowed = true;
+        return;
+    }
+
+    // Let the client know it missed events and needs to fetch the current
+    // state before relying on the stream again
+    if (in_sub->overflowed) {
+        in_sub->overflowed = false;
+        in_sub->buffer->write("event: overflow\ndata: {}\n\n");
+    }
+
+    in_sub->buffer->write(in_event);
+}
+
+void Kis_Httpd_Eventstream::Publish(string in_topic, SharedTrackerElement in_elem,
+        bool in_projectable) {
+
+    local_locker lock(&subscriber_mutex);
+
+    // Events rendered for each distinct projection
+    map<string, string> rendered;
+
+    for (unsigned int x = 0; x < subscriber_vec.size(); x++) {
+        kis_eventstream_subscriber *sub = subscriber_vec[x];
+
+        if (sub->topics.find(in_topic) == sub->topics.end())
+            continue;
+
+        string key = in_projectable ? sub->projection_key : "";
+
+        map<string, string>::iterator ri = rendered.find(key);
+
+        if (ri == rendered.end()) {
+            SharedTrackerElement e = in_elem;
+            TrackerElementSerializer::rename_map rename_map;
+
+            if (in_projectable && !sub->projection.empty()) {
+                if (in_elem->get_type() == TrackerVector) {
+                    e.reset(new TrackerElement(TrackerVector, in_elem->get_id()));
+
+                    TrackerElementVector v(in_elem);
+                    for (TrackerElementVector::iterator vi = v.begin();
+                            vi != v.end(); ++vi) {
+                        e->add_vector(sub->projection.apply(*vi, rename_map));
+                    }
+                } else {
+                    e = sub->projection.apply(in_elem, rename_map);
+                }
+            }
+
+            JsonAdapter::JsonWriter writer(globalreg);
+
+            writer.put("event: ");
+            writer.put(in_topic);
+            writer.put("\ndata: ");
+            JsonAdapter::Pack(globalreg, writer, e, &rename_map);
+            writer.put("\n\n");
+
+            ri = rendered.insert(make_pair(key, writer.str())).first;
+        }
+
+        QueueEvent(sub, ri->second);
+    }
+}
+
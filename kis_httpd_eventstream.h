@@ -0,0 +1,136 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __KIS_HTTPD_EVENTSTREAM_H__
+#define __KIS_HTTPD_EVENTSTREAM_H__
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <pthread.h>
+
+#include "globalregistry.h"
+#include "trackedelement.h"
+#include "timetracker.h"
+#include "kis_net_microhttpd.h"
+#include "devicetracker.h"
+
+// Most that can be queued for a single subscriber before events are dropped
+#define KIS_HTTPD_EVENTSTREAM_QUEUESZ       (1024 * 512)
+
+// Seconds between keepalive comments on idle streams
+#define KIS_HTTPD_EVENTSTREAM_KEEPALIVE     15
+
+// Event topics
+#define KIS_EVENTSTREAM_TOPIC_DEVICE        "device"
+#define KIS_EVENTSTREAM_TOPIC_ALERT         "alert"
+#define KIS_EVENTSTREAM_TOPIC_MESSAGE       "message"
+
+class Kis_Httpd_Eventstream;
+
+// A connected client and the queue of events waiting to be sent to it
+class kis_eventstream_subscriber {
+public:
+    kis_eventstream_subscriber(Kis_Httpd_Eventstream *in_eventstream,
+            shared_ptr<EntryTracker> in_entrytracker);
+    ~kis_eventstream_subscriber();
+
+    Kis_Httpd_Eventstream *eventstream;
+
+    set<string> topics;
+
+    // Field selection for device events, and a key which is identical for
+    // subscribers asking for the same projection
+    devicetracker_projection projection;
+    string projection_key;
+
+    Kis_Net_Httpd_Buffer_Stream *buffer;
+
+    // Events were dropped because the client wasn't keeping up
+    bool overflowed;
+};
+
+// Server-Sent Events channel.  Clients subscribe to topics with a single
+// long-lived GET, and publishers push events to every subscriber instead of
+// each client polling for changes.  Each subscriber has a bounded queue; a
+// client which falls too far behind loses events and is told to re-sync.
+class Kis_Httpd_Eventstream : public Kis_Net_Httpd_Stream_Handler,
+    public TimetrackerEvent, public LifetimeGlobal {
+public:
+    static shared_ptr<Kis_Httpd_Eventstream>
+        create_eventstream(GlobalRegistry *in_globalreg) {
+        shared_ptr<Kis_Httpd_Eventstream> mon(new Kis_Httpd_Eventstream(in_globalreg));
+        in_globalreg->RegisterLifetimeGlobal(mon);
+        in_globalreg->InsertGlobal("HTTPD_EVENTSTREAM", mon);
+        return mon;
+    }
+
+private:
+    Kis_Httpd_Eventstream(GlobalRegistry *in_globalreg);
+
+public:
+    virtual ~Kis_Httpd_Eventstream();
+
+    virtual bool Httpd_VerifyPath(const char *path, const char *method);
+
+    // Never called; event streams are sent by Httpd_HandleRequest
+    virtual void Httpd_CreateStreamResponse(Kis_Net_Httpd *httpd __attribute__((unused)),
+            Kis_Net_Httpd_Connection *connection __attribute__((unused)),
+            const char *url __attribute__((unused)),
+            const char *method __attribute__((unused)),
+            const char *upload_data __attribute__((unused)),
+            size_t *upload_data_size __attribute__((unused)),
+            std::stringstream &stream __attribute__((unused))) { }
+
+    virtual int Httpd_HandleRequest(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection,
+            const char *url, const char *method, const char *upload_data,
+            size_t *upload_data_size);
+
+    virtual int timetracker_event(int eventid);
+
+    // Is anyone subscribed to a topic; publishers should check this before
+    // doing any work to build an event
+    bool HasSubscribers(string in_topic);
+
+    // Send an event to every subscriber of a topic.  Projectable events have
+    // the subscriber field selection applied to the element, or to each
+    // element of a vector.  The element is only read during the call.
+    void Publish(string in_topic, SharedTrackerElement in_elem,
+            bool in_projectable = false);
+
+    // Called when the connection of a subscriber is closed
+    void RemoveSubscriber(kis_eventstream_subscriber *in_sub);
+
+protected:
+    GlobalRegistry *globalreg;
+    shared_ptr<EntryTracker> entrytracker;
+
+    pthread_mutex_t subscriber_mutex;
+    vector<kis_eventstream_subscriber *> subscriber_vec;
+
+    int keepalive_timer;
+
+    // Queue a pre-formatted event, dropping it if the subscriber is full
+    void QueueEvent(kis_eventstream_subscriber *in_sub, const string &in_event);
+};
+
+#endif
+
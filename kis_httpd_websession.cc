@@ -41,6 +41,9 @@ Kis_Httpd_Websession::Kis_Httpd_Websession(GlobalRegistry *in_globalreg) :
 
     conf_username = up[0];
     conf_password = up[1];
+
+    Httpd_RegisterRoute("GET", "/session/create_session");
+    Httpd_RegisterRoute("GET", "/session/check_session");
 }
 
 Kis_Httpd_Websession::~Kis_Httpd_Websession() {
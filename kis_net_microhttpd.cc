@@ -24,6 +24,7 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <functional>
 #include <stdio.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -35,6 +36,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <math.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 
 #include "globalregistry.h"
 #include "messagebus.h"
@@ -53,6 +58,15 @@ Kis_Net_Httpd::Kis_Net_Httpd(GlobalRegistry *in_globalreg) {
     cert_key = NULL;
 
     pthread_mutex_init(&controller_mutex, NULL);
+    pthread_mutex_init(&cache_mutex, NULL);
+    pthread_mutex_init(&longpoll_mutex, NULL);
+    pthread_mutex_init(&static_cache_mutex, NULL);
+    pthread_mutex_init(&client_mutex, NULL);
+    pthread_cond_init(&longpoll_cond, NULL);
+
+    longpoll_timer = -1;
+
+    response_cache_bytes = 0;
 
     if (globalreg->kismet_config == NULL) {
         fprintf(stderr, "FATAL OOPS: Kis_Net_Httpd called without kismet_config\n");
@@ -60,6 +74,7 @@ Kis_Net_Httpd::Kis_Net_Httpd(GlobalRegistry *in_globalreg) {
     }
 
     http_port = globalreg->kismet_config->FetchOptUInt("httpd_port", 2501);
+    http_bind_address = globalreg->kismet_config->FetchOpt("httpd_bind_address");
 
     http_data_dir = globalreg->kismet_config->FetchOpt("httpd_home");
     http_aux_data_dir = globalreg->kismet_config->FetchOpt("httpd_user_home");
@@ -90,13 +105,88 @@ Kis_Net_Httpd::Kis_Net_Httpd(GlobalRegistry *in_globalreg) {
     }
 
     if (http_serve_files == false && http_serve_user_files == false) {
-        RegisterHandler(new Kis_Net_Httpd_No_Files_Handler());
+        Kis_Net_Httpd_Handler *nofiles = new Kis_Net_Httpd_No_Files_Handler();
+        RegisterHandler(nofiles);
+        RegisterRoute("GET", "/", nofiles);
+        RegisterRoute("GET", "/index.html", nofiles);
+    }
+
+    response_cache_enabled = 
+        globalreg->kismet_config->FetchOptBoolean("httpd_response_cache", true);
+
+#ifdef HAVE_LIBZ
+    compression_level = 
+        globalreg->kismet_config->FetchOptUInt("httpd_compression_level", 6);
+    if (compression_level > 9) {
+        _MSG("Invalid httpd_compression_level, expected 0 to 9; using 9", MSGFLAG_ERROR);
+        compression_level = 9;
+    }
+#else
+    compression_level = 0;
+#endif
+
+    compression_min_size = 
+        globalreg->kismet_config->FetchOptUInt("httpd_compression_min_size", 1024);
+
+    post_max_size = 
+        (size_t) globalreg->kismet_config->FetchOptUInt("httpd_post_max_size", 16384) * 1024;
+
+    // Rate limits are rate,burst in requests per second
+    const char *rate_opts[KIS_HTTPD_CLASS_MAX] = 
+        { "httpd_rate_limit_light", "httpd_rate_limit_heavy" };
+    const char *rate_defaults[KIS_HTTPD_CLASS_MAX] = { "0,0", "5,20" };
+
+    for (unsigned int c = 0; c < KIS_HTTPD_CLASS_MAX; c++) {
+        string opt = globalreg->kismet_config->FetchOpt(rate_opts[c]);
+
+        if (opt == "")
+            opt = rate_defaults[c];
+
+        if (sscanf(opt.c_str(), "%lf,%lf", &(rate_limit[c]), &(rate_burst[c])) != 2 ||
+                rate_limit[c] < 0 || rate_burst[c] < 1) {
+            if (opt != "0,0")
+                _MSG("Invalid " + string(rate_opts[c]) + ", expected rate,burst; "
+                        "disabling the limit", MSGFLAG_ERROR);
+            rate_limit[c] = 0;
+            rate_burst[c] = 0;
+        }
     }
 
+    heavy_concurrency = 
+        globalreg->kismet_config->FetchOptUInt("httpd_heavy_concurrency", 4);
+    heavy_active = 0;
+
     use_ssl = globalreg->kismet_config->FetchOptBoolean("httpd_ssl", false);
     pem_path = globalreg->kismet_config->FetchOpt("httpd_ssl_cert");
     key_path = globalreg->kismet_config->FetchOpt("httpd_ssl_key");
 
+    string mode = StrLower(globalreg->kismet_config->FetchOpt("httpd_mode"));
+
+    if (mode == "" || mode == "thread") {
+        httpd_mode = KIS_HTTPD_MODE_THREAD;
+    } else if (mode == "pool") {
+        httpd_mode = KIS_HTTPD_MODE_POOL;
+    } else {
+        _MSG("Unknown httpd_mode '" + mode + "', expected 'thread' or 'pool'; "
+                "using 'thread'", MSGFLAG_ERROR);
+        httpd_mode = KIS_HTTPD_MODE_THREAD;
+    }
+
+    // Default to a pool thread per core
+    pool_size = globalreg->kismet_config->FetchOptUInt("httpd_pool_size", 0);
+
+    if (pool_size == 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        pool_size = ncpus > 0 ? ncpus : 1;
+    }
+
+    connection_limit = 
+        globalreg->kismet_config->FetchOptUInt("httpd_connection_limit", 0);
+    per_ip_connection_limit = 
+        globalreg->kismet_config->FetchOptUInt("httpd_connection_limit_per_ip", 0);
+    connection_timeout = 
+        globalreg->kismet_config->FetchOptUInt("httpd_connection_timeout", 0);
+
     RegisterMimeType("html", "text/html");
     RegisterMimeType("svg", "image/svg+xml");
     RegisterMimeType("css", "text/css");
@@ -121,6 +211,30 @@ Kis_Net_Httpd::Kis_Net_Httpd(GlobalRegistry *in_globalreg) {
         
     }
 
+    // Keep the web UI in memory instead of reading it from disk for every
+    // client; sensors often run from slow SD cards
+    static_cache_enabled =
+        globalreg->kismet_config->FetchOptBoolean("httpd_static_cache", true);
+    static_cache_max = 
+        globalreg->kismet_config->FetchOptUInt("httpd_static_cache_size", 32) * 1024 * 1024;
+    static_cache_bytes = 0;
+
+    if (static_cache_max == 0)
+        static_cache_enabled = false;
+
+    if (http_serve_files && static_cache_enabled) {
+        char *datadir_real = realpath(http_data_dir.c_str(), NULL);
+
+        if (datadir_real != NULL) {
+            PreloadStaticAssets(datadir_real, 0);
+            free(datadir_real);
+        }
+
+        _MSG("Cached " + UIntToString(static_cache.size()) + " static files (" +
+                UIntToString(static_cache_bytes / 1024) + "KB) from '" + 
+                http_data_dir + "'", MSGFLAG_INFO);
+    }
+
     // Fetch configured usernames
     string userpair = globalreg->kismet_config->FetchOpt("httpd_user");
     vector<string> up = StrTokenize(userpair, ":");
@@ -211,6 +325,9 @@ Kis_Net_Httpd::~Kis_Net_Httpd() {
         delete(i->second);
     }
 
+    if (longpoll_timer >= 0 && globalreg->timetracker != NULL)
+        globalreg->timetracker->RemoveTimer(longpoll_timer);
+
     pthread_mutex_destroy(&controller_mutex);
 }
 
@@ -279,6 +396,7 @@ void Kis_Net_Httpd::RegisterHandler(Kis_Net_Httpd_Handler *in_handler) {
     local_locker lock(&controller_mutex);
 
     handler_vec.push_back(in_handler);
+    unrouted_handler_vec.push_back(in_handler);
 }
 
 void Kis_Net_Httpd::RemoveHandler(Kis_Net_Httpd_Handler *in_handler) {
@@ -290,6 +408,349 @@ void Kis_Net_Httpd::RemoveHandler(Kis_Net_Httpd_Handler *in_handler) {
             break;
         }
     }
+
+    for (unsigned int x = 0; x < unrouted_handler_vec.size(); x++) {
+        if (unrouted_handler_vec[x] == in_handler) {
+            unrouted_handler_vec.erase(unrouted_handler_vec.begin() + x);
+            break;
+        }
+    }
+
+    route_root.remove(in_handler);
+}
+
+// Split a path into segments, ignoring the leading slash
+static vector<string> split_route_path(const char *in_path) {
+    vector<string> ret;
+
+    if (*in_path == '/')
+        in_path++;
+
+    if (*in_path == 0)
+        return ret;
+
+    const char *start = in_path;
+
+    for (const char *p = in_path; ; p++) {
+        if (*p == '/' || *p == 0) {
+            ret.push_back(string(start, p - start));
+
+            if (*p == 0)
+                break;
+
+            start = p + 1;
+        }
+    }
+
+    return ret;
+}
+
+void Kis_Net_Httpd::RegisterRoute(string in_method, string in_route,
+        Kis_Net_Httpd_Handler *in_handler) {
+    local_locker lock(&controller_mutex);
+
+    route_root.insert(split_route_path(in_route.c_str()), 0, in_method, in_handler);
+
+    for (unsigned int x = 0; x < unrouted_handler_vec.size(); x++) {
+        if (unrouted_handler_vec[x] == in_handler) {
+            unrouted_handler_vec.erase(unrouted_handler_vec.begin() + x);
+            break;
+        }
+    }
+}
+
+Kis_Net_Httpd_Handler *Kis_Net_Httpd::FindHandler(const char *url, const char *method) {
+    vector<string> path = split_route_path(url);
+    vector<Kis_Net_Httpd_Handler *> candidates;
+
+    {
+        local_locker lock(&controller_mutex);
+
+        route_root.match(path, 0, method, candidates);
+
+        candidates.insert(candidates.end(), unrouted_handler_vec.begin(),
+                unrouted_handler_vec.end());
+    }
+
+    // Handlers take their own locks to check a path, so don't hold the 
+    // controller while they do
+    for (unsigned int x = 0; x < candidates.size(); x++) {
+        if (candidates[x]->Httpd_VerifyPath(url, method))
+            return candidates[x];
+    }
+
+    return NULL;
+}
+
+uint64_t Kis_Net_Httpd::ThreadCPUTime() {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int Kis_Net_Httpd::AdmitRequest(Kis_Net_Httpd_Connection *connection, int in_class) {
+    string address;
+
+    const union MHD_ConnectionInfo *ci = 
+        MHD_get_connection_info(connection->connection, 
+                MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+
+    if (ci != NULL && ci->client_addr != NULL) {
+        char addrstr[INET6_ADDRSTRLEN] = "";
+
+        if (ci->client_addr->sa_family == AF_INET) {
+            inet_ntop(AF_INET, &(((struct sockaddr_in *) ci->client_addr)->sin_addr),
+                    addrstr, sizeof(addrstr));
+        } else if (ci->client_addr->sa_family == AF_INET6) {
+            inet_ntop(AF_INET6, &(((struct sockaddr_in6 *) ci->client_addr)->sin6_addr),
+                    addrstr, sizeof(addrstr));
+        }
+
+        address = addrstr;
+    }
+
+    // Logged in clients are limited per session so that several users behind
+    // one address don't share a limit; the key is a hash so the session id 
+    // isn't exposed in the client statistics
+    if (connection->session != NULL) {
+        std::stringstream ss;
+        ss << "session-" << std::hex << std::hash<string>()(connection->session->sessionid);
+        connection->client_key = ss.str();
+    } else {
+        connection->client_key = address;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double now = ts.tv_sec + (double) ts.tv_nsec / 1000000000;
+
+    local_locker lock(&client_mutex);
+
+    // Forget idle clients once there are too many
+    if (client_map.size() >= KIS_HTTPD_CLIENT_MAX) {
+        time_t idle = time(0) - KIS_HTTPD_CLIENT_IDLE;
+
+        for (map<string, Kis_Net_Httpd_Client>::iterator i = client_map.begin();
+                i != client_map.end(); ) {
+            if (i->second.last_time < idle)
+                client_map.erase(i++);
+            else
+                ++i;
+        }
+    }
+
+    map<string, Kis_Net_Httpd_Client>::iterator ci_itr = 
+        client_map.find(connection->client_key);
+
+    if (ci_itr == client_map.end()) {
+        Kis_Net_Httpd_Client c;
+        c.key = connection->client_key;
+        c.refill_time = now;
+
+        for (unsigned int x = 0; x < KIS_HTTPD_CLASS_MAX; x++)
+            c.tokens[x] = rate_burst[x];
+
+        ci_itr = client_map.insert(make_pair(c.key, c)).first;
+    }
+
+    Kis_Net_Httpd_Client &client = ci_itr->second;
+
+    client.address = address;
+    client.last_time = time(0);
+
+    // Refill the buckets for the time since the last request
+    for (unsigned int x = 0; x < KIS_HTTPD_CLASS_MAX; x++) {
+        client.tokens[x] += (now - client.refill_time) * rate_limit[x];
+
+        if (client.tokens[x] > rate_burst[x])
+            client.tokens[x] = rate_burst[x];
+    }
+
+    client.refill_time = now;
+
+    if (in_class < 0 || in_class >= KIS_HTTPD_CLASS_MAX)
+        in_class = KIS_HTTPD_CLASS_LIGHT;
+
+    if (rate_limit[in_class] > 0) {
+        if (client.tokens[in_class] < 1) {
+            client.rejected++;
+            return (int) ceil((1 - client.tokens[in_class]) / rate_limit[in_class]);
+        }
+
+        client.tokens[in_class] -= 1;
+    }
+
+    if (in_class == KIS_HTTPD_CLASS_HEAVY && heavy_concurrency != 0) {
+        if (heavy_active >= heavy_concurrency) {
+            // Don't charge for a request we didn't run
+            if (rate_limit[in_class] > 0)
+                client.tokens[in_class] += 1;
+
+            client.rejected++;
+            return 1;
+        }
+
+        heavy_active++;
+        connection->heavy_slot = true;
+    }
+
+    client.requests++;
+
+    return 0;
+}
+
+void Kis_Net_Httpd::ReleaseRequest(Kis_Net_Httpd_Connection *connection) {
+    if (connection->heavy_slot) {
+        local_locker lock(&client_mutex);
+        heavy_active--;
+        connection->heavy_slot = false;
+    }
+
+    if (connection->client_key != "")
+        AddClientCost(connection->client_key, connection->cpu_usec, 
+                connection->bytes_sent);
+}
+
+void Kis_Net_Httpd::AddClientCost(string in_key, uint64_t in_cpu_usec, 
+        uint64_t in_bytes) {
+    local_locker lock(&client_mutex);
+
+    map<string, Kis_Net_Httpd_Client>::iterator ci = client_map.find(in_key);
+
+    if (ci == client_map.end())
+        return;
+
+    ci->second.cpu_usec += in_cpu_usec;
+    ci->second.bytes += in_bytes;
+}
+
+void Kis_Net_Httpd::GetClientStats(vector<Kis_Net_Httpd_Client> &ret_clients) {
+    local_locker lock(&client_mutex);
+
+    ret_clients.clear();
+
+    for (map<string, Kis_Net_Httpd_Client>::iterator ci = client_map.begin();
+            ci != client_map.end(); ++ci)
+        ret_clients.push_back(ci->second);
+}
+
+Kis_Net_Httpd_Route_Node::~Kis_Net_Httpd_Route_Node() {
+    for (map<string, Kis_Net_Httpd_Route_Node *>::iterator i = literal.begin();
+            i != literal.end(); ++i)
+        delete(i->second);
+
+    for (map<string, Kis_Net_Httpd_Route_Node *>::iterator i = suffixed.begin();
+            i != suffixed.end(); ++i)
+        delete(i->second);
+
+    if (param != NULL)
+        delete(param);
+}
+
+void Kis_Net_Httpd_Route_Node::insert(const vector<string> &in_route, 
+        unsigned int in_pos, string in_method, Kis_Net_Httpd_Handler *in_handler) {
+    route_target t;
+    t.method = in_method;
+    t.handler = in_handler;
+
+    if (in_pos == in_route.size()) {
+        targets.push_back(t);
+        return;
+    }
+
+    const string &seg = in_route[in_pos];
+
+    if (seg == "*" && in_pos == in_route.size() - 1) {
+        rest_targets.push_back(t);
+        return;
+    }
+
+    Kis_Net_Httpd_Route_Node **next;
+
+    if (seg.length() > 0 && seg[0] == ':') {
+        next = &param;
+    } else if (seg.length() > 2 && seg.substr(seg.length() - 2, 2) == ".*") {
+        next = &(suffixed[seg.substr(0, seg.length() - 2)]);
+    } else {
+        next = &(literal[seg]);
+    }
+
+    if (*next == NULL)
+        *next = new Kis_Net_Httpd_Route_Node();
+
+    (*next)->insert(in_route, in_pos + 1, in_method, in_handler);
+}
+
+static void remove_route_targets(vector<Kis_Net_Httpd_Route_Node::route_target> &vec,
+        Kis_Net_Httpd_Handler *in_handler) {
+    for (unsigned int x = 0; x < vec.size(); ) {
+        if (vec[x].handler == in_handler) {
+            vec.erase(vec.begin() + x);
+            continue;
+        }
+
+        x++;
+    }
+}
+
+void Kis_Net_Httpd_Route_Node::remove(Kis_Net_Httpd_Handler *in_handler) {
+    remove_route_targets(targets, in_handler);
+    remove_route_targets(rest_targets, in_handler);
+
+    for (map<string, Kis_Net_Httpd_Route_Node *>::iterator i = literal.begin();
+            i != literal.end(); ++i)
+        i->second->remove(in_handler);
+
+    for (map<string, Kis_Net_Httpd_Route_Node *>::iterator i = suffixed.begin();
+            i != suffixed.end(); ++i)
+        i->second->remove(in_handler);
+
+    if (param != NULL)
+        param->remove(in_handler);
+}
+
+static void add_route_targets(const vector<Kis_Net_Httpd_Route_Node::route_target> &vec,
+        const char *in_method, vector<Kis_Net_Httpd_Handler *> &ret_handlers) {
+    for (unsigned int x = 0; x < vec.size(); x++) {
+        if (vec[x].method != in_method)
+            continue;
+
+        if (std::find(ret_handlers.begin(), ret_handlers.end(), vec[x].handler) == 
+                ret_handlers.end())
+            ret_handlers.push_back(vec[x].handler);
+    }
+}
+
+void Kis_Net_Httpd_Route_Node::match(const vector<string> &in_path, 
+        unsigned int in_pos, const char *in_method, 
+        vector<Kis_Net_Httpd_Handler *> &ret_handlers) {
+
+    if (in_pos == in_path.size()) {
+        add_route_targets(targets, in_method, ret_handlers);
+        add_route_targets(rest_targets, in_method, ret_handlers);
+        return;
+    }
+
+    const string &seg = in_path[in_pos];
+
+    map<string, Kis_Net_Httpd_Route_Node *>::iterator i = literal.find(seg);
+    if (i != literal.end())
+        i->second->match(in_path, in_pos + 1, in_method, ret_handlers);
+
+    size_t dot = seg.rfind('.');
+    if (dot != string::npos && suffixed.size() != 0) {
+        i = suffixed.find(seg.substr(0, dot));
+        if (i != suffixed.end())
+            i->second->match(in_path, in_pos + 1, in_method, ret_handlers);
+    }
+
+    if (param != NULL)
+        param->match(in_path, in_pos + 1, in_method, ret_handlers);
+
+    add_route_targets(rest_targets, in_method, ret_handlers);
 }
 
 int Kis_Net_Httpd::StartHttpd() {
@@ -327,17 +788,90 @@ int Kis_Net_Httpd::StartHttpd() {
     }
 
 
+    unsigned int flags;
+
+    if (httpd_mode == KIS_HTTPD_MODE_POOL) {
+#ifdef SYS_LINUX
+        flags = MHD_USE_EPOLL_INTERNALLY_LINUX_ONLY;
+#else
+        flags = MHD_USE_SELECT_INTERNALLY;
+#endif
+        flags |= KIS_HTTPD_SUSPEND_FLAG;
+    } else {
+        flags = MHD_USE_THREAD_PER_CONNECTION;
+    }
+
+    // Only pass the limits which are configured, the rest keep the library 
+    // defaults
+    vector<struct MHD_OptionItem> options;
+    struct MHD_OptionItem opt;
+
+    opt.ptr_value = NULL;
+
+    if (httpd_mode == KIS_HTTPD_MODE_POOL && pool_size > 1) {
+        opt.option = MHD_OPTION_THREAD_POOL_SIZE;
+        opt.value = pool_size;
+        options.push_back(opt);
+    }
+
+    if (connection_limit > 0) {
+        opt.option = MHD_OPTION_CONNECTION_LIMIT;
+        opt.value = connection_limit;
+        options.push_back(opt);
+    }
+
+    if (per_ip_connection_limit > 0) {
+        opt.option = MHD_OPTION_PER_IP_CONNECTION_LIMIT;
+        opt.value = per_ip_connection_limit;
+        options.push_back(opt);
+    }
+
+    if (connection_timeout > 0) {
+        opt.option = MHD_OPTION_CONNECTION_TIMEOUT;
+        opt.value = connection_timeout;
+        options.push_back(opt);
+    }
+
+    // Only read by MHD_start_daemon, when it binds
+    struct sockaddr_in bind_addr;
+
+    if (http_bind_address != "") {
+        memset(&bind_addr, 0, sizeof(bind_addr));
+        bind_addr.sin_family = AF_INET;
+        bind_addr.sin_port = htons(http_port);
+
+        if (inet_pton(AF_INET, http_bind_address.c_str(), &(bind_addr.sin_addr)) != 1) {
+            _MSG("Invalid httpd_bind_address '" + http_bind_address + "', expected "
+                    "an IPv4 address", MSGFLAG_FATAL);
+            globalreg->fatal_condition = 1;
+            return -1;
+        }
+
+        opt.option = MHD_OPTION_SOCK_ADDR;
+        opt.value = 0;
+        opt.ptr_value = &bind_addr;
+        options.push_back(opt);
+        opt.ptr_value = NULL;
+    }
+
+    opt.option = MHD_OPTION_END;
+    opt.value = 0;
+    options.push_back(opt);
+
     if (!use_ssl) {
-        microhttpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION,
+        microhttpd = MHD_start_daemon(flags,
                 http_port, NULL, NULL, 
                 &http_request_handler, this, 
                 MHD_OPTION_NOTIFY_COMPLETED, &http_request_completed, NULL,
+                MHD_OPTION_ARRAY, &(options[0]),
                 MHD_OPTION_END); 
     } else {
-        microhttpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION | MHD_USE_SSL,
+        microhttpd = MHD_start_daemon(flags | MHD_USE_SSL,
                 http_port, NULL, NULL, &http_request_handler, this, 
+                MHD_OPTION_NOTIFY_COMPLETED, &http_request_completed, NULL,
                 MHD_OPTION_HTTPS_MEM_KEY, cert_key,
                 MHD_OPTION_HTTPS_MEM_CERT, cert_pem,
+                MHD_OPTION_ARRAY, &(options[0]),
                 MHD_OPTION_END); 
     }
 
@@ -351,7 +885,21 @@ int Kis_Net_Httpd::StartHttpd() {
 
     MHD_set_panic_func(Kis_Net_Httpd::MHD_Panic, this);
 
-    _MSG("Started http server on port " + UIntToString(http_port), MSGFLAG_INFO);
+    // Suspended long-poll requests have to be woken up when they time out
+    if (httpd_mode == KIS_HTTPD_MODE_POOL)
+        longpoll_timer =
+            globalreg->timetracker->RegisterTimer(SERVER_TIMESLICES_SEC, NULL, 1, this);
+
+    string listen = UIntToString(http_port);
+
+    if (http_bind_address != "")
+        listen = http_bind_address + ":" + listen;
+
+    if (httpd_mode == KIS_HTTPD_MODE_POOL)
+        _MSG("Started http server on " + listen + 
+                " with " + UIntToString(pool_size) + " threads", MSGFLAG_INFO);
+    else
+        _MSG("Started http server on " + listen, MSGFLAG_INFO);
 
     return 1;
 }
@@ -466,21 +1014,12 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
     
     Kis_Net_Httpd_Handler *handler = NULL;
 
-    {
-        local_locker(&(kishttpd->controller_mutex));
-        /* Find a handler that can handle this path & method */
-        for (unsigned int i = 0; i < kishttpd->handler_vec.size(); i++) {
-            Kis_Net_Httpd_Handler *h = kishttpd->handler_vec[i];
-
-            if (h->Httpd_VerifyPath(url, method)) {
-                handler = h;
-                break;
-            }
-        }
-    }
-
     // If we don't have a connection state, make one
     if (*ptr == NULL) {
+        // Find the handler once for the request, not again for every block of
+        // POST data
+        handler = kishttpd->FindHandler(url, method);
+
         concls = new Kis_Net_Httpd_Connection();
         // fprintf(stderr, "debug - allocated new connection state %p\n", concls);
 
@@ -493,10 +1032,40 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
         concls->url = string(url);
         concls->connection = connection;
 
+        // Static files are cheap; everything else is charged to the client
+        if (handler != NULL) {
+            int retry = 
+                kishttpd->AdmitRequest(concls, handler->Httpd_RequestClass(url, method));
+
+            if (retry > 0) {
+                concls->post_rejected = true;
+                concls->response_headers[MHD_HTTP_HEADER_RETRY_AFTER] = IntToString(retry);
+                return kishttpd->SendHttpResponse(kishttpd, concls, url, 429,
+                        "Too many requests");
+            }
+        }
+
         /* Set up a POST handler */
         if (strcmp(method, "POST") == 0) {
             concls->connection_type = Kis_Net_Httpd_Connection::CONNECTION_POST;
 
+            // Turn away bodies we know are too large before they're sent
+            const char *content_len =
+                MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                        MHD_HTTP_HEADER_CONTENT_LENGTH);
+
+            if (content_len != NULL && kishttpd->post_max_size != 0 &&
+                    strtoull(content_len, NULL, 10) > kishttpd->post_max_size) {
+                concls->post_rejected = true;
+                return kishttpd->SendHttpResponse(kishttpd, concls, url, 413,
+                        "Request body too large");
+            }
+
+            if (handler != NULL && handler->Httpd_UseStreamingPost(concls)) {
+                concls->post_streaming = true;
+                return MHD_YES;
+            }
+
             concls->postprocessor =
                 MHD_create_post_processor(connection, KIS_HTTPD_POSTBUFFERSZ,
                         kishttpd->http_post_handler, (void *) concls);
@@ -517,6 +1086,7 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
         return MHD_YES;
     } else {
         concls = (Kis_Net_Httpd_Connection *) *ptr;
+        handler = concls->httpdhandler;
     }
 
     if (handler == NULL) {
@@ -541,23 +1111,55 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
         
         // If we still have data to process
         if (*upload_data_size != 0) {
-            // Process regardless of size to get our completion
-            MHD_post_process(concls->postprocessor, upload_data, *upload_data_size);
+            concls->post_size += *upload_data_size;
+
+            if (concls->post_rejected || concls->post_overflowed) {
+                // Discard the rest of a body we've already refused
+            } else if (kishttpd->post_max_size != 0 && 
+                    concls->post_size > kishttpd->post_max_size) {
+                // Chunked bodies can only be caught once they get too big; we
+                // can't respond until the upload is finished
+                concls->post_overflowed = true;
+            } else {
+                uint64_t cpu_start = ThreadCPUTime();
+
+                if (concls->post_streaming) {
+                    handler->Httpd_PostData(concls, upload_data, *upload_data_size);
+                } else {
+                    // Process regardless of size to get our completion
+                    MHD_post_process(concls->postprocessor, upload_data, 
+                            *upload_data_size);
+                }
+
+                concls->cpu_usec += ThreadCPUTime() - cpu_start;
+            }
 
             // Continue processing post data
             *upload_data_size = 0;
             return MHD_YES;
         } 
 
+        // The error was already sent
+        if (concls->post_rejected)
+            return MHD_YES;
+
+        if (concls->post_overflowed)
+            return kishttpd->SendHttpResponse(kishttpd, concls, url, 413,
+                    "Request body too large");
+
         // Otherwise we've completed our post data processing, flag us
         // as completed so our post handler knows we're done
         
         // fprintf(stderr, "con %p post complete\n", concls);
         concls->post_complete = true;
 
+        uint64_t cpu_start = ThreadCPUTime();
+
         // Notify the processor it's complete
         (concls->httpdhandler)->Httpd_PostComplete(concls);
 
+        concls->cpu_usec += ThreadCPUTime() - cpu_start;
+
         // Send the content
         // fprintf(stderr, "debug - sending postprocessor content %p\n", concls);
         ret = kishttpd->SendHttpResponse(kishttpd, concls, 
@@ -566,8 +1168,12 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
         return MHD_YES;
     } else {
         // Handle GET + any others
+        uint64_t cpu_start = ThreadCPUTime();
+
         ret = handler->Httpd_HandleRequest(kishttpd, concls, url, method, 
                 upload_data, upload_data_size);
+
+        concls->cpu_usec += ThreadCPUTime() - cpu_start;
     }
 
     return ret;
@@ -604,11 +1210,18 @@ void Kis_Net_Httpd::http_request_completed(void *cls __attribute__((unused)),
     if (con_info == NULL)
         return;
 
-    if (con_info->connection_type == Kis_Net_Httpd_Connection::CONNECTION_POST) {
+    if (con_info->connection_type == Kis_Net_Httpd_Connection::CONNECTION_POST &&
+            con_info->postprocessor != NULL) {
         MHD_destroy_post_processor(con_info->postprocessor);
         con_info->postprocessor = NULL;
     }
 
+    if (con_info->longpoll_deadline != 0 && con_info->httpd != NULL)
+        con_info->httpd->CancelLongPoll(con_info);
+
+    if (con_info->httpd != NULL)
+        con_info->httpd->ReleaseRequest(con_info);
+
     delete(con_info);
     *con_cls = NULL;
 }
@@ -656,132 +1269,691 @@ int Kis_Net_Httpd::handle_static_file(void *cls, Kis_Net_Httpd_Connection *conne
     datadir_path = kishttpd->http_data_dir.c_str();
     realpath_path = realpath(fullfile.c_str(), NULL);
 
-    if (realpath_path == NULL) {
+    if (realpath_path == NULL)
         return -1;
-    } else {
-        // Make sure we're hosted inside the data dir
-        if (strstr(realpath_path, datadir_path) == realpath_path) {
-
-            struct MHD_Response *response;
-            struct stat buf;
-
-            FILE *f = fopen(realpath_path, "rb");
-            int fd;
-            free(realpath_path);
-            
-            if (f != NULL) {
-                fd = fileno(f);
-                if (fstat(fd, &buf) != 0 || (!S_ISREG(buf.st_mode))) {
-                    fclose(f);
-                    return -1;
-                }
 
-                response = MHD_create_response_from_callback(buf.st_size, 32 * 1024,
-                        &file_reader, f, &free_callback);
+    // Make sure we're hosted inside the data dir
+    if (strstr(realpath_path, datadir_path) != realpath_path) {
+        free(realpath_path);
+        return -1;
+    }
 
-                if (response == NULL) {
-                    fclose(f);
-                    return -1;
-                }
+    string realfile = realpath_path;
+    free(realpath_path);
 
-                if (connection->session != NULL) {
-                    std::stringstream cookiestr;
-                    std::stringstream cookie;
+    struct MHD_Response *response = NULL;
+    struct stat buf;
+    shared_ptr<Kis_Net_Httpd_Static_Asset> asset;
+    bool gzip = false;
+    int httpcode = MHD_HTTP_OK;
 
-                    cookiestr << KIS_SESSION_COOKIE << "=";
-                    cookiestr << connection->session->sessionid;
-                    cookiestr << "; Path=/";
+    if (stat(realfile.c_str(), &buf) != 0 || !S_ISREG(buf.st_mode))
+        return -1;
 
-                    MHD_add_response_header(response, MHD_HTTP_HEADER_SET_COOKIE, 
-                                cookiestr.str().c_str());
-                }
+    if (kishttpd->static_cache_enabled)
+        asset = kishttpd->FetchStaticAsset(realfile, &buf);
 
-                char lastmod[31];
-                struct tm tmstruct;
-                localtime_r(&(buf.st_ctime), &tmstruct);
-                strftime(lastmod, 31, "%a, %d %b %Y %H:%M:%S %Z", &tmstruct);
-                MHD_add_response_header(response, "Last-Modified", lastmod);
+    if (asset != NULL) {
+        gzip = asset->gzip_body.length() != 0 &&
+            kishttpd->NegotiateEncoding(connection) == KIS_HTTPD_ENCODING_GZIP;
 
-                string suffix = GetSuffix(url);
-                string mime = kishttpd->GetMimeType(suffix);
+        const string &etag = gzip ? asset->gzip_etag : asset->etag;
+        const string &body = gzip ? asset->gzip_body : asset->body;
 
-                if (mime != "") {
-                    MHD_add_response_header(response, "Content-Type", mime.c_str());
-                }
+        const char *client_etag = 
+            MHD_lookup_connection_value(connection->connection, MHD_HEADER_KIND,
+                    MHD_HTTP_HEADER_IF_NONE_MATCH);
 
-                // Allow any?
-                MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+        if (client_etag != NULL && strstr(client_etag, etag.c_str()) != NULL) {
+            httpcode = MHD_HTTP_NOT_MODIFIED;
+            response = MHD_create_response_from_buffer(0, (void *) "", 
+                    MHD_RESPMEM_PERSISTENT);
+        } else {
+            // The connection holds the asset until the request is complete, so 
+            // the response can point straight at the cached data
+            connection->static_asset = asset;
+            connection->bytes_sent += body.length();
+            response = MHD_create_response_from_buffer(body.length(), 
+                    (void *) body.data(), MHD_RESPMEM_PERSISTENT);
+        }
 
-                // Never let the browser cache our responses.  Maybe moderate this
-                // in the future to cache for 60 seconds or something?
-                MHD_add_response_header(response, "Cache-Control", "no-cache");
-                MHD_add_response_header(response, "Pragma", "no-cache");
-                MHD_add_response_header(response, 
-                        "Expires", "Sat, 01 Jan 2000 00:00:00 GMT");
+        if (response == NULL)
+            return -1;
 
-                MHD_queue_response(connection->connection, MHD_HTTP_OK, response);
-                MHD_destroy_response(response);
+        MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, etag.c_str());
 
-                return 1;
-            }
+        if (asset->gzip_body.length() != 0)
+            MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, 
+                    MHD_HTTP_HEADER_ACCEPT_ENCODING);
+
+        if (gzip && httpcode == MHD_HTTP_OK)
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
+
+        MHD_add_response_header(response, "Last-Modified", asset->lastmod.c_str());
+
+        if (asset->mime != "")
+            MHD_add_response_header(response, "Content-Type", asset->mime.c_str());
+    } else {
+        FILE *f = fopen(realfile.c_str(), "rb");
 
+        if (f == NULL)
             return -1;
-        } else {
+
+        if (fstat(fileno(f), &buf) != 0 || (!S_ISREG(buf.st_mode))) {
+            fclose(f);
             return -1;
         }
-    }
 
-    return -1;
-}
+        response = MHD_create_response_from_callback(buf.st_size, 32 * 1024,
+                &file_reader, f, &free_callback);
 
-int Kis_Net_Httpd::SendHttpResponse(Kis_Net_Httpd *httpd,
-        Kis_Net_Httpd_Connection *connection,
-        const char *url, int httpcode, string responsestr) {
+        if (response == NULL) {
+            fclose(f);
+            return -1;
+        }
 
-    int ret = MHD_YES;
+        connection->bytes_sent += buf.st_size;
 
-    // If this connection doesn't have a response, make one, populate it, and
-    // send it.  If there is already a response for this connection, it means
-    // something did a custom send - like a basicauth reject - so we just destroy
-    // the response at the end during cleanup.
-    if (connection->response == NULL) {
-        connection->response = 
-            MHD_create_response_from_buffer(responsestr.length(),
-                    (void *) responsestr.data(), MHD_RESPMEM_MUST_COPY);
+        char lastmod[31];
+        struct tm tmstruct;
+        localtime_r(&(buf.st_ctime), &tmstruct);
+        strftime(lastmod, 31, "%a, %d %b %Y %H:%M:%S %Z", &tmstruct);
+        MHD_add_response_header(response, "Last-Modified", lastmod);
+
+        string suffix = GetSuffix(url);
+        string mime = kishttpd->GetMimeType(suffix);
+
+        if (mime != "") {
+            MHD_add_response_header(response, "Content-Type", mime.c_str());
+        }
+    }
 
-        if (connection->session != NULL) {
-            std::stringstream cookiestr;
-            std::stringstream cookie;
+    if (connection->session != NULL) {
+        std::stringstream cookiestr;
+        std::stringstream cookie;
 
-            cookiestr << KIS_SESSION_COOKIE << "=";
-            cookiestr << connection->session->sessionid;
-            cookiestr << "; Path=/";
+        cookiestr << KIS_SESSION_COOKIE << "=";
+        cookiestr << connection->session->sessionid;
+        cookiestr << "; Path=/";
 
-            MHD_add_response_header(connection->response, MHD_HTTP_HEADER_SET_COOKIE, 
+        MHD_add_response_header(response, MHD_HTTP_HEADER_SET_COOKIE, 
                     cookiestr.str().c_str());
+    }
+
+    // Allow any?
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+
+    // Never let the browser use a cached copy without checking it first; 
+    // cached static files answer with a 304 when the ETag still matches
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+    MHD_add_response_header(response, "Pragma", "no-cache");
+    MHD_add_response_header(response, 
+            "Expires", "Sat, 01 Jan 2000 00:00:00 GMT");
+
+    MHD_queue_response(connection->connection, httpcode, response);
+    MHD_destroy_response(response);
+
+    return 1;
+}
+
+shared_ptr<Kis_Net_Httpd_Static_Asset> Kis_Net_Httpd::FetchStaticAsset(string in_path,
+        struct stat *in_stat) {
+    shared_ptr<Kis_Net_Httpd_Static_Asset> asset;
+
+    {
+        local_locker lock(&static_cache_mutex);
+
+        map<string, shared_ptr<Kis_Net_Httpd_Static_Asset> >::iterator si =
+            static_cache.find(in_path);
+
+        if (si != static_cache.end()) {
+            if (si->second->mtime == in_stat->st_mtime && 
+                    si->second->size == in_stat->st_size)
+                return si->second;
+
+            // The file changed on disk; drop the old copy.  Connections still
+            // sending it keep their own reference
+            static_cache_bytes -= 
+                si->second->body.length() + si->second->gzip_body.length();
+            static_cache.erase(si);
         }
+    }
 
-        char lastmod[31];
-        struct tm tmstruct;
-        time_t now;
-        time(&now);
-        gmtime_r(&now, &tmstruct);
-        strftime(lastmod, 31, "%a, %d %b %Y %H:%M:%S %Z", &tmstruct);
-        MHD_add_response_header(connection->response, "Last-Modified", lastmod);
+    // Read and compress without holding the cache
+    asset = LoadStaticAsset(in_path, in_stat);
+
+    if (asset == NULL)
+        return asset;
+
+    size_t asset_bytes = asset->body.length() + asset->gzip_body.length();
+
+    local_locker lock(&static_cache_mutex);
+
+    // Serve it this time even if it doesn't fit
+    if (static_cache_bytes + asset_bytes > static_cache_max)
+        return asset;
+
+    map<string, shared_ptr<Kis_Net_Httpd_Static_Asset> >::iterator si =
+        static_cache.find(in_path);
+
+    if (si != static_cache.end()) 
+        static_cache_bytes -= si->second->body.length() + si->second->gzip_body.length();
+
+    static_cache[in_path] = asset;
+    static_cache_bytes += asset_bytes;
+
+    return asset;
+}
+
+shared_ptr<Kis_Net_Httpd_Static_Asset> Kis_Net_Httpd::LoadStaticAsset(string in_path,
+        struct stat *in_stat) {
+    shared_ptr<Kis_Net_Httpd_Static_Asset> asset;
+
+    // Large files are streamed from disk
+    if ((size_t) in_stat->st_size > static_cache_max / 4)
+        return asset;
+
+    FILE *f = fopen(in_path.c_str(), "rb");
+
+    if (f == NULL)
+        return asset;
+
+    asset.reset(new Kis_Net_Httpd_Static_Asset());
+
+    asset->mtime = in_stat->st_mtime;
+    asset->size = in_stat->st_size;
+
+    asset->body.resize(in_stat->st_size);
+
+    if (in_stat->st_size != 0 &&
+            fread(&(asset->body[0]), in_stat->st_size, 1, f) != 1) {
+        fclose(f);
+        asset.reset();
+        return asset;
+    }
 
+    fclose(f);
+
+    string key = in_path + ":" + UIntToString(in_stat->st_size);
+
+    asset->etag = GetETag(key, in_stat->st_mtime);
+    asset->mime = GetMimeType(GetSuffix(in_path));
+
+    char lastmod[31];
+    struct tm tmstruct;
+    localtime_r(&(in_stat->st_ctime), &tmstruct);
+    strftime(lastmod, 31, "%a, %d %b %Y %H:%M:%S %Z", &tmstruct);
+    asset->lastmod = lastmod;
+
+    // Keep a gzip copy unless the file is already compressed, like most images
+    if (CompressionEnabled() &&
+            CompressBody(KIS_HTTPD_ENCODING_GZIP, asset->body, asset->gzip_body) &&
+            asset->gzip_body.length() < asset->body.length() - asset->body.length() / 8) {
+        asset->gzip_etag = GetETag(key + "|gzip", in_stat->st_mtime);
+    } else {
+        asset->gzip_body.clear();
+    }
+
+    return asset;
+}
+
+void Kis_Net_Httpd::PreloadStaticAssets(string in_dir, unsigned int in_depth) {
+    // Don't chase symlink loops forever
+    if (in_depth > 16)
+        return;
+
+    DIR *dir = opendir(in_dir.c_str());
+
+    if (dir == NULL)
+        return;
+
+    struct dirent *de;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (static_cache_bytes >= static_cache_max)
+            break;
+
+        // Skip ., .., and hidden files; they're still cached when requested
+        if (de->d_name[0] == '.')
+            continue;
+
+        string path = in_dir + "/" + de->d_name;
+        struct stat buf;
+
+        if (stat(path.c_str(), &buf) != 0)
+            continue;
+
+        if (S_ISDIR(buf.st_mode)) {
+            PreloadStaticAssets(path, in_depth + 1);
+            continue;
+        }
+
+        if (!S_ISREG(buf.st_mode))
+            continue;
+
+        // Cache by the same resolved path requests use
+        char *realpath_path = realpath(path.c_str(), NULL);
+
+        if (realpath_path == NULL)
+            continue;
+
+        FetchStaticAsset(realpath_path, &buf);
+        free(realpath_path);
+    }
+
+    closedir(dir);
+}
+
+void Kis_Net_Httpd::AppendStandardHeaders(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection,
+        struct MHD_Response *response, const char *url) {
+
+    if (connection->session != NULL) {
+        std::stringstream cookiestr;
+
+        cookiestr << KIS_SESSION_COOKIE << "=";
+        cookiestr << connection->session->sessionid;
+        cookiestr << "; Path=/";
+
+        MHD_add_response_header(response, MHD_HTTP_HEADER_SET_COOKIE, 
+                cookiestr.str().c_str());
+    }
+
+    char lastmod[31];
+    struct tm tmstruct;
+    time_t now;
+    time(&now);
+    gmtime_r(&now, &tmstruct);
+    strftime(lastmod, 31, "%a, %d %b %Y %H:%M:%S %Z", &tmstruct);
+    MHD_add_response_header(response, "Last-Modified", lastmod);
+
+    // Handlers which override the type (for instance with a plain text error)
+    // set it in the response headers
+    if (connection->response_headers.find("Content-Type") == 
+            connection->response_headers.end()) {
         string suffix = GetSuffix(url);
         string mime = httpd->GetMimeType(suffix);
 
         if (mime != "") {
-            MHD_add_response_header(connection->response, "Content-Type", mime.c_str());
+            MHD_add_response_header(response, "Content-Type", mime.c_str());
+        }
+    }
+
+    // Allow any?  This lets us handle webuis hosted elsewhere
+    MHD_add_response_header(response, 
+            "Access-Control-Allow-Origin", "*");
+
+    for (map<string, string>::iterator hi = connection->response_headers.begin();
+            hi != connection->response_headers.end(); ++hi) {
+        MHD_add_response_header(response, hi->first.c_str(), hi->second.c_str());
+    }
+}
+
+static int cache_key_iterator(void *cls, enum MHD_ValueKind kind __attribute__((unused)),
+        const char *key, const char *value) {
+    string *ret = (string *) cls;
+
+    ret->append("&");
+    ret->append(key);
+
+    if (value != NULL) {
+        ret->append("=");
+        ret->append(value);
+    }
+
+    return MHD_YES;
+}
+
+string Kis_Net_Httpd::GetCacheKey(Kis_Net_Httpd_Connection *connection, 
+        const char *url) {
+    string key = url;
+
+    key += "?";
+
+    MHD_get_connection_values(connection->connection, MHD_GET_ARGUMENT_KIND,
+            &cache_key_iterator, &key);
+
+    return key;
+}
+
+static int argument_iterator(void *cls, enum MHD_ValueKind kind __attribute__((unused)),
+        const char *key, const char *value) {
+    map<string, string> *ret = (map<string, string> *) cls;
+
+    (*ret)[key] = value == NULL ? "" : value;
+
+    return MHD_YES;
+}
+
+void Kis_Net_Httpd::GetArguments(Kis_Net_Httpd_Connection *connection,
+        map<string, string> &ret_args) {
+    MHD_get_connection_values(connection->connection, MHD_GET_ARGUMENT_KIND,
+            &argument_iterator, &ret_args);
+}
+
+string Kis_Net_Httpd::GetETag(string in_key, uint64_t in_generation) {
+    std::stringstream etag;
+
+    etag << "\"" << std::hex << std::hash<string>()(in_key) << "-" << 
+        in_generation << "\"";
+
+    return etag.str();
+}
+
+Kis_Net_Httpd_Compressor::Kis_Net_Httpd_Compressor(int in_encoding, int in_level) {
+    valid = false;
+
+#ifdef HAVE_LIBZ
+    memset(&zs, 0, sizeof(z_stream));
+
+    // gzip adds its header and trailer when 16 is added to the window bits
+    int wbits = 15;
+    if (in_encoding == KIS_HTTPD_ENCODING_GZIP)
+        wbits += 16;
+
+    if (deflateInit2(&zs, in_level, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+        valid = true;
+#endif
+}
+
+Kis_Net_Httpd_Compressor::~Kis_Net_Httpd_Compressor() {
+#ifdef HAVE_LIBZ
+    if (valid)
+        deflateEnd(&zs);
+#endif
+}
+
+bool Kis_Net_Httpd_Compressor::compress(const char *in_data, size_t in_len,
+        string &ret_data, bool in_finish) {
+    if (!valid)
+        return false;
+
+#ifdef HAVE_LIBZ
+    char chunk[16384];
+    int r;
+
+    zs.next_in = (Bytef *) in_data;
+    zs.avail_in = in_len;
+
+    do {
+        zs.next_out = (Bytef *) chunk;
+        zs.avail_out = sizeof(chunk);
+
+        r = deflate(&zs, in_finish ? Z_FINISH : Z_NO_FLUSH);
+
+        if (r == Z_STREAM_ERROR) {
+            valid = false;
+            return false;
+        }
+
+        ret_data.append(chunk, sizeof(chunk) - zs.avail_out);
+    } while (zs.avail_out == 0 || (in_finish && r != Z_STREAM_END));
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Kis_Net_Httpd::WaitLongPoll(Kis_Net_Httpd_Stream_Handler *in_handler,
+        Kis_Net_Httpd_Connection *connection, const char *url, string in_topic) {
+
+    // First time through, work out when to give up
+    if (connection->longpoll_deadline == 0) {
+        const char *timeout_arg =
+            MHD_lookup_connection_value(connection->connection, 
+                    MHD_GET_ARGUMENT_KIND, "timeout");
+        unsigned int timeout;
+
+        if (timeout_arg == NULL || sscanf(timeout_arg, "%u", &timeout) != 1 ||
+                timeout == 0)
+            return true;
+
+        if (timeout > KIS_HTTPD_LONGPOLL_MAX)
+            timeout = KIS_HTTPD_LONGPOLL_MAX;
+
+        connection->longpoll_deadline = time(0) + timeout;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&longpoll_mutex);
+        uint64_t seq = longpoll_seq[in_topic];
+        pthread_mutex_unlock(&longpoll_mutex);
+
+        // The handler takes its own locks to check, so we can't hold ours
+        if (time(0) >= connection->longpoll_deadline || 
+                in_handler->Httpd_LongPollReady(url))
+            return true;
+
+        pthread_mutex_lock(&longpoll_mutex);
+
+        // Something changed while we were checking; look again
+        if (longpoll_seq[in_topic] != seq) {
+            pthread_mutex_unlock(&longpoll_mutex);
+            continue;
+        }
+
+        if (httpd_mode == KIS_HTTPD_MODE_POOL) {
+            longpoll_waiter w;
+            w.connection = connection;
+            w.topic = in_topic;
+            longpoll_waiters.push_back(w);
+
+            MHD_suspend_connection(connection->connection);
+
+            pthread_mutex_unlock(&longpoll_mutex);
+            return false;
+        }
+
+        struct timespec t;
+        t.tv_sec = connection->longpoll_deadline;
+        t.tv_nsec = 0;
+
+        while (longpoll_seq[in_topic] == seq && time(0) < connection->longpoll_deadline) {
+            if (pthread_cond_timedwait(&longpoll_cond, &longpoll_mutex, &t) != 0)
+                break;
+        }
+
+        pthread_mutex_unlock(&longpoll_mutex);
+    }
+}
+
+void Kis_Net_Httpd::NotifyLongPoll(string in_topic) {
+    local_locker lock(&longpoll_mutex);
+
+    longpoll_seq[in_topic]++;
+
+    for (unsigned int x = 0; x < longpoll_waiters.size(); ) {
+        if (longpoll_waiters[x].topic == in_topic) {
+            MHD_resume_connection(longpoll_waiters[x].connection->connection);
+            longpoll_waiters.erase(longpoll_waiters.begin() + x);
+            continue;
+        }
+
+        x++;
+    }
+
+    pthread_cond_broadcast(&longpoll_cond);
+}
+
+void Kis_Net_Httpd::CancelLongPoll(Kis_Net_Httpd_Connection *connection) {
+    local_locker lock(&longpoll_mutex);
+
+    for (unsigned int x = 0; x < longpoll_waiters.size(); x++) {
+        if (longpoll_waiters[x].connection == connection) {
+            longpoll_waiters.erase(longpoll_waiters.begin() + x);
+            break;
+        }
+    }
+}
+
+int Kis_Net_Httpd::timetracker_event(int eventid) {
+    if (eventid != longpoll_timer)
+        return 1;
+
+    local_locker lock(&longpoll_mutex);
+
+    time_t now = time(0);
+
+    // Resume timed out requests; they answer with whatever they have
+    for (unsigned int x = 0; x < longpoll_waiters.size(); ) {
+        if (longpoll_waiters[x].connection->longpoll_deadline <= now) {
+            MHD_resume_connection(longpoll_waiters[x].connection->connection);
+            longpoll_waiters.erase(longpoll_waiters.begin() + x);
+            continue;
+        }
+
+        x++;
+    }
+
+    return 1;
+}
+
+int Kis_Net_Httpd::NegotiateEncoding(Kis_Net_Httpd_Connection *connection) {
+    if (!CompressionEnabled())
+        return KIS_HTTPD_ENCODING_IDENTITY;
+
+    const char *accept = 
+        MHD_lookup_connection_value(connection->connection, MHD_HEADER_KIND,
+                MHD_HTTP_HEADER_ACCEPT_ENCODING);
+
+    if (accept == NULL)
+        return KIS_HTTPD_ENCODING_IDENTITY;
+
+    bool gzip = false, deflate = false;
+
+    vector<string> codings = StrTokenize(accept, ",");
+
+    for (unsigned int x = 0; x < codings.size(); x++) {
+        vector<string> params = StrTokenize(codings[x], ";");
+
+        if (params.size() == 0)
+            continue;
+
+        string coding = StrLower(StrStrip(params[0]));
+
+        // Honor an explicit refusal of an encoding
+        bool refused = false;
+        for (unsigned int p = 1; p < params.size(); p++) {
+            string param = StrStrip(params[p]);
+            if (param.substr(0, 2) == "q=" && atof(param.substr(2).c_str()) <= 0)
+                refused = true;
         }
 
-        // Allow any?  This lets us handle webuis hosted elsewhere
-        MHD_add_response_header(connection->response, 
-                "Access-Control-Allow-Origin", "*");
+        if (refused)
+            continue;
+
+        if (coding == "gzip" || coding == "x-gzip")
+            gzip = true;
+        else if (coding == "deflate")
+            deflate = true;
+    }
+
+    if (gzip)
+        return KIS_HTTPD_ENCODING_GZIP;
+
+    if (deflate)
+        return KIS_HTTPD_ENCODING_DEFLATE;
+
+    return KIS_HTTPD_ENCODING_IDENTITY;
+}
+
+const char *Kis_Net_Httpd::EncodingName(int in_encoding) {
+    switch (in_encoding) {
+        case KIS_HTTPD_ENCODING_GZIP:
+            return "gzip";
+        case KIS_HTTPD_ENCODING_DEFLATE:
+            return "deflate";
+        default:
+            return "identity";
+    }
+}
+
+bool Kis_Net_Httpd::CompressBody(int in_encoding, const string &in_body, 
+        string &ret_body) {
+    if (in_encoding == KIS_HTTPD_ENCODING_IDENTITY || 
+            in_body.length() < compression_min_size)
+        return false;
+
+    Kis_Net_Httpd_Compressor compressor(in_encoding, compression_level);
+
+    ret_body.clear();
+    ret_body.reserve(in_body.length() / 4);
+
+    return compressor.compress(in_body.data(), in_body.length(), ret_body, true);
+}
+
+bool Kis_Net_Httpd::FetchCachedResponse(string in_key, uint64_t in_generation,
+        string &ret_body, int &ret_encoding) {
+    local_locker lock(&cache_mutex);
+
+    map<string, cached_response>::iterator ci = response_cache.find(in_key);
+
+    if (ci == response_cache.end() || ci->second.generation != in_generation)
+        return false;
+
+    ret_body = ci->second.body;
+    ret_encoding = ci->second.encoding;
+
+    return true;
+}
+
+void Kis_Net_Httpd::StoreCachedResponse(string in_key, uint64_t in_generation,
+        const string &in_body, int in_encoding) {
+    if (in_body.length() > KIS_HTTPD_CACHE_MAX_BYTES / 4)
+        return;
+
+    local_locker lock(&cache_mutex);
+
+    map<string, cached_response>::iterator ci = response_cache.find(in_key);
+
+    if (ci != response_cache.end()) {
+        // Don't replace a newer response with one which raced it
+        if (ci->second.generation > in_generation)
+            return;
+
+        response_cache_bytes -= ci->second.body.length();
+        response_cache.erase(ci);
+    }
+
+    // Dump the cache when it fills; entries are re-populated by the next 
+    // request for each
+    if (response_cache.size() >= KIS_HTTPD_CACHE_MAX_ENTRIES ||
+            response_cache_bytes + in_body.length() > KIS_HTTPD_CACHE_MAX_BYTES) {
+        response_cache.clear();
+        response_cache_bytes = 0;
+    }
+
+    cached_response cr;
+    cr.generation = in_generation;
+    cr.body = in_body;
+    cr.encoding = in_encoding;
+
+    response_cache[in_key] = cr;
+    response_cache_bytes += in_body.length();
+}
+
+int Kis_Net_Httpd::SendHttpResponse(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection,
+        const char *url, int httpcode, string responsestr) {
+
+    int ret = MHD_YES;
+
+    // If this connection doesn't have a response, make one, populate it, and
+    // send it.  If there is already a response for this connection, it means
+    // something did a custom send - like a basicauth reject - so we just destroy
+    // the response at the end during cleanup.
+    if (connection->response == NULL) {
+        connection->response = 
+            MHD_create_response_from_buffer(responsestr.length(),
+                    (void *) responsestr.data(), MHD_RESPMEM_MUST_COPY);
+
+        AppendStandardHeaders(httpd, connection, connection->response, url);
 
         ret = MHD_queue_response(connection->connection, httpcode, 
                 connection->response);
+
+        connection->bytes_sent += responsestr.length();
     }
 
     MHD_destroy_response(connection->response);
@@ -823,6 +1995,11 @@ bool Kis_Net_Httpd_Handler::Httpd_CanSerialize(string path) {
     return entrytracker->CanSerialize(httpd->GetSuffix(path));
 }
 
+void Kis_Net_Httpd_Handler::Httpd_RegisterRoute(string in_method, string in_route) {
+    if (httpd != NULL)
+        httpd->RegisterRoute(in_method, in_route, this);
+}
+
 string Kis_Net_Httpd_Handler::Httpd_GetSuffix(string path) {
     return httpd->GetSuffix(path);
 }
@@ -837,18 +2014,373 @@ bool Kis_Net_Httpd_Stream_Handler::Httpd_Serialize(string path,
     return entrytracker->Serialize(httpd->GetSuffix(path), stream, e, name_map);
 }
 
+bool Kis_Net_Httpd_Stream_Handler::Httpd_SerializeDelta(string path, 
+        std::stringstream &stream, SharedTrackerElement e, uint64_t since,
+        TrackerElementSerializer::rename_map *name_map) {
+    return entrytracker->SerializeDelta(httpd->GetSuffix(path), stream, e, 
+            since, name_map);
+}
+
+Kis_Net_Httpd_Buffer_Stream::Kis_Net_Httpd_Buffer_Stream(size_t in_max_size) {
+    pthread_mutex_init(&buffer_mutex, NULL);
+    pthread_cond_init(&buffer_cond, NULL);
+
+    buffer_pos = 0;
+    max_size = in_max_size;
+
+    completed = false;
+    errored = false;
+    cancelled = false;
+
+    suspend_connection = NULL;
+    suspended = false;
+
+    compressor = NULL;
+}
+
+Kis_Net_Httpd_Buffer_Stream::~Kis_Net_Httpd_Buffer_Stream() {
+    delete(compressor);
+
+    pthread_cond_destroy(&buffer_cond);
+    pthread_mutex_destroy(&buffer_mutex);
+}
+
+bool Kis_Net_Httpd_Buffer_Stream::write(const char *in_data, size_t in_len) {
+    if (compressor == NULL)
+        return append(in_data, in_len);
+
+    // Compress outside of the buffer lock so the reader isn't held up
+    string compressed;
+
+    if (!compressor->compress(in_data, in_len, compressed, false)) {
+        cancel();
+        return false;
+    }
+
+    return append(compressed.data(), compressed.length());
+}
+
+bool Kis_Net_Httpd_Buffer_Stream::append(const char *in_data, size_t in_len) {
+    pthread_mutex_lock(&buffer_mutex);
+
+    if (cancelled) {
+        pthread_mutex_unlock(&buffer_mutex);
+        return false;
+    }
+
+    // Compact the consumed portion before growing the buffer
+    if (buffer_pos != 0) {
+        buffer.erase(0, buffer_pos);
+        buffer_pos = 0;
+    }
+
+    buffer.append(in_data, in_len);
+
+    pthread_cond_broadcast(&buffer_cond);
+    wake_reader();
+    pthread_mutex_unlock(&buffer_mutex);
+
+    return true;
+}
+
+void Kis_Net_Httpd_Buffer_Stream::wake_reader() {
+    if (suspended) {
+        suspended = false;
+        MHD_resume_connection(suspend_connection);
+    }
+}
+
+bool Kis_Net_Httpd_Buffer_Stream::wait_drain() {
+    pthread_mutex_lock(&buffer_mutex);
+
+    while (!cancelled && buffer.length() - buffer_pos >= max_size)
+        pthread_cond_wait(&buffer_cond, &buffer_mutex);
+
+    bool ret = !cancelled;
+
+    pthread_mutex_unlock(&buffer_mutex);
+
+    return ret;
+}
+
+size_t Kis_Net_Httpd_Buffer_Stream::get_pending() {
+    pthread_mutex_lock(&buffer_mutex);
+    size_t ret = buffer.length() - buffer_pos;
+    pthread_mutex_unlock(&buffer_mutex);
+    return ret;
+}
+
+void Kis_Net_Httpd_Buffer_Stream::complete(bool in_error) {
+    // Flush the end of the compressed stream
+    if (compressor != NULL && !in_error) {
+        string compressed;
+
+        if (compressor->compress(NULL, 0, compressed, true))
+            append(compressed.data(), compressed.length());
+        else
+            in_error = true;
+    }
+
+    pthread_mutex_lock(&buffer_mutex);
+    completed = true;
+    errored = in_error;
+    pthread_cond_broadcast(&buffer_cond);
+    wake_reader();
+    pthread_mutex_unlock(&buffer_mutex);
+}
+
+ssize_t Kis_Net_Httpd_Buffer_Stream::read(char *in_buf, size_t in_max) {
+    pthread_mutex_lock(&buffer_mutex);
+
+    // Park the connection until the producer has more for us; the producer
+    // can't wake it before we've suspended it because we hold the buffer
+    if (suspend_connection != NULL && !cancelled && !completed && 
+            buffer_pos == buffer.length()) {
+        suspended = true;
+        MHD_suspend_connection(suspend_connection);
+        pthread_mutex_unlock(&buffer_mutex);
+        return 0;
+    }
+
+    while (!cancelled && !completed && buffer_pos == buffer.length())
+        pthread_cond_wait(&buffer_cond, &buffer_mutex);
+
+    ssize_t ret;
+
+    if (cancelled || (errored && buffer_pos == buffer.length())) {
+        ret = MHD_CONTENT_READER_END_WITH_ERROR;
+    } else if (buffer_pos == buffer.length()) {
+        ret = MHD_CONTENT_READER_END_OF_STREAM;
+    } else {
+        ret = std::min(in_max, buffer.length() - buffer_pos);
+        memcpy(in_buf, buffer.data() + buffer_pos, ret);
+        buffer_pos += ret;
+
+        if (buffer_pos == buffer.length()) {
+            buffer.clear();
+            buffer_pos = 0;
+        }
+
+        // Wake up a producer waiting for the buffer to drain
+        pthread_cond_broadcast(&buffer_cond);
+    }
+
+    pthread_mutex_unlock(&buffer_mutex);
+
+    return ret;
+}
+
+void Kis_Net_Httpd_Buffer_Stream::cancel() {
+    pthread_mutex_lock(&buffer_mutex);
+    cancelled = true;
+    pthread_cond_broadcast(&buffer_cond);
+    pthread_mutex_unlock(&buffer_mutex);
+}
+
+bool Kis_Net_Httpd_Buffer_Stream::is_cancelled() {
+    pthread_mutex_lock(&buffer_mutex);
+    bool ret = cancelled;
+    pthread_mutex_unlock(&buffer_mutex);
+    return ret;
+}
+
+// State shared between a streaming response, the thread generating it, and
+// the microhttpd reader callbacks
+struct kis_net_httpd_stream_aux {
+    Kis_Net_Httpd *httpd;
+    Kis_Net_Httpd_Stream_Handler *handler;
+    string url;
+    map<string, string> args;
+    Kis_Net_Httpd_Buffer_Stream *buffer;
+    pthread_t generator_thread;
+
+    // The response outlives the request, so its cost is charged to the 
+    // client when it's freed
+    string client_key;
+    uint64_t cpu_usec;
+    uint64_t bytes_sent;
+};
+
+static void *stream_generator_thread(void *arg) {
+    kis_net_httpd_stream_aux *aux = (kis_net_httpd_stream_aux *) arg;
+
+    try {
+        aux->handler->Httpd_CreateStreamingResponse(aux->url, aux->args, aux->buffer);
+        aux->buffer->complete();
+    } catch (const std::exception& e) {
+        // Most likely a lock timeout; terminate the response so the client
+        // doesn't mistake a truncated document for a complete one
+        aux->buffer->complete(true);
+    }
+
+    aux->cpu_usec = Kis_Net_Httpd::ThreadCPUTime();
+
+    return NULL;
+}
+
+static ssize_t stream_reader(void *cls, uint64_t pos __attribute__((unused)), 
+        char *buf, size_t max) {
+    kis_net_httpd_stream_aux *aux = (kis_net_httpd_stream_aux *) cls;
+
+    ssize_t r = aux->buffer->read(buf, max);
+
+    if (r > 0)
+        aux->bytes_sent += r;
+
+    return r;
+}
+
+static void stream_free_callback(void *cls) {
+    kis_net_httpd_stream_aux *aux = (kis_net_httpd_stream_aux *) cls;
+
+    // Unblock the generator if the client went away early and wait for it
+    aux->buffer->cancel();
+    pthread_join(aux->generator_thread, NULL);
+
+    aux->httpd->AddClientCost(aux->client_key, aux->cpu_usec, aux->bytes_sent);
+
+    delete(aux->buffer);
+    delete(aux);
+}
+
+int Kis_Net_Httpd_Stream_Handler::Httpd_SendStreamingResponse(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection, const char *url, int in_encoding) {
+
+    kis_net_httpd_stream_aux *aux = new kis_net_httpd_stream_aux();
+    aux->httpd = httpd;
+    aux->handler = this;
+    aux->client_key = connection->client_key;
+    aux->cpu_usec = 0;
+    aux->bytes_sent = 0;
+    aux->url = url;
+    Kis_Net_Httpd::GetArguments(connection, aux->args);
+    aux->buffer = new Kis_Net_Httpd_Buffer_Stream(KIS_HTTPD_STREAMBUFFERSZ);
+
+    if (httpd->UsingThreadPool())
+        aux->buffer->set_suspend_connection(connection->connection);
+
+    // Streamed responses are large by definition, so they're always compressed
+    // when the client allows it
+    if (in_encoding != KIS_HTTPD_ENCODING_IDENTITY) {
+        aux->buffer->set_compressor(new Kis_Net_Httpd_Compressor(in_encoding,
+                    httpd->FetchCompressionLevel()));
+        connection->response_headers[MHD_HTTP_HEADER_CONTENT_ENCODING] = 
+            Kis_Net_Httpd::EncodingName(in_encoding);
+    }
+
+    if (pthread_create(&(aux->generator_thread), NULL, 
+                stream_generator_thread, aux) != 0) {
+        delete(aux->buffer);
+        delete(aux);
+        return MHD_NO;
+    }
+
+    struct MHD_Response *response = 
+        MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 32 * 1024,
+                &stream_reader, aux, &stream_free_callback);
+
+    if (response == NULL) {
+        stream_free_callback(aux);
+        return MHD_NO;
+    }
+
+    Kis_Net_Httpd::AppendStandardHeaders(httpd, connection, response, url);
+
+    int ret = MHD_queue_response(connection->connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+
+    return ret;
+}
+
 int Kis_Net_Httpd_Stream_Handler::Httpd_HandleRequest(Kis_Net_Httpd *httpd, 
         Kis_Net_Httpd_Connection *connection,
         const char *url, const char *method, const char *upload_data,
         size_t *upload_data_size) {
 
-    std::stringstream stream;
+    uint64_t generation = 0;
+    string cache_key;
+
+    // Park long-poll requests until there's something to send
+    string longpoll_topic = Httpd_LongPollTopic(url, method);
+
+    if (longpoll_topic != "" && 
+            !httpd->WaitLongPoll(this, connection, url, longpoll_topic))
+        return MHD_YES;
+
+    int encoding = httpd->NegotiateEncoding(connection);
+
+    // Caches between us and the client need to keep encodings apart
+    if (httpd->CompressionEnabled())
+        connection->response_headers[MHD_HTTP_HEADER_VARY] = 
+            MHD_HTTP_HEADER_ACCEPT_ENCODING;
+
+    if (httpd->UseResponseCache())
+        generation = Httpd_ContentGeneration(url, method);
+
+    if (generation != 0) {
+        // Each encoding is a different representation with its own ETag
+        cache_key = Kis_Net_Httpd::GetCacheKey(connection, url) + "|" +
+            Kis_Net_Httpd::EncodingName(encoding);
+
+        string etag = Kis_Net_Httpd::GetETag(cache_key, generation);
+
+        connection->response_headers[MHD_HTTP_HEADER_ETAG] = etag;
+        // Let browsers keep the response but make them check it every time
+        connection->response_headers[MHD_HTTP_HEADER_CACHE_CONTROL] = "no-cache";
+
+        const char *client_etag = 
+            MHD_lookup_connection_value(connection->connection, MHD_HEADER_KIND,
+                    MHD_HTTP_HEADER_IF_NONE_MATCH);
+
+        if (client_etag != NULL && 
+                (strcmp(client_etag, "*") == 0 || strstr(client_etag, etag.c_str()) != NULL))
+            return httpd->SendHttpResponse(httpd, connection, url, 
+                    MHD_HTTP_NOT_MODIFIED, "");
+    }
+
+    if (Httpd_StreamingResponse(url, method))
+        return Httpd_SendStreamingResponse(httpd, connection, url, encoding);
+
+    string body;
+    int body_encoding = KIS_HTTPD_ENCODING_IDENTITY;
     int ret;
 
-    Httpd_CreateStreamResponse(httpd, connection, url, method, upload_data,
-            upload_data_size, stream);
+    if (generation == 0 || 
+            !httpd->FetchCachedResponse(cache_key, generation, body, body_encoding)) {
+        std::stringstream stream;
+
+        // Handlers can reject a request by setting the code
+        connection->httpcode = MHD_HTTP_OK;
+
+        Httpd_CreateStreamResponse(httpd, connection, url, method, upload_data,
+                upload_data_size, stream);
+
+        body = stream.str();
+
+        // Errors aren't a representation of the content; don't cache or tag them
+        if (connection->httpcode != MHD_HTTP_OK) {
+            connection->response_headers.erase(MHD_HTTP_HEADER_ETAG);
+            connection->response_headers.erase(MHD_HTTP_HEADER_CACHE_CONTROL);
+
+            return httpd->SendHttpResponse(httpd, connection, url, 
+                    connection->httpcode, body);
+        }
+
+        string compressed;
+        if (httpd->CompressBody(encoding, body, compressed)) {
+            body.swap(compressed);
+            body_encoding = encoding;
+        }
+
+        if (generation != 0)
+            httpd->StoreCachedResponse(cache_key, generation, body, body_encoding);
+    }
+
+    if (body_encoding != KIS_HTTPD_ENCODING_IDENTITY)
+        connection->response_headers[MHD_HTTP_HEADER_CONTENT_ENCODING] = 
+            Kis_Net_Httpd::EncodingName(body_encoding);
 
-    ret = httpd->SendHttpResponse(httpd, connection, url, MHD_HTTP_OK, stream.str());
+    ret = httpd->SendHttpResponse(httpd, connection, url, MHD_HTTP_OK, body);
     
     return ret;
 }
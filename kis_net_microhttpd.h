@@ -27,9 +27,16 @@
 #include <string>
 #include <sstream>
 #include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <microhttpd.h>
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #include "globalregistry.h"
+#include "timetracker.h"
 #include "trackedelement.h"
 
 #ifndef __KIS_NET_MICROHTTPD__
@@ -40,6 +47,54 @@ class Kis_Net_Httpd_Session;
 class Kis_Net_Httpd_Connection;
 
 class EntryTracker;
+class Kis_Net_Httpd_Handler;
+
+// Request cost classes, for rate limiting.  Heavy requests are the ones which
+// walk or serialize the whole device list while holding its lock.
+#define KIS_HTTPD_CLASS_LIGHT       0
+#define KIS_HTTPD_CLASS_HEAVY       1
+#define KIS_HTTPD_CLASS_MAX         2
+
+// Clients idle this long, in seconds, are forgotten once we track too many
+#define KIS_HTTPD_CLIENT_IDLE       600
+#define KIS_HTTPD_CLIENT_MAX        1024
+
+// Node of the compiled route tree.  Each node is one path segment; requests
+// are dispatched by walking the tree instead of asking every handler.
+class Kis_Net_Httpd_Route_Node {
+public:
+    Kis_Net_Httpd_Route_Node() {
+        param = NULL;
+    }
+
+    ~Kis_Net_Httpd_Route_Node();
+
+    struct route_target {
+        string method;
+        Kis_Net_Httpd_Handler *handler;
+    };
+
+    // Segments matched exactly
+    map<string, Kis_Net_Httpd_Route_Node *> literal;
+    // Segments matched by the name before a format suffix
+    map<string, Kis_Net_Httpd_Route_Node *> suffixed;
+    // Any single segment
+    Kis_Net_Httpd_Route_Node *param;
+
+    // Handlers for routes ending here, and for routes ending here which
+    // accept any remaining path
+    vector<route_target> targets;
+    vector<route_target> rest_targets;
+
+    void insert(const vector<string> &in_route, unsigned int in_pos, 
+            string in_method, Kis_Net_Httpd_Handler *in_handler);
+    void remove(Kis_Net_Httpd_Handler *in_handler);
+
+    // Add every handler with a route matching the path to ret_handlers, most
+    // specific first
+    void match(const vector<string> &in_path, unsigned int in_pos,
+            const char *in_method, vector<Kis_Net_Httpd_Handler *> &ret_handlers);
+};
 
 // Basic request handler from MHD
 class Kis_Net_Httpd_Handler {
@@ -68,6 +123,15 @@ public:
     virtual string Httpd_GetSuffix(string path);
     virtual string Httpd_StripSuffix(string path);
 
+    // Register a route this handler serves; see Kis_Net_Httpd::RegisterRoute
+    void Httpd_RegisterRoute(string in_method, string in_route);
+
+    // Cost class of a request, for rate limiting
+    virtual int Httpd_RequestClass(const char *url __attribute__((unused)),
+            const char *method __attribute__((unused))) {
+        return KIS_HTTPD_CLASS_LIGHT;
+    }
+
 
     // By default, the Kismet HTTPD implementation will cache all POST variables
     // in the variable_cache map in the connection record, and call
@@ -79,6 +143,23 @@ public:
         return false;
     }
 
+    // Streaming POST.  When this returns true for a request, the body is not
+    // run through the form parser and cached; Httpd_PostData is called with 
+    // each block of the body as it arrives, pointing straight into the 
+    // webserver buffer, and Httpd_PostComplete is called at the end as usual.
+    // The request headers are available through the connection.
+    virtual bool Httpd_UseStreamingPost(Kis_Net_Httpd_Connection *con __attribute__((unused))) {
+        return false;
+    }
+
+    // Handle a block of a streamed POST body.  The data is only valid during
+    // the call.
+    virtual void Httpd_PostData(Kis_Net_Httpd_Connection *con __attribute__((unused)),
+            const char *data __attribute__((unused)), 
+            size_t size __attribute__((unused))) {
+        return;
+    }
+
     // Called when a POST event is complete - all data has been uploaded and
     // cached in the connection info.
     virtual int Httpd_PostComplete(Kis_Net_Httpd_Connection *con __attribute__((unused))) {
@@ -126,6 +207,116 @@ protected:
 
 };
 
+// Daemon operating modes; a thread for every connection, or a fixed pool of
+// threads polling all connections
+#define KIS_HTTPD_MODE_THREAD       0
+#define KIS_HTTPD_MODE_POOL         1
+
+// Pool threads have to be able to park a connection which is waiting on data;
+// older libmicrohttpd only needs the shutdown pipe to allow it
+#if MHD_VERSION >= 0x00094200
+#define KIS_HTTPD_SUSPEND_FLAG      MHD_USE_SUSPEND_RESUME
+#else
+#define KIS_HTTPD_SUSPEND_FLAG      MHD_USE_PIPE_FOR_SHUTDOWN
+#endif
+
+// Longest a long-poll request can be held, in seconds
+#define KIS_HTTPD_LONGPOLL_MAX      60
+
+// Content encodings we can apply to a response
+#define KIS_HTTPD_ENCODING_IDENTITY     0
+#define KIS_HTTPD_ENCODING_GZIP         1
+#define KIS_HTTPD_ENCODING_DEFLATE      2
+
+// Incremental gzip or deflate compressor.  Without zlib every compression
+// fails and responses are sent uncompressed.
+class Kis_Net_Httpd_Compressor {
+public:
+    Kis_Net_Httpd_Compressor(int in_encoding, int in_level);
+    ~Kis_Net_Httpd_Compressor();
+
+    // Compress a block of data, appending any output to ret_data.  in_finish
+    // flushes and terminates the compressed stream.
+    bool compress(const char *in_data, size_t in_len, string &ret_data, bool in_finish);
+
+protected:
+    bool valid;
+
+#ifdef HAVE_LIBZ
+    z_stream zs;
+#endif
+};
+
+// Bounded buffer between a thread generating a streaming response and the
+// microhttpd content reader callback which drains it to the client.
+//
+// The producer appends with write(), which never blocks, and calls wait_drain()
+// between chunks - outside of any locks - to pause until the client has caught
+// up.  The reader blocks in read() until data is available or the producer
+// calls complete().  If the client goes away the stream is cancelled and
+// write() and wait_drain() return false so the producer can bail out.
+class Kis_Net_Httpd_Buffer_Stream {
+public:
+    Kis_Net_Httpd_Buffer_Stream(size_t in_max_size);
+    ~Kis_Net_Httpd_Buffer_Stream();
+
+    // Compress everything written from here on; the stream takes ownership of
+    // the compressor
+    void set_compressor(Kis_Net_Httpd_Compressor *in_compressor) {
+        compressor = in_compressor;
+    }
+
+    // A pool thread can't block waiting for data, so instead of waiting the
+    // reader suspends the connection and the producer resumes it when there
+    // is something to send
+    void set_suspend_connection(struct MHD_Connection *in_connection) {
+        suspend_connection = in_connection;
+    }
+
+    // Producer side
+    bool write(const char *in_data, size_t in_len);
+    bool write(const string &in_data) {
+        return write(in_data.data(), in_data.length());
+    }
+
+    bool wait_drain();
+
+    // Bytes written but not yet read
+    size_t get_pending();
+
+    // Mark the stream as finished; an errored stream terminates the response
+    // instead of ending it cleanly
+    void complete(bool in_error = false);
+
+    // Consumer side, returns the number of bytes copied or one of the
+    // MHD_CONTENT_READER_END_ codes
+    ssize_t read(char *in_buf, size_t in_max);
+
+    void cancel();
+    bool is_cancelled();
+
+protected:
+    pthread_mutex_t buffer_mutex;
+    pthread_cond_t buffer_cond;
+
+    string buffer;
+    size_t buffer_pos;
+    size_t max_size;
+
+    bool completed, errored, cancelled;
+
+    struct MHD_Connection *suspend_connection;
+    bool suspended;
+
+    // Resume a suspended reader; must be called with the buffer locked
+    void wake_reader();
+
+    // Only used by the producer, so it's never touched under the buffer lock
+    Kis_Net_Httpd_Compressor *compressor;
+
+    bool append(const char *in_data, size_t in_len);
+};
+
 // Take a C++ stringstream and use it as a response
 class Kis_Net_Httpd_Stream_Handler : public Kis_Net_Httpd_Handler {
 public:
@@ -146,11 +337,59 @@ public:
             const char *url, const char *method, const char *upload_data,
             size_t *upload_data_size);
 
+    // Large responses can be generated incrementally instead of being built
+    // in a stringstream and copied.  If this returns true for a request,
+    // Httpd_CreateStreamingResponse is called in its own thread and its output
+    // is sent to the client as the socket accepts it.  The connection may not
+    // be touched from the generator thread, so any GET arguments of the request
+    // are passed along in args.
+    virtual bool Httpd_StreamingResponse(const char *url __attribute__((unused)),
+            const char *method __attribute__((unused))) {
+        return false;
+    }
+
+    virtual void Httpd_CreateStreamingResponse(string url __attribute__((unused)),
+            map<string, string> args __attribute__((unused)),
+            Kis_Net_Httpd_Buffer_Stream *stream __attribute__((unused))) {
+        return;
+    }
+
+    // Long-polling.  When a request carries a 'timeout' argument and this
+    // returns a topic, the request is held until Httpd_LongPollReady is true
+    // or the timeout passes.  Readiness is checked again whenever
+    // Kis_Net_Httpd::NotifyLongPoll is called for the topic.
+    virtual string Httpd_LongPollTopic(const char *url __attribute__((unused)),
+            const char *method __attribute__((unused))) {
+        return "";
+    }
+
+    virtual bool Httpd_LongPollReady(const char *url __attribute__((unused))) {
+        return true;
+    }
+
+    int Httpd_SendStreamingResponse(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection, const char *url, int in_encoding);
+
+    // Responses can be cached and validated by ETag when the handler can
+    // report a generation which changes whenever the content of url would.
+    // Repeated requests within a generation are served from the cached
+    // response, and clients holding a matching ETag get a 304.  Returning 0
+    // disables caching for the request.
+    virtual uint64_t Httpd_ContentGeneration(const char *url __attribute__((unused)),
+            const char *method __attribute__((unused))) {
+        return 0;
+    }
+
     // Shortcuts to the entry tracker and serializer since most endpoints will
     // need to serialize
     virtual bool Httpd_Serialize(string path, std::stringstream &stream,
             SharedTrackerElement e, 
             TrackerElementSerializer::rename_map *name_map = NULL);
+
+    // Serialize only what changed at or after generation 'since'
+    virtual bool Httpd_SerializeDelta(string path, std::stringstream &stream,
+            SharedTrackerElement e, uint64_t since,
+            TrackerElementSerializer::rename_map *name_map = NULL);
 };
 
 // Fallback handler to report that we can't serve static files
@@ -166,6 +405,60 @@ public:
 
 #define KIS_SESSION_COOKIE      "KISMET"
 #define KIS_HTTPD_POSTBUFFERSZ  (1024 * 32)
+// Maximum data buffered ahead of the client in a streaming response
+#define KIS_HTTPD_STREAMBUFFERSZ    (1024 * 256)
+// Limits of the generation-keyed response cache; responses larger than a 
+// quarter of the cache are never stored
+#define KIS_HTTPD_CACHE_MAX_ENTRIES 64
+#define KIS_HTTPD_CACHE_MAX_BYTES   (1024 * 1024 * 16)
+
+// A static file held in memory, with a gzip copy when it compresses well.
+// Connections serving it hold a reference, since the response points at the
+// cached data instead of copying it.
+class Kis_Net_Httpd_Static_Asset {
+public:
+    time_t mtime;
+    off_t size;
+
+    string body;
+    string gzip_body;
+
+    string etag;
+    string gzip_etag;
+
+    string mime;
+    string lastmod;
+};
+
+// Requests and cost of a client, keyed by login session or by address
+class Kis_Net_Httpd_Client {
+public:
+    Kis_Net_Httpd_Client() {
+        last_time = 0;
+        refill_time = 0;
+        requests = 0;
+        rejected = 0;
+        cpu_usec = 0;
+        bytes = 0;
+
+        for (unsigned int x = 0; x < KIS_HTTPD_CLASS_MAX; x++)
+            tokens[x] = 0;
+    }
+
+    string key;
+    string address;
+
+    time_t last_time;
+
+    // Token buckets for each request class, and when they were last filled
+    double tokens[KIS_HTTPD_CLASS_MAX];
+    double refill_time;
+
+    uint64_t requests;
+    uint64_t rejected;
+    uint64_t cpu_usec;
+    uint64_t bytes;
+};
 
 // Connection data, used for processing POST requests
 class Kis_Net_Httpd_Connection {
@@ -183,6 +476,14 @@ public:
         session = NULL;
         connection = NULL;
         response = NULL;
+        longpoll_deadline = 0;
+        post_size = 0;
+        post_streaming = false;
+        post_rejected = false;
+        post_overflowed = false;
+        heavy_slot = false;
+        cpu_usec = 0;
+        bytes_sent = 0;
     }
 
     // response generated by post
@@ -203,6 +504,31 @@ public:
     // Is the post complete?
     bool post_complete;
 
+    // Size of the POST body so far
+    size_t post_size;
+
+    // Is the body being passed to the handler as it arrives instead of 
+    // being parsed into variable_cache
+    bool post_streaming;
+
+    // Unparsed tail of a streamed body, for handlers which parse it one 
+    // record at a time
+    string post_remainder;
+
+    // Body was too large and an error has been sent
+    bool post_rejected;
+
+    // Body grew too large while it was being uploaded; the error is sent once
+    // the upload completes
+    bool post_overflowed;
+
+    // Client the request is charged to, whether it holds one of the limited
+    // slots for heavy requests, and what it has cost so far
+    string client_key;
+    bool heavy_slot;
+    uint64_t cpu_usec;
+    uint64_t bytes_sent;
+
     // Type of request/connection
     int connection_type;
 
@@ -220,6 +546,15 @@ public:
 
     // Response created elsewhere, if any
     struct MHD_Response *response;
+
+    // Additional headers to attach to the response
+    map<string, string> response_headers;
+
+    // When a long-poll request gives up waiting, or 0 if not long-polling
+    time_t longpoll_deadline;
+
+    // Cached static file being sent, kept until the request completes
+    shared_ptr<Kis_Net_Httpd_Static_Asset> static_asset;
 };
 
 class Kis_Net_Httpd_Session {
@@ -237,7 +572,7 @@ public:
     time_t session_lifetime;
 };
 
-class Kis_Net_Httpd : public LifetimeGlobal {
+class Kis_Net_Httpd : public LifetimeGlobal, public TimetrackerEvent {
 public:
     static shared_ptr<Kis_Net_Httpd> create_httpd(GlobalRegistry *in_globalreg) {
         shared_ptr<Kis_Net_Httpd> mon(new Kis_Net_Httpd(in_globalreg));
@@ -260,9 +595,46 @@ public:
     unsigned int FetchPort() { return http_port; };
     bool FetchUsingSSL() { return use_ssl; };
 
+    // Are requests served by a pool of threads; if so, handlers must not block
+    // waiting on anything but locks
+    bool UsingThreadPool() { return httpd_mode == KIS_HTTPD_MODE_POOL; }
+
     void RegisterHandler(Kis_Net_Httpd_Handler *in_handler);
     void RemoveHandler(Kis_Net_Httpd_Handler *in_handler);
 
+    // Register a route served by a handler.  Routes are matched a segment at a
+    // time:
+    //   name       matches exactly
+    //   name.*     matches name with any format suffix, such as name.json
+    //   :name      matches any single segment
+    //   *          as the final segment, matches whatever is left of the path
+    // A handler with routes is only offered the requests matching them, and
+    // Httpd_VerifyPath is still called to validate the request.  Handlers 
+    // without routes are asked about every request which no route claims.
+    void RegisterRoute(string in_method, string in_route, 
+            Kis_Net_Httpd_Handler *in_handler);
+
+    // Find the handler for a request
+    Kis_Net_Httpd_Handler *FindHandler(const char *url, const char *method);
+
+    // Charge a request to its client and check it against the limits for its
+    // class.
+    // Return: 0 if the request may run, or seconds the client should wait
+    int AdmitRequest(Kis_Net_Httpd_Connection *connection, int in_class);
+
+    // Return the heavy request slot of a completed request and record its cost
+    void ReleaseRequest(Kis_Net_Httpd_Connection *connection);
+
+    // Add to the cost of a client; streamed responses finish after their 
+    // request completes
+    void AddClientCost(string in_key, uint64_t in_cpu_usec, uint64_t in_bytes);
+
+    // Copy of the per-client statistics
+    void GetClientStats(vector<Kis_Net_Httpd_Client> &ret_clients);
+
+    // CPU time used by the calling thread
+    static uint64_t ThreadCPUTime();
+
     static string GetSuffix(string url);
     static string StripSuffix(string url);
 
@@ -283,6 +655,57 @@ public:
             Kis_Net_Httpd_Connection *connection,
             const char *url, int httpcode, string responsestr);
 
+    // Add the session cookie, mime type, and other common headers to a response
+    static void AppendStandardHeaders(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection,
+            struct MHD_Response *response, const char *url);
+
+    // Hold a long-poll request until its handler has something new, a
+    // notification arrives for the topic, or it times out.  Pool threads can't
+    // wait, so in pool mode the connection is suspended and false is returned;
+    // the request is handled again when it's resumed.
+    // Return: true if the request should be answered now
+    bool WaitLongPoll(Kis_Net_Httpd_Stream_Handler *in_handler,
+            Kis_Net_Httpd_Connection *connection, const char *url, string in_topic);
+
+    // Something has changed which long-poll requests on a topic may be
+    // waiting for
+    void NotifyLongPoll(string in_topic);
+
+    // Forget a connection which closed while waiting
+    void CancelLongPoll(Kis_Net_Httpd_Connection *connection);
+
+    virtual int timetracker_event(int eventid);
+
+    // Pick the encoding for a response from the client Accept-Encoding header
+    // and the compression config
+    int NegotiateEncoding(Kis_Net_Httpd_Connection *connection);
+    static const char *EncodingName(int in_encoding);
+
+    bool CompressionEnabled() { return compression_level > 0; }
+    int FetchCompressionLevel() { return compression_level; }
+
+    // Compress a complete response body if it's large enough to be worth it
+    // Return: true if ret_body holds the compressed body
+    bool CompressBody(int in_encoding, const string &in_body, string &ret_body);
+
+    // Generation-keyed response cache
+    bool UseResponseCache() { return response_cache_enabled; }
+
+    // Cache key of a request, from the URL and any GET arguments
+    static string GetCacheKey(Kis_Net_Httpd_Connection *connection, const char *url);
+
+    // All GET arguments of a request
+    static void GetArguments(Kis_Net_Httpd_Connection *connection,
+            map<string, string> &ret_args);
+    static string GetETag(string in_key, uint64_t in_generation);
+
+    // Fetch a cached response generated at in_generation
+    bool FetchCachedResponse(string in_key, uint64_t in_generation, string &ret_body,
+            int &ret_encoding);
+    void StoreCachedResponse(string in_key, uint64_t in_generation, 
+            const string &in_body, int in_encoding);
+
     // Catch MHD panics and try to close more elegantly
     static void MHD_Panic(void *cls, const char *file, unsigned int line,
             const char *reason);
@@ -291,6 +714,8 @@ protected:
     GlobalRegistry *globalreg;
 
     unsigned int http_port;
+    // IPv4 address to listen on, or empty for all interfaces
+    string http_bind_address;
     string http_data_dir, http_aux_data_dir;
 
     bool http_serve_files, http_serve_user_files;
@@ -298,12 +723,23 @@ protected:
     struct MHD_Daemon *microhttpd;
     std::vector<Kis_Net_Httpd_Handler *> handler_vec;
 
+    // Routed handlers, and the handlers without routes which are still
+    // dispatched by asking each in turn
+    Kis_Net_Httpd_Route_Node route_root;
+    std::vector<Kis_Net_Httpd_Handler *> unrouted_handler_vec;
+
     string conf_username, conf_password;
 
     bool use_ssl;
     char *cert_pem, *cert_key;
     string pem_path, key_path;
 
+    // Threading mode and connection limits; 0 leaves the libmicrohttpd default
+    int httpd_mode;
+    unsigned int pool_size;
+    unsigned int connection_limit, per_ip_connection_limit;
+    unsigned int connection_timeout;
+
     bool running;
 
     std::map<string, string> mime_type_map;
@@ -321,6 +757,24 @@ protected:
     static int handle_static_file(void *cls, Kis_Net_Httpd_Connection *connection,
             const char *url, const char *method);
 
+    // Static file cache; entries are checked against the file modification 
+    // time and size on every request
+    bool static_cache_enabled;
+    size_t static_cache_max;
+    size_t static_cache_bytes;
+    pthread_mutex_t static_cache_mutex;
+    map<string, shared_ptr<Kis_Net_Httpd_Static_Asset> > static_cache;
+
+    // Fetch a file from the cache, loading it if it's missing or out of date.
+    // Return: NULL if the file is too large to cache or can't be read
+    shared_ptr<Kis_Net_Httpd_Static_Asset> FetchStaticAsset(string in_path, 
+            struct stat *in_stat);
+    shared_ptr<Kis_Net_Httpd_Static_Asset> LoadStaticAsset(string in_path,
+            struct stat *in_stat);
+
+    // Load everything under a directory into the cache at startup
+    void PreloadStaticAssets(string in_dir, unsigned int in_depth);
+
     static int http_post_handler(void *coninfo_cls, enum MHD_ValueKind kind, 
             const char *key, const char *filename, const char *content_type,
             const char *transfer_encoding, const char *data, 
@@ -335,10 +789,52 @@ protected:
 
     map<string, Kis_Net_Httpd_Session *> session_map;
 
+    int compression_level;
+    size_t compression_min_size;
+
+    // Largest POST body accepted, or 0 for no limit
+    size_t post_max_size;
+
+    // Per-client token bucket for each request class; a rate of 0 is unlimited
+    double rate_limit[KIS_HTTPD_CLASS_MAX];
+    double rate_burst[KIS_HTTPD_CLASS_MAX];
+
+    // Heavy requests which may run at once, or 0 for no limit
+    unsigned int heavy_concurrency;
+    unsigned int heavy_active;
+
+    pthread_mutex_t client_mutex;
+    map<string, Kis_Net_Httpd_Client> client_map;
+
+    struct cached_response {
+        uint64_t generation;
+        string body;
+        int encoding;
+    };
+
+    bool response_cache_enabled;
+    pthread_mutex_t cache_mutex;
+    map<string, cached_response> response_cache;
+    size_t response_cache_bytes;
+
     bool store_sessions;
     string sessiondb_file;
     ConfigFile *session_db;
 
+    struct longpoll_waiter {
+        Kis_Net_Httpd_Connection *connection;
+        string topic;
+    };
+
+    // Long-poll state; the sequence of each topic changes with every
+    // notification so that one arriving while a request checks its handler
+    // isn't missed
+    pthread_mutex_t longpoll_mutex;
+    pthread_cond_t longpoll_cond;
+    map<string, uint64_t> longpoll_seq;
+    vector<longpoll_waiter> longpoll_waiters;
+    int longpoll_timer;
+
 };
 
 #endif
@@ -43,6 +43,7 @@
 #include "packetsource_wext.h"
 #include "packetsource_ipwlive.h"
 #include "packetsource_airpcap.h"
+#include "packetsource_tpacket.h"
 #include "packetsourcetracker.h"
 
 #include "dumpfile.h"
@@ -235,6 +236,10 @@ int main(int argc, char *argv[], char *envp[]) {
 	if (globalreg->sourcetracker->RegisterPacketSource(new PacketSource_AirPcap(globalreg)) < 0 || globalreg->fatal_condition) 
 		CatchShutdown(-1);
 #endif
+#ifdef USE_PACKETSOURCE_TPACKET
+	if (globalreg->sourcetracker->RegisterPacketSource(new PacketSource_Tpacket(globalreg)) < 0 || globalreg->fatal_condition) 
+		CatchShutdown(-1);
+#endif
 
 #ifndef SYS_CYGWIN
 	// Prep the tuntap 
@@ -0,0 +1,889 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* REST load generator and latency benchmark.
+ *
+ * Starts the Kismet webserver and the REST handlers in-process, fills the
+ * device tracker with synthetic devices, and drives requests at the endpoints
+ * from a set of client threads over loopback.  Nothing is captured and nothing
+ * listens beyond 127.0.0.1, so it can be run anywhere to compare builds or
+ * webserver options.
+ */
+
+#include "config.h"
+
+#include "version.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "getopt.h"
+#include "util.h"
+#include "globalregistry.h"
+#include "configfile.h"
+#include "messagebus.h"
+#include "timetracker.h"
+#include "packetchain.h"
+#include "entrytracker.h"
+#include "msgpack_adapter.h"
+#include "json_adapter.h"
+#include "base64.h"
+
+#include "kis_net_microhttpd.h"
+#include "kis_httpd_eventstream.h"
+#include "kis_httpd_websession.h"
+#include "messagebus_restclient.h"
+#include "alertracker.h"
+#include "channeltracker2.h"
+#include "devicetracker.h"
+#include "phy_rtl433.h"
+#include "system_monitor.h"
+
+#ifndef exec_name
+char *exec_name;
+#endif
+
+int glob_linewrap = 1;
+int glob_silent = 0;
+
+GlobalRegistry *globalreg = NULL;
+
+#define BENCH_USER      "bench"
+#define BENCH_PASS      "bench"
+
+// Only errors are worth printing; the info messages would swamp the report
+class BenchMessageClient : public MessageClient {
+public:
+    BenchMessageClient(GlobalRegistry *in_globalreg, void *in_aux) :
+        MessageClient(in_globalreg, in_aux) { }
+    virtual ~BenchMessageClient() { }
+
+    void ProcessMessage(string in_msg, int in_flags) {
+        if (in_flags & MSGFLAG_FATAL)
+            fprintf(stderr, "FATAL: %s\n", in_msg.c_str());
+        else if (in_flags & MSGFLAG_ERROR)
+            fprintf(stderr, "ERROR: %s\n", in_msg.c_str());
+    }
+};
+
+// Minimal keep-alive HTTP/1.1 client; only what's needed to time a request
+// and discard the response
+class bench_http_client {
+public:
+    bench_http_client(unsigned int in_port, string in_auth, bool in_gzip) {
+        fd = -1;
+        port = in_port;
+        auth = in_auth;
+        gzip = in_gzip;
+    }
+
+    ~bench_http_client() {
+        Disconnect();
+    }
+
+    // Status code of the response, or -1 if the connection failed.  The
+    // connection is re-opened as needed.
+    int Request(const string& in_url, size_t *ret_len) {
+        *ret_len = 0;
+
+        if (fd < 0 && Connect() < 0)
+            return -1;
+
+        string req = "GET " + in_url + " HTTP/1.1\r\n"
+            "Host: localhost\r\n"
+            "Authorization: Basic " + auth + "\r\n";
+
+        if (gzip)
+            req += "Accept-Encoding: gzip\r\n";
+
+        req += "\r\n";
+
+        if (WriteAll(req) < 0) {
+            // The server may have closed an idle keep-alive; try once more on a
+            // fresh connection
+            Disconnect();
+
+            if (Connect() < 0 || WriteAll(req) < 0) {
+                Disconnect();
+                return -1;
+            }
+        }
+
+        int code = ReadResponse(ret_len);
+
+        if (code < 0 || close_after)
+            Disconnect();
+
+        return code;
+    }
+
+protected:
+    int fd;
+    unsigned int port;
+    string auth;
+    bool gzip;
+
+    string rbuf;
+    bool close_after;
+
+    int Connect() {
+        struct sockaddr_in addr;
+
+        if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+            return -1;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+            Disconnect();
+            return -1;
+        }
+
+        rbuf.clear();
+
+        return 1;
+    }
+
+    void Disconnect() {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+        rbuf.clear();
+    }
+
+    int WriteAll(const string& in_data) {
+        size_t pos = 0;
+
+        while (pos < in_data.length()) {
+            ssize_t r = send(fd, in_data.data() + pos, in_data.length() - pos,
+                    MSG_NOSIGNAL);
+
+            if (r < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+
+            pos += r;
+        }
+
+        return 1;
+    }
+
+    // Read more of the response into the buffer; 0 on close
+    int Fill() {
+        char buf[65536];
+
+        while (1) {
+            ssize_t r = recv(fd, buf, sizeof(buf), 0);
+
+            if (r < 0 && errno == EINTR)
+                continue;
+
+            if (r > 0)
+                rbuf.append(buf, r);
+
+            return r;
+        }
+    }
+
+    // Wait until the buffer holds a line and return it, without the CRLF
+    int ReadLine(string& ret_line) {
+        size_t eol;
+
+        while ((eol = rbuf.find("\r\n")) == string::npos) {
+            if (Fill() <= 0)
+                return -1;
+        }
+
+        ret_line = rbuf.substr(0, eol);
+        rbuf.erase(0, eol + 2);
+
+        return 1;
+    }
+
+    // Consume a fixed amount of body
+    int Discard(size_t in_len) {
+        while (rbuf.length() < in_len) {
+            in_len -= rbuf.length();
+            rbuf.clear();
+
+            if (Fill() <= 0)
+                return -1;
+        }
+
+        rbuf.erase(0, in_len);
+
+        return 1;
+    }
+
+    int ReadResponse(size_t *ret_len) {
+        string line;
+        int code;
+
+        close_after = false;
+
+        if (ReadLine(line) < 0)
+            return -1;
+
+        if (sscanf(line.c_str(), "HTTP/%*d.%*d %d", &code) != 1)
+            return -1;
+
+        bool chunked = false;
+        bool have_len = false;
+        size_t len = 0;
+
+        while (1) {
+            if (ReadLine(line) < 0)
+                return -1;
+
+            if (line == "")
+                break;
+
+            size_t colon = line.find(':');
+            if (colon == string::npos)
+                continue;
+
+            string key = StrLower(line.substr(0, colon));
+            string value = StrLower(StrStrip(line.substr(colon + 1)));
+
+            if (key == "content-length") {
+                have_len = true;
+                len = strtoull(value.c_str(), NULL, 10);
+            } else if (key == "transfer-encoding" && value == "chunked") {
+                chunked = true;
+            } else if (key == "connection" && value == "close") {
+                close_after = true;
+            }
+        }
+
+        // No body, regardless of the headers
+        if (code == 304 || code == 204 || (code >= 100 && code < 200))
+            return code;
+
+        if (chunked) {
+            while (1) {
+                if (ReadLine(line) < 0)
+                    return -1;
+
+                size_t chunk = strtoull(line.c_str(), NULL, 16);
+
+                if (chunk == 0) {
+                    // Skip any trailers up to the final blank line
+                    do {
+                        if (ReadLine(line) < 0)
+                            return -1;
+                    } while (line != "");
+
+                    break;
+                }
+
+                if (Discard(chunk + 2) < 0)
+                    return -1;
+
+                *ret_len += chunk;
+            }
+        } else if (have_len) {
+            if (Discard(len) < 0)
+                return -1;
+
+            *ret_len = len;
+        } else {
+            // Body runs to the end of the connection
+            *ret_len = rbuf.length();
+            rbuf.clear();
+
+            int r;
+            while ((r = Fill()) > 0) {
+                *ret_len += rbuf.length();
+                rbuf.clear();
+            }
+
+            close_after = true;
+        }
+
+        return code;
+    }
+};
+
+struct bench_url_stats {
+    bench_url_stats() {
+        errors = 0;
+        bytes = 0;
+    }
+
+    vector<uint32_t> latency_usec;
+    map<int, uint64_t> codes;
+    uint64_t errors;
+    uint64_t bytes;
+};
+
+struct bench_worker {
+    pthread_t thread;
+    unsigned int id;
+
+    unsigned int port;
+    string auth;
+    bool gzip;
+
+    const vector<string> *urls;
+    vector<bench_url_stats> stats;
+
+    volatile bool *running;
+};
+
+static uint64_t bench_now_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *bench_worker_thread(void *arg) {
+    bench_worker *w = (bench_worker *) arg;
+    bench_http_client client(w->port, w->auth, w->gzip);
+
+    // Start each worker at a different endpoint so the mix is even from the
+    // first request
+    unsigned int u = w->id % w->urls->size();
+
+    while (*(w->running)) {
+        size_t len;
+
+        uint64_t start = bench_now_usec();
+        int code = client.Request((*(w->urls))[u], &len);
+        uint64_t end = bench_now_usec();
+
+        bench_url_stats& s = w->stats[u];
+
+        if (code < 0) {
+            s.errors++;
+            // Don't spin if the server has gone away
+            usleep(10000);
+        } else {
+            s.codes[code]++;
+            s.bytes += len;
+            s.latency_usec.push_back(end - start);
+        }
+
+        u = (u + 1) % w->urls->size();
+    }
+
+    return NULL;
+}
+
+struct bench_updater {
+    pthread_t thread;
+
+    shared_ptr<Devicetracker> devicetracker;
+    shared_ptr<Packetchain> packetchain;
+    int pack_comp_common;
+    int phyid;
+
+    unsigned int num_devices;
+    unsigned int rate;
+
+    uint64_t updates;
+
+    volatile bool *running;
+};
+
+static mac_addr bench_device_mac(unsigned int in_num) {
+    uint8_t mac[6];
+
+    // Locally administered so they can't be mistaken for real hardware
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = (in_num >> 24) & 0xFF;
+    mac[3] = (in_num >> 16) & 0xFF;
+    mac[4] = (in_num >> 8) & 0xFF;
+    mac[5] = in_num & 0xFF;
+
+    return mac_addr(mac, 6);
+}
+
+// Update a device the same way a packet would, through the common device path
+static void bench_update_device(bench_updater *u, unsigned int in_num) {
+    kis_packet *pack = u->packetchain->GeneratePacket();
+
+    if (pack == NULL)
+        return;
+
+    pack->ts = globalreg->timestamp;
+
+    kis_common_info *common = new kis_common_info();
+    common->phyid = u->phyid;
+    common->type = packet_basic_data;
+    common->datasize = 64 + (in_num % 1400);
+    common->freq_khz = 433920;
+    common->channel = "433.92MHz";
+    common->device = bench_device_mac(in_num);
+    common->source = common->device;
+
+    pack->insert(u->pack_comp_common, common);
+
+    u->devicetracker->UpdateCommonDevice(common->device, u->phyid, pack,
+            (UCD_UPDATE_PACKETS | UCD_UPDATE_FREQUENCIES));
+
+    u->packetchain->DestroyPacket(pack);
+}
+
+static void *bench_updater_thread(void *arg) {
+    bench_updater *u = (bench_updater *) arg;
+    unsigned int next = 0;
+
+    // Update in batches every 10ms so the lock is taken the way it would be
+    // by a steady packet stream
+    unsigned int batch = u->rate / 100;
+    if (batch == 0)
+        batch = 1;
+
+    uint64_t interval = 10000 * batch * 100 / u->rate;
+
+    while (*(u->running)) {
+        uint64_t start = bench_now_usec();
+
+        for (unsigned int x = 0; x < batch; x++) {
+            bench_update_device(u, next);
+            next = (next + 1) % u->num_devices;
+            u->updates++;
+        }
+
+        u->devicetracker->BumpContentGeneration();
+
+        uint64_t spent = bench_now_usec() - start;
+
+        if (spent < interval)
+            usleep(interval - spent);
+    }
+
+    return NULL;
+}
+
+static void bench_percentile(vector<uint32_t>& in_sorted, double in_pct,
+        char *ret, size_t ret_len) {
+    if (in_sorted.size() == 0) {
+        snprintf(ret, ret_len, "-");
+        return;
+    }
+
+    size_t idx = (size_t) (in_pct * (in_sorted.size() - 1));
+
+    snprintf(ret, ret_len, "%.2f", in_sorted[idx] / 1000.0f);
+}
+
+int Usage(char *argv) {
+    printf("Usage: %s [OPTION]\n", argv);
+    printf(" *** Kismet REST Benchmark ***\n"
+            "Starts the Kismet webserver with a synthetic set of devices and times\n"
+            "requests to the REST endpoints over loopback.\n"
+            " -f, --config-file <file>     Read webserver options from a kismet.conf\n"
+            "                              (the port, address, and login are always\n"
+            "                              replaced)\n"
+            " -p, --port <port>            Port for the benchmark server (2599)\n"
+            " -n, --devices <count>        Synthetic devices to create (10000)\n"
+            " -c, --clients <count>        Concurrent client connections (8)\n"
+            " -t, --time <seconds>         Length of the run (10)\n"
+            " -r, --updates <rate>         Device updates per second during the run,\n"
+            "                              0 for a static device set (1000)\n"
+            " -u, --url <url>              Endpoint to request; may be repeated, and\n"
+            "                              replaces the default set\n"
+            " -s, --serialize-threads <n>  Device serialization threads; 1 for the\n"
+            "                              single-threaded path (one per CPU)\n"
+            " -z, --gzip                   Ask for compressed responses\n"
+            " -h, --help                   This message\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[], char *envp[]) {
+    exec_name = argv[0];
+
+    char *configfilename = NULL;
+    unsigned int port = 2599;
+    unsigned int num_devices = 10000;
+    unsigned int num_clients = 8;
+    unsigned int duration = 10;
+    unsigned int update_rate = 1000;
+    unsigned int serialize_threads = 0;
+    bool gzip = false;
+    vector<string> urls;
+
+    static struct option bench_longopt[] = {
+        { "config-file", required_argument, 0, 'f' },
+        { "port", required_argument, 0, 'p' },
+        { "devices", required_argument, 0, 'n' },
+        { "clients", required_argument, 0, 'c' },
+        { "time", required_argument, 0, 't' },
+        { "updates", required_argument, 0, 'r' },
+        { "url", required_argument, 0, 'u' },
+        { "serialize-threads", required_argument, 0, 's' },
+        { "gzip", no_argument, 0, 'z' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option_idx = 0;
+    optind = 0;
+
+    while (1) {
+        int r = getopt_long(argc, argv, "f:p:n:c:t:r:u:s:zh",
+                bench_longopt, &option_idx);
+        if (r < 0) break;
+
+        if (r == 'f') {
+            configfilename = strdup(optarg);
+        } else if (r == 'p') {
+            if (sscanf(optarg, "%u", &port) != 1 || port == 0 || port > 65535) {
+                fprintf(stderr, "Invalid port '%s'\n", optarg);
+                Usage(argv[0]);
+            }
+        } else if (r == 'n') {
+            if (sscanf(optarg, "%u", &num_devices) != 1 || num_devices == 0) {
+                fprintf(stderr, "Invalid device count '%s'\n", optarg);
+                Usage(argv[0]);
+            }
+        } else if (r == 'c') {
+            if (sscanf(optarg, "%u", &num_clients) != 1 || num_clients == 0) {
+                fprintf(stderr, "Invalid client count '%s'\n", optarg);
+                Usage(argv[0]);
+            }
+        } else if (r == 't') {
+            if (sscanf(optarg, "%u", &duration) != 1 || duration == 0) {
+                fprintf(stderr, "Invalid time '%s'\n", optarg);
+                Usage(argv[0]);
+            }
+        } else if (r == 'r') {
+            if (sscanf(optarg, "%u", &update_rate) != 1) {
+                fprintf(stderr, "Invalid update rate '%s'\n", optarg);
+                Usage(argv[0]);
+            }
+        } else if (r == 'u') {
+            if (optarg[0] != '/') {
+                fprintf(stderr, "URLs must start with '/'\n");
+                Usage(argv[0]);
+            }
+            urls.push_back(optarg);
+        } else if (r == 's') {
+            if (sscanf(optarg, "%u", &serialize_threads) != 1 || 
+                    serialize_threads == 0) {
+                fprintf(stderr, "Invalid serialize thread count '%s'\n", optarg);
+                Usage(argv[0]);
+            }
+        } else if (r == 'z') {
+            gzip = true;
+        } else {
+            Usage(argv[0]);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    globalreg = new GlobalRegistry;
+
+    globalreg->version_major = VERSION_MAJOR;
+    globalreg->version_minor = VERSION_MINOR;
+    globalreg->version_tiny = VERSION_TINY;
+    globalreg->revision = REVISION;
+    globalreg->revdate = REVDATE;
+
+    globalreg->argc = argc;
+    globalreg->argv = argv;
+    globalreg->envp = envp;
+
+    MessageBus::create_messagebus(globalreg);
+    globalreg->messagebus->RegisterClient(new BenchMessageClient(globalreg, NULL),
+            MSGFLAG_FATAL | MSGFLAG_ERROR);
+
+    ConfigFile *conf = new ConfigFile(globalreg);
+
+    if (configfilename != NULL && conf->ParseConfig(configfilename) < 0)
+        exit(1);
+
+    globalreg->kismet_config = conf;
+
+    // Always serve on loopback with our own login.  Without a config, run
+    // with the defaults minus the rate limits, so the clients measure the
+    // server and not the limiter.
+    conf->SetOpt("httpd_port", UIntToString(port), 0);
+    conf->SetOpt("httpd_bind_address", "127.0.0.1", 0);
+    conf->SetOpt("httpd_user", string(BENCH_USER) + ":" + string(BENCH_PASS), 0);
+    conf->SetOpt("httpd_session_db", "", 0);
+
+    if (configfilename == NULL) {
+        conf->SetOpt("httpd_rate_limit_light", "0,0", 0);
+        conf->SetOpt("httpd_rate_limit_heavy", "0,0", 0);
+        conf->SetOpt("httpd_heavy_concurrency", "0", 0);
+    }
+
+    if (serialize_threads != 0)
+        conf->SetOpt("tracker_serialize_threads", UIntToString(serialize_threads), 0);
+
+    Timetracker::create_timetracker(globalreg);
+    globalreg->timetracker->Tick();
+
+    // The default mix is what the web UI polls, plus the full device lists;
+    // the last-time request sees the devices being updated during the run
+    if (urls.size() == 0) {
+        urls.push_back("/system/status.json");
+        urls.push_back("/devices/all_devices.msgpack");
+        urls.push_back("/devices/all_devices.json");
+        urls.push_back("/devices/last-time/" + 
+                IntToString(globalreg->timestamp.tv_sec) + "/devices.json");
+        urls.push_back("/phy/all_phys.json");
+        urls.push_back("/messagebus/all_messages.json");
+        urls.push_back("/alerts/all_alerts.json");
+    }
+
+    Kis_Net_Httpd::create_httpd(globalreg);
+
+    if (globalreg->fatal_condition)
+        exit(1);
+
+    shared_ptr<EntryTracker> entrytracker =
+        EntryTracker::create_entrytracker(globalreg);
+
+    entrytracker->RegisterSerializer("msgpack", shared_ptr<TrackerElementSerializer>(new MsgpackAdapter::Serializer(globalreg)));
+    entrytracker->RegisterSerializer("json", shared_ptr<TrackerElementSerializer>(new JsonAdapter::Serializer(globalreg)));
+    entrytracker->RegisterSerializer("cmd", shared_ptr<TrackerElementSerializer>(new MsgpackAdapter::Serializer(globalreg)));
+    entrytracker->RegisterSerializer("jcmd", shared_ptr<TrackerElementSerializer>(new JsonAdapter::Serializer(globalreg)));
+
+    globalreg->servername = "Kismet-Bench";
+
+    shared_ptr<Packetchain> packetchain = Packetchain::create_packetchain(globalreg);
+
+    Kis_Httpd_Eventstream::create_eventstream(globalreg);
+    RestMessageClient::create_messageclient(globalreg);
+    Kis_Httpd_Websession::create_websession(globalreg);
+    Channeltracker_V2::create_channeltracker(globalreg);
+    Alertracker::create_alertracker(globalreg);
+
+    shared_ptr<Devicetracker> devicetracker =
+        Devicetracker::create_devicetracker(globalreg);
+
+    int phyid = devicetracker->RegisterPhyHandler(new Kis_RTL433_Phy(globalreg));
+
+    if (globalreg->fatal_condition)
+        exit(1);
+
+    Systemmonitor::create_systemmonitor(globalreg);
+
+    // Build the synthetic device set before the server takes requests
+    bool running = true;
+
+    bench_updater updater;
+    updater.devicetracker = devicetracker;
+    updater.packetchain = packetchain;
+    updater.pack_comp_common = packetchain->RegisterPacketComponent("COMMON");
+    updater.phyid = phyid;
+    updater.num_devices = num_devices;
+    updater.rate = update_rate;
+    updater.updates = 0;
+    updater.running = &running;
+
+    uint64_t build_start = bench_now_usec();
+
+    for (unsigned int x = 0; x < num_devices; x++)
+        bench_update_device(&updater, x);
+
+    devicetracker->BumpContentGeneration();
+
+    printf("Created %u devices in %.2f seconds\n", num_devices,
+            (bench_now_usec() - build_start) / 1000000.0f);
+
+    if (globalreg->httpd_server->StartHttpd() < 0 || globalreg->fatal_condition)
+        exit(1);
+
+    printf("Running %u clients for %u seconds against %lu endpoints, %u device "
+            "updates/sec%s\n", num_clients, duration, urls.size(), update_rate,
+            gzip ? ", gzip" : "");
+
+    local_locker_stats::contended = 0;
+    local_locker_stats::wait_usec = 0;
+    local_locker_stats::enabled = true;
+
+    vector<bench_worker *> workers;
+    string auth = Base64::encode(string(BENCH_USER) + ":" + string(BENCH_PASS));
+
+    uint64_t run_start = bench_now_usec();
+    uint64_t run_cpu_start = (uint64_t) clock() * 1000000 / CLOCKS_PER_SEC;
+
+    for (unsigned int x = 0; x < num_clients; x++) {
+        bench_worker *w = new bench_worker();
+
+        w->id = x;
+        w->port = port;
+        w->auth = auth;
+        w->gzip = gzip;
+        w->urls = &urls;
+        w->stats.resize(urls.size());
+        w->running = &running;
+
+        if (pthread_create(&(w->thread), NULL, bench_worker_thread, w) != 0) {
+            fprintf(stderr, "Failed to start client thread: %s\n",
+                    kis_strerror_r(errno).c_str());
+            exit(1);
+        }
+
+        workers.push_back(w);
+    }
+
+    if (update_rate > 0 &&
+            pthread_create(&(updater.thread), NULL, bench_updater_thread,
+                &updater) != 0) {
+        fprintf(stderr, "Failed to start update thread: %s\n",
+                kis_strerror_r(errno).c_str());
+        exit(1);
+    }
+
+    // Run the timers while the clients work; they drive the status updates,
+    // device event publishing, and long-poll timeouts
+    while (bench_now_usec() - run_start < (uint64_t) duration * 1000000) {
+        struct timeval tm;
+        tm.tv_sec = 0;
+        tm.tv_usec = 100000;
+        select(0, NULL, NULL, NULL, &tm);
+
+        globalreg->timetracker->Tick();
+
+        if (globalreg->fatal_condition)
+            exit(1);
+    }
+
+    running = false;
+
+    for (unsigned int x = 0; x < workers.size(); x++)
+        pthread_join(workers[x]->thread, NULL);
+
+    if (update_rate > 0)
+        pthread_join(updater.thread, NULL);
+
+    double elapsed = (bench_now_usec() - run_start) / 1000000.0f;
+    uint64_t run_cpu = (uint64_t) clock() * 1000000 / CLOCKS_PER_SEC - run_cpu_start;
+
+    local_locker_stats::enabled = false;
+
+    // Merge the per-worker results
+    vector<bench_url_stats> totals(urls.size());
+    bench_url_stats all;
+
+    for (unsigned int x = 0; x < workers.size(); x++) {
+        for (unsigned int u = 0; u < urls.size(); u++) {
+            bench_url_stats& s = workers[x]->stats[u];
+
+            totals[u].latency_usec.insert(totals[u].latency_usec.end(),
+                    s.latency_usec.begin(), s.latency_usec.end());
+            totals[u].errors += s.errors;
+            totals[u].bytes += s.bytes;
+
+            for (map<int, uint64_t>::iterator ci = s.codes.begin();
+                    ci != s.codes.end(); ++ci)
+                totals[u].codes[ci->first] += ci->second;
+        }
+    }
+
+    printf("\n%-40s %8s %9s %9s %9s %9s %10s\n", "endpoint", "reqs", "req/s",
+            "p50 ms", "p99 ms", "max ms", "avg bytes");
+
+    char p50[32], p99[32], pmax[32];
+
+    for (unsigned int u = 0; u < urls.size(); u++) {
+        bench_url_stats& s = totals[u];
+
+        std::sort(s.latency_usec.begin(), s.latency_usec.end());
+
+        bench_percentile(s.latency_usec, 0.50, p50, sizeof(p50));
+        bench_percentile(s.latency_usec, 0.99, p99, sizeof(p99));
+        bench_percentile(s.latency_usec, 1.0, pmax, sizeof(pmax));
+
+        size_t n = s.latency_usec.size();
+
+        printf("%-40s %8lu %9.1f %9s %9s %9s %10lu\n", urls[u].c_str(), n,
+                n / elapsed, p50, p99, pmax, n ? s.bytes / n : 0);
+
+        all.latency_usec.insert(all.latency_usec.end(),
+                s.latency_usec.begin(), s.latency_usec.end());
+        all.errors += s.errors;
+        all.bytes += s.bytes;
+
+        for (map<int, uint64_t>::iterator ci = s.codes.begin();
+                ci != s.codes.end(); ++ci)
+            all.codes[ci->first] += ci->second;
+    }
+
+    std::sort(all.latency_usec.begin(), all.latency_usec.end());
+
+    bench_percentile(all.latency_usec, 0.50, p50, sizeof(p50));
+    bench_percentile(all.latency_usec, 0.99, p99, sizeof(p99));
+    bench_percentile(all.latency_usec, 1.0, pmax, sizeof(pmax));
+
+    size_t total = all.latency_usec.size();
+
+    printf("%-40s %8lu %9.1f %9s %9s %9s %10lu\n", "total", total, total / elapsed,
+            p50, p99, pmax, total ? all.bytes / total : 0);
+
+    printf("\nResponses:");
+    for (map<int, uint64_t>::iterator ci = all.codes.begin();
+            ci != all.codes.end(); ++ci)
+        printf(" %d: %lu", ci->first, ci->second);
+    printf(", connection errors: %lu\n", all.errors);
+
+    printf("Throughput: %.1f req/s, %.2f MB/s\n", total / elapsed,
+            all.bytes / elapsed / (1024 * 1024));
+
+    // Server side time, as accounted by the webserver
+    vector<Kis_Net_Httpd_Client> clients;
+    globalreg->httpd_server->GetClientStats(clients);
+
+    uint64_t server_cpu = 0;
+    for (unsigned int x = 0; x < clients.size(); x++)
+        server_cpu += clients[x].cpu_usec;
+
+    printf("Server CPU: %.3f ms/request in handlers, %.1f%% of one core for the "
+            "whole process\n", total ? server_cpu / 1000.0f / total : 0,
+            run_cpu / 10000.0f / elapsed);
+
+    printf("Lock wait: %lu contended acquisitions, %.3f ms total, %.3f ms/request\n",
+            (unsigned long) local_locker_stats::contended,
+            local_locker_stats::wait_usec / 1000.0f,
+            total ? local_locker_stats::wait_usec / 1000.0f / total : 0);
+
+    if (update_rate > 0)
+        printf("Device updates: %.1f/s\n", updater.updates / elapsed);
+
+    // The webserver can't be cleanly torn down while connections may still be
+    // closing, the same as the server; just exit
+    exit(0);
+}
+
@@ -66,6 +66,7 @@
 #include "packetsource_wext.h"
 #include "packetsource_ipwlive.h"
 #include "packetsource_airpcap.h"
+#include "packetsource_tpacket.h"
 #include "packetsourcetracker.h"
 
 #include "kis_datasource.h"
@@ -81,6 +82,7 @@
 #include "system_monitor.h"
 #include "channeltracker2.h"
 #include "kis_httpd_websession.h"
+#include "kis_httpd_eventstream.h"
 #include "messagebus_restclient.h"
 
 #include "gps_manager.h"
@@ -928,6 +930,9 @@ int main(int argc, char *argv[], char *envp[]) {
     _MSG("Creating packet chain...", MSGFLAG_INFO);
     Packetchain::create_packetchain(globalregistry);
 
+    // Add the event push channel before anything which publishes to it
+    Kis_Httpd_Eventstream::create_eventstream(globalregistry);
+
     // Add the messagebus REST interface
     RestMessageClient::create_messageclient(globalregistry);
 
@@ -1045,6 +1050,10 @@ int main(int argc, char *argv[], char *envp[]) {
     if (globalregistry->sourcetracker->RegisterPacketSource(new PacketSource_AirPcap(globalregistry)) < 0 || globalregistry->fatal_condition) 
         CatchShutdown(-1);
 #endif
+#ifdef USE_PACKETSOURCE_TPACKET
+    if (globalregistry->sourcetracker->RegisterPacketSource(new PacketSource_Tpacket(globalregistry)) < 0 || globalregistry->fatal_condition) 
+        CatchShutdown(-1);
+#endif
 
     // Start the plugin handler
     if (plugins) {
@@ -25,6 +25,7 @@
 
 #include "json_adapter.h"
 #include "msgpack_adapter.h"
+#include "kis_httpd_eventstream.h"
 
 RestMessageClient::RestMessageClient(GlobalRegistry *in_globalreg, void *in_aux) :
     MessageClient(in_globalreg, in_aux),
@@ -48,7 +49,13 @@ RestMessageClient::RestMessageClient(GlobalRegistry *in_globalreg, void *in_aux)
 
     pthread_mutex_init(&msg_mutex, NULL);
 
+    eventstream =
+        static_pointer_cast<Kis_Httpd_Eventstream>(globalreg->FetchGlobal("HTTPD_EVENTSTREAM"));
+
 	globalreg->messagebus->RegisterClient(this, MSGFLAG_ALL);
+
+    Httpd_RegisterRoute("GET", "/messagebus/all_messages.*");
+    Httpd_RegisterRoute("GET", "/messagebus/last-time/:ts/messages.*");
 }
 
 RestMessageClient::~RestMessageClient() {
@@ -79,6 +86,13 @@ void RestMessageClient::ProcessMessage(string in_msg, int in_flags) {
             message_vec.erase(message_vec.begin());
         }
     }
+
+    if (eventstream != NULL && 
+            eventstream->HasSubscribers(KIS_EVENTSTREAM_TOPIC_MESSAGE))
+        eventstream->Publish(KIS_EVENTSTREAM_TOPIC_MESSAGE, msg);
+
+    if (httpd != NULL)
+        httpd->NotifyLongPoll("messages");
 }
 
 bool RestMessageClient::Httpd_VerifyPath(const char *path, const char *method) {
@@ -112,6 +126,34 @@ bool RestMessageClient::Httpd_VerifyPath(const char *path, const char *method) {
     return false;
 }
 
+string RestMessageClient::Httpd_LongPollTopic(const char *url, const char *method) {
+    if (strcmp(method, "GET") != 0)
+        return "";
+
+    vector<string> tokenurl = StrTokenize(url, "/");
+
+    if (tokenurl.size() == 5 && tokenurl[1] == "messagebus" && 
+            tokenurl[2] == "last-time")
+        return "messages";
+
+    return "";
+}
+
+bool RestMessageClient::Httpd_LongPollReady(const char *url) {
+    vector<string> tokenurl = StrTokenize(url, "/");
+
+    long lastts;
+    if (tokenurl.size() < 4 || sscanf(tokenurl[3].c_str(), "%ld", &lastts) != 1)
+        return true;
+
+    local_locker lock(&msg_mutex);
+
+    if (message_vec.size() == 0)
+        return false;
+
+    return message_vec[message_vec.size() - 1]->get_timestamp() > lastts;
+}
+
 void RestMessageClient::Httpd_CreateStreamResponse(
         Kis_Net_Httpd *httpd __attribute__((unused)),
         Kis_Net_Httpd_Connection *connection __attribute__((unused)),
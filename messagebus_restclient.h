@@ -89,6 +89,8 @@ protected:
     int timestamp_id;
 };
 
+class Kis_Httpd_Eventstream;
+
 class RestMessageClient : public MessageClient, public Kis_Net_Httpd_Stream_Handler,
     public LifetimeGlobal {
 public:
@@ -114,11 +116,18 @@ public:
             const char *url, const char *method, const char *upload_data,
             size_t *upload_data_size, std::stringstream &stream);
 
+    // Requests for messages since a timestamp can wait for a new message
+    virtual string Httpd_LongPollTopic(const char *url, const char *method);
+    virtual bool Httpd_LongPollReady(const char *url);
+
 protected:
     pthread_mutex_t msg_mutex;
 
     std::vector<shared_ptr<tracked_message> > message_vec;
 
+    // Messages are pushed to event stream subscribers as they arrive
+    shared_ptr<Kis_Httpd_Eventstream> eventstream;
+
     int message_vec_id, message_entry_id, message_timestamp_id;
 };
 
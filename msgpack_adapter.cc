@@ -35,9 +35,79 @@
 #include "devicetracker_component.h"
 #include "msgpack_adapter.h"
 
+// Emit the values of a vector whose elements all share a single numeric type.
+// Each element still goes out as a [type, value] pair, but the pair header is
+// written as raw bytes and the value type is resolved once for the vector.
+template<typename T>
+static void pack_vector_values(TrackerElement::tracked_vector *tvec, TrackerType in_type,
+        MsgpackAdapter::MsgpackBuffer &buffer, msgpack::packer<MsgpackAdapter::MsgpackBuffer> &o) {
+    // fixarray(2) followed by the type as a positive fixint
+    const char header[2] = { (char) 0x92, (char) in_type };
+
+    for (unsigned int x = 0; x < tvec->size(); x++) {
+        (*tvec)[x]->pre_serialize();
+
+        buffer.write(header, 2);
+        o.pack(GetTrackerValue<T>((*tvec)[x]));
+    }
+}
+
+// Pack homogeneous vectors of numbers, such as RRD buckets, in bulk.  Returns
+// false if the vector needs to be packed element by element.
+static bool pack_homogeneous_vector(TrackerElement::tracked_vector *tvec,
+        MsgpackAdapter::MsgpackBuffer &buffer, msgpack::packer<MsgpackAdapter::MsgpackBuffer> &o) {
+    if (tvec->size() == 0 || (*tvec)[0] == NULL)
+        return false;
+
+    TrackerType vtype = (*tvec)[0]->get_type();
+
+    for (unsigned int x = 1; x < tvec->size(); x++) {
+        if ((*tvec)[x] == NULL || (*tvec)[x]->get_type() != vtype)
+            return false;
+    }
+
+    switch (vtype) {
+        case TrackerInt8:
+            pack_vector_values<int8_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerUInt8:
+            pack_vector_values<uint8_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerInt16:
+            pack_vector_values<int16_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerUInt16:
+            pack_vector_values<uint16_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerInt32:
+            pack_vector_values<int32_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerUInt32:
+            pack_vector_values<uint32_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerInt64:
+            pack_vector_values<int64_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerUInt64:
+            pack_vector_values<uint64_t>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerFloat:
+            pack_vector_values<float>(tvec, vtype, buffer, o);
+            return true;
+        case TrackerDouble:
+            pack_vector_values<double>(tvec, vtype, buffer, o);
+            return true;
+        default:
+            return false;
+    }
+}
+
 void MsgpackAdapter::Packer(GlobalRegistry *globalreg, SharedTrackerElement v,
-        msgpack::packer<std::stringstream> &o,
-        TrackerElementSerializer::rename_map *name_map) {
+        MsgpackBuffer &buffer,
+        TrackerElementSerializer::rename_map *name_map,
+        uint64_t since) {
+
+    msgpack::packer<MsgpackBuffer> o(buffer);
 
     if (v == NULL) {
         o.pack_array(2);
@@ -85,6 +155,9 @@ void MsgpackAdapter::Packer(GlobalRegistry *globalreg, SharedTrackerElement v,
     shared_ptr<uint8_t> bytes;
     size_t sz;
 
+    // Number of map entries which survive delta filtering
+    size_t nentries;
+
     switch (v->get_type()) {
         case TrackerString:
             o.pack(GetTrackerValue<string>(v));
@@ -133,15 +206,33 @@ void MsgpackAdapter::Packer(GlobalRegistry *globalreg, SharedTrackerElement v,
             tvec = v->get_vector();
 
             o.pack_array(v->size());
+
+            // Elements may need path-specific handling when renamed
+            if (name_map == NULL && pack_homogeneous_vector(tvec, buffer, o))
+                break;
+
             for (x = 0; x < tvec->size(); x++) {
-                Packer(globalreg, (*tvec)[x], o, name_map);
+                Packer(globalreg, (*tvec)[x], buffer, name_map, since);
             }
 
             break;
         case TrackerMap:
             tmap = v->get_map();
-            o.pack_map(tmap->size());
+            if (since == 0) {
+                nentries = tmap->size();
+            } else {
+                nentries = 0;
+                for (map_iter = tmap->begin(); map_iter != tmap->end(); 
+                        ++map_iter) {
+                    if (!TrackerElementSerializer::delta_skip(map_iter->second, since))
+                        nentries++;
+                }
+            }
+            o.pack_map(nentries);
             for (map_iter = tmap->begin(); map_iter != tmap->end(); ++map_iter) {
+                if (TrackerElementSerializer::delta_skip(map_iter->second, since))
+                    continue;
+
                 TrackerElementSerializer::rename_map::iterator nmi;
                 if (name_map != NULL &&
                         (nmi = name_map->find(map_iter->second)) != name_map->end() &&
@@ -149,55 +240,113 @@ void MsgpackAdapter::Packer(GlobalRegistry *globalreg, SharedTrackerElement v,
                     o.pack(nmi->second->rename);
                 } else {
                     string tname;
+                    const TrackerFieldToken *token;
                     if (map_iter->second != NULL &&
                             (tname = map_iter->second->get_local_name()) != "")
                         o.pack(tname);
+                    else if ((token = 
+                                globalreg->entrytracker->GetFieldToken(map_iter->first)) != NULL)
+                        // The token is already a complete msgpack str
+                        o.pack_str_body(token->msgpack_key.data(), 
+                                token->msgpack_key.length());
                     else
                         o.pack(globalreg->entrytracker->GetFieldName(map_iter->first));
                 }
 
-                Packer(globalreg, map_iter->second, o, name_map);
+                Packer(globalreg, map_iter->second, buffer, name_map, since);
             }
             break;
         case TrackerIntMap:
             tintmap = v->get_intmap();
-            o.pack_map(tintmap->size());
+            if (since == 0) {
+                nentries = tintmap->size();
+            } else {
+                nentries = 0;
+                for (int_map_iter = tintmap->begin(); int_map_iter != tintmap->end(); 
+                        ++int_map_iter) {
+                    if (!TrackerElementSerializer::delta_skip(int_map_iter->second, since))
+                        nentries++;
+                }
+            }
+            o.pack_map(nentries);
             for (int_map_iter = tintmap->begin(); int_map_iter != tintmap->end(); 
                     ++int_map_iter) {
+                if (TrackerElementSerializer::delta_skip(int_map_iter->second, since))
+                    continue;
+
                 o.pack(int_map_iter->first);
-                Packer(globalreg, int_map_iter->second, o, name_map);
+                Packer(globalreg, int_map_iter->second, buffer, name_map, since);
             }
             break;
         case TrackerMacMap:
             tmacmap = v->get_macmap();
-            o.pack_map(tmacmap->size());
+            if (since == 0) {
+                nentries = tmacmap->size();
+            } else {
+                nentries = 0;
+                for (mac_map_iter = tmacmap->begin(); mac_map_iter != tmacmap->end(); 
+                        ++mac_map_iter) {
+                    if (!TrackerElementSerializer::delta_skip(mac_map_iter->second, since))
+                        nentries++;
+                }
+            }
+            o.pack_map(nentries);
             for (mac_map_iter = tmacmap->begin(); 
                     mac_map_iter != tmacmap->end();
                     ++mac_map_iter) {
+                if (TrackerElementSerializer::delta_skip(mac_map_iter->second, since))
+                    continue;
+
                 // Macmaps need to go out as just the mac string,
                 // not a vector of mac+mask
                 o.pack(mac_map_iter->first.MacFull2String());
-                Packer(globalreg, mac_map_iter->second, o, name_map);
+                Packer(globalreg, mac_map_iter->second, buffer, name_map, since);
             }
             break;
         case TrackerStringMap:
             tstringmap = v->get_stringmap();
-            o.pack_map(tstringmap->size());
+            if (since == 0) {
+                nentries = tstringmap->size();
+            } else {
+                nentries = 0;
+                for (string_map_iter = tstringmap->begin(); string_map_iter != tstringmap->end(); 
+                        ++string_map_iter) {
+                    if (!TrackerElementSerializer::delta_skip(string_map_iter->second, since))
+                        nentries++;
+                }
+            }
+            o.pack_map(nentries);
             for (string_map_iter = tstringmap->begin();
                     string_map_iter != tstringmap->end();
                     ++string_map_iter) {
+                if (TrackerElementSerializer::delta_skip(string_map_iter->second, since))
+                    continue;
+
                 o.pack(string_map_iter->first);
-                Packer(globalreg, string_map_iter->second, o, name_map);
+                Packer(globalreg, string_map_iter->second, buffer, name_map, since);
             }
             break;
         case TrackerDoubleMap:
             tdoublemap = v->get_doublemap();
-            o.pack_map(tdoublemap->size());
+            if (since == 0) {
+                nentries = tdoublemap->size();
+            } else {
+                nentries = 0;
+                for (double_map_iter = tdoublemap->begin(); double_map_iter != tdoublemap->end(); 
+                        ++double_map_iter) {
+                    if (!TrackerElementSerializer::delta_skip(double_map_iter->second, since))
+                        nentries++;
+                }
+            }
+            o.pack_map(nentries);
             for (double_map_iter = tdoublemap->begin();
                     double_map_iter != tdoublemap->end();
                     ++double_map_iter) {
+                if (TrackerElementSerializer::delta_skip(double_map_iter->second, since))
+                    continue;
+
                 o.pack(double_map_iter->first);
-                Packer(globalreg, double_map_iter->second, o, name_map);
+                Packer(globalreg, double_map_iter->second, buffer, name_map, since);
             }
             break;
         case TrackerByteArray:
@@ -214,10 +363,18 @@ void MsgpackAdapter::Packer(GlobalRegistry *globalreg, SharedTrackerElement v,
     }
 }
 
+void MsgpackAdapter::Pack(GlobalRegistry *globalreg, MsgpackBuffer &buffer,
+        SharedTrackerElement e, TrackerElementSerializer::rename_map *name_map,
+        uint64_t since) {
+    Packer(globalreg, e, buffer, name_map, since);
+}
+
 void MsgpackAdapter::Pack(GlobalRegistry *globalreg, std::stringstream &stream,
-        SharedTrackerElement e, TrackerElementSerializer::rename_map *name_map) {
-    msgpack::packer<std::stringstream> packer(&stream);
-    Packer(globalreg, e, packer, name_map);
+        SharedTrackerElement e, TrackerElementSerializer::rename_map *name_map,
+        uint64_t since) {
+    MsgpackBuffer buffer;
+    Packer(globalreg, e, buffer, name_map, since);
+    stream.write(buffer.str().data(), buffer.str().length());
 }
 
 void MsgpackAdapter::AsStringVector(msgpack::object &obj, 
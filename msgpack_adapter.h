@@ -38,13 +38,54 @@ namespace MsgpackAdapter {
 
 typedef map<string, msgpack::object> MsgpackStrMap;
 
+// Contiguous output buffer for msgpack encoding.  It satisfies the stream 
+// interface of msgpack::packer, so encoded values are appended directly
+// instead of going through stringstream writes, and can be re-used across
+// multiple elements.
+class MsgpackBuffer {
+public:
+    MsgpackBuffer() : buffer(own_buffer) {
+        buffer.reserve(4096);
+    }
+
+    // Append to the caller's string instead, such as the chunk handed to a
+    // streaming response
+    MsgpackBuffer(string &in_target) : buffer(in_target) { }
+
+    void write(const char *in_data, size_t in_len) {
+        buffer.append(in_data, in_len);
+    }
+
+    const string &str() {
+        return buffer;
+    }
+
+    void clear() {
+        buffer.clear();
+    }
+
+protected:
+    string own_buffer;
+    string &buffer;
+};
+
 void Packer(GlobalRegistry *globalreg, SharedTrackerElement v, 
-        msgpack::packer<std::stringstream> &packer,
-        TrackerElementSerializer::rename_map *name_map = NULL);
+        MsgpackBuffer &buffer,
+        TrackerElementSerializer::rename_map *name_map = NULL,
+        uint64_t since = 0);
+
+// Pack an element onto the end of an existing buffer
+void Pack(GlobalRegistry *globalreg, MsgpackBuffer &buffer, 
+        SharedTrackerElement e, 
+        TrackerElementSerializer::rename_map *name_map = NULL,
+        uint64_t since = 0);
 
+// Pack an element as msgpack.  When since is non-zero, keyed maps only include
+// children modified at or after that generation
 void Pack(GlobalRegistry *globalreg, std::stringstream &stream, 
         SharedTrackerElement e, 
-        TrackerElementSerializer::rename_map *name_map = NULL);
+        TrackerElementSerializer::rename_map *name_map = NULL,
+        uint64_t since = 0);
 
 class Serializer : public TrackerElementSerializer {
 public:
@@ -55,6 +96,30 @@ public:
             rename_map *name_map = NULL) {
         Pack(globalreg, stream, in_elem, name_map);
     }
+
+    virtual void serialize_delta(SharedTrackerElement in_elem, std::stringstream &stream,
+            uint64_t since, rename_map *name_map = NULL) {
+        Pack(globalreg, stream, in_elem, name_map, since);
+    }
+
+    // msgpack arrays are length-prefixed, so the whole frame is written up front
+    virtual bool can_stream_vector() {
+        return true;
+    }
+
+    virtual void stream_serialize(SharedTrackerElement in_elem, string &out,
+            rename_map *name_map = NULL) {
+        MsgpackBuffer buffer(out);
+        Pack(globalreg, buffer, in_elem, name_map);
+    }
+
+    virtual void stream_vector_open(string &out, size_t in_size) {
+        MsgpackBuffer buffer(out);
+        msgpack::packer<MsgpackBuffer> o(buffer);
+        o.pack_array(2);
+        o.pack((int) TrackerVector);
+        o.pack_array(in_size);
+    }
 };
 
 // Convert to std::vector<std::string>.  MAY THROW EXCEPTIONS.
@@ -243,12 +243,74 @@ void PacketSource_Pcap::Pcap_Callback(u_char *bp, const struct pcap_pkthdr *head
 	memcpy(callback_data, in_data, kismin(header->len, MAX_PACKET_LEN));
 }
 
+void PacketSource_Pcap::ParseDispatchOptions(vector<opt_pair> *in_opts) {
+	dispatch_count = PCAP_DISPATCH_DEFAULT;
+	dispatch_budget = PCAP_DISPATCH_BUDGET_DEFAULT;
+	dispatch_frames = 0;
+
+	// The capture helper has no config of its own
+	if (globalreg->kismet_config != NULL) {
+		dispatch_count = 
+			globalreg->kismet_config->FetchOptUInt("pcap_dispatch", 
+												   PCAP_DISPATCH_DEFAULT);
+		dispatch_budget = 
+			globalreg->kismet_config->FetchOptUInt("pcap_dispatch_budget",
+												   PCAP_DISPATCH_BUDGET_DEFAULT);
+	}
+
+	string opt = FetchOpt("dispatch", in_opts);
+
+	if (opt != "" && sscanf(opt.c_str(), "%u", &dispatch_count) != 1) {
+		_MSG("Invalid dispatch= on source '" + interface + "', expected a number "
+			 "of frames", MSGFLAG_ERROR);
+		dispatch_count = PCAP_DISPATCH_DEFAULT;
+	}
+
+	if (dispatch_count == 0)
+		dispatch_count = 1;
+}
+
+void PacketSource_Pcap::Pcap_Dispatch_Callback(u_char *bp, 
+											   const struct pcap_pkthdr *header,
+											   const u_char *in_data) {
+	PacketSource_Pcap *source = (PacketSource_Pcap *) bp;
+
+	source->ProcessFrame(header, in_data);
+	source->dispatch_frames++;
+
+	// Checking the clock on every frame would cost more than it saves
+	if (source->dispatch_budget == 0 || (source->dispatch_frames % 8) != 0)
+		return;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	if ((unsigned int) ((now.tv_sec - source->dispatch_start.tv_sec) * 1000000 +
+				(now.tv_usec - source->dispatch_start.tv_usec)) >= 
+			source->dispatch_budget)
+		pcap_breakloop(source->pd);
+}
+
 int PacketSource_Pcap::Poll() {
 	int ret;
 	char errstr[STATUS_MAX] = "";
 
-	// Get data from the pcap callbacks
-	if ((ret = pcap_dispatch(pd, 1, PacketSource_Pcap::Pcap_Callback, NULL)) < 0) {
+	dispatch_frames = 0;
+
+	if (dispatch_budget != 0)
+		gettimeofday(&dispatch_start, NULL);
+
+	// Drain up to a batch of frames; the descriptor is non-blocking, so this
+	// returns as soon as the kernel has nothing more queued
+	ret = pcap_dispatch(pd, dispatch_count, PacketSource_Pcap::Pcap_Dispatch_Callback, 
+						(u_char *) this);
+
+	// Out of budget; the rest will be read on the next pass of the main loop
+	// once the other sources have had their turn
+	if (ret == PCAP_ERROR_BREAK)
+		ret = dispatch_frames;
+
+	if (ret < 0) {
 		// If we failed to dispatch a packet collection, find out if the interface
 		// got downed and give a smarter error message
 #ifdef SYS_LINUX
@@ -277,24 +339,31 @@ int PacketSource_Pcap::Poll() {
 	if (ret == 0)
 		return 0;
 
+	return 1;
+}
+
+void PacketSource_Pcap::ProcessFrame(const struct pcap_pkthdr *header, 
+									 const u_char *in_data, bool in_copy) {
 	if (paused)
-		return 0;
+		return;
 
 	// Genesis a new packet, fill it in with the radio layer info if we have it,
 	// and inject it into the system
 	kis_packet *newpack = globalreg->packetchain->GeneratePacket();
 
-	// Get the timestamp from the pcap callback
-	newpack->ts.tv_sec = callback_header.ts.tv_sec;
-	newpack->ts.tv_usec = callback_header.ts.tv_usec;
+	// Get the timestamp from the pcap header
+	newpack->ts.tv_sec = header->ts.tv_sec;
+	newpack->ts.tv_usec = header->ts.tv_usec;
 
-	// Add the link-layer raw data to the packet, for the pristine copy
+	// Add the link-layer raw data to the packet, for the pristine copy.  The
+	// pcap buffer is only valid during the callback, so it's copied unless
+	// the caller owns the buffer for the life of the packet.
 	kis_datachunk *linkchunk = new kis_datachunk;
 	linkchunk->dlt = datalink_type;
 	linkchunk->source_id = source_id;
 
-	linkchunk->set_data(callback_data, kismin(callback_header.caplen, 
-											  (uint32_t) MAX_PACKET_LEN), true);
+	linkchunk->set_data((uint8_t *) in_data, kismin(header->caplen, 
+											  (uint32_t) MAX_PACKET_LEN), in_copy);
 #if 0
 	linkchunk->data = 
 		new uint8_t[kismin(callback_header.caplen, (uint32_t) MAX_PACKET_LEN)];
@@ -320,8 +389,6 @@ int PacketSource_Pcap::Poll() {
 
 	// Packetchain destroys the packet at the end of processing, so we're done
 	// with it here
-
-	return 1;
 }
 
 int PacketSource_Pcap::ManglePacket(kis_packet *packet, kis_datachunk *linkchunk) {
@@ -92,6 +92,17 @@ extern "C" {
 #define IEEE80211_IOC_CHANNEL 0
 #endif
 
+#ifndef PCAP_ERROR_BREAK
+#define PCAP_ERROR_BREAK	-2
+#endif
+
+// Most frames read from a source each time it's readable, and the longest it
+// may spend on them in usec, so that a busy source can't starve the others.
+// Overridden by pcap_dispatch and pcap_dispatch_budget in kismet.conf, and
+// dispatch= on a source.
+#define PCAP_DISPATCH_DEFAULT		64
+#define PCAP_DISPATCH_BUDGET_DEFAULT	5000
+
 class PacketSource_Pcap : public KisPacketSource {
 public:
 	PacketSource_Pcap() {
@@ -116,6 +127,8 @@ public:
 		KisPacketSource(in_globalreg, in_interface, in_opts) { 
 			pd = NULL;
 			override_dlt = -1;
+
+			ParseDispatchOptions(in_opts);
 		}
 	virtual ~PacketSource_Pcap() { }
 
@@ -138,6 +151,11 @@ public:
 	static void Pcap_Callback(u_char *bp, const struct pcap_pkthdr *header,
 							  const u_char *in_data);
 
+	// Batched callback for Poll; bp is the source, and each frame is
+	// processed as it's handed to us instead of copied out one at a time
+	static void Pcap_Dispatch_Callback(u_char *bp, const struct pcap_pkthdr *header,
+									   const u_char *in_data);
+
 	virtual int FetchHardwareChannel();
 
 	// Mangle linkheaders off a frame, etc
@@ -151,9 +169,24 @@ protected:
 	// If we're just a straight up frame
 	int Eight2KisPack(kis_packet *packet, kis_datachunk *linkchunk);
 
+	void ParseDispatchOptions(vector<opt_pair> *in_opts);
+
+	// Build a packet from a captured frame and send it down the chain.  Without
+	// in_copy the packet references in_data directly, which must stay valid
+	// until the packetchain is done with it.
+	void ProcessFrame(const struct pcap_pkthdr *header, const u_char *in_data,
+					  bool in_copy = true);
+
 	pcap_t *pd;
 	int datalink_type;
 	int override_dlt;
+
+	unsigned int dispatch_count;
+	unsigned int dispatch_budget;
+
+	// State of the current batch
+	unsigned int dispatch_frames;
+	struct timeval dispatch_start;
 };	
 
 class PacketSource_Pcapfile : public PacketSource_Pcap {
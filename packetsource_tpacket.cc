@@ -0,0 +1,452 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
+
+#include "util.h"
+#include "messagebus.h"
+#include "configfile.h"
+#include "packetsourcetracker.h"
+#include "packetsource_tpacket.h"
+
+#ifdef USE_PACKETSOURCE_TPACKET
+
+#ifndef ARPHRD_IEEE80211
+#define ARPHRD_IEEE80211			801
+#endif
+#ifndef ARPHRD_IEEE80211_PRISM
+#define ARPHRD_IEEE80211_PRISM		802
+#endif
+#ifndef ARPHRD_IEEE80211_RADIOTAP
+#define ARPHRD_IEEE80211_RADIOTAP	803
+#endif
+
+PacketSource_Tpacket::PacketSource_Tpacket(GlobalRegistry *in_globalreg,
+										   string in_interface,
+										   vector<opt_pair> *in_opts) :
+	PacketSource_Pcap(in_globalreg, in_interface, in_opts) {
+
+	tpacket_fd = -1;
+	ring = NULL;
+	ring_len = 0;
+	ring_block = 0;
+
+	ParseOptions(in_opts);
+}
+
+PacketSource_Tpacket::~PacketSource_Tpacket() {
+	CloseSource();
+}
+
+int PacketSource_Tpacket::AutotypeProbe(string in_device) {
+	// Only used when asked for by type
+	return 0;
+}
+
+int PacketSource_Tpacket::RegisterSources(Packetsourcetracker *tracker) {
+	tracker->RegisterPacketProto("tpacket", this, "n/a", 1);
+	return 1;
+}
+
+int PacketSource_Tpacket::ParseOptions(vector<opt_pair> *in_opts) {
+	PacketSource_Pcap::ParseOptions(in_opts);
+
+	block_size = TPACKET_BLOCK_SIZE_DEFAULT;
+	block_count = TPACKET_BLOCK_COUNT_DEFAULT;
+	block_timeout = TPACKET_BLOCK_TIMEOUT_DEFAULT;
+	fanout_group = 0;
+	fanout_mode = PACKET_FANOUT_HASH;
+
+	// The capture helper has no config of its own
+	if (globalreg->kismet_config != NULL) {
+		block_size =
+			globalreg->kismet_config->FetchOptUInt("tpacket_block_size",
+												   TPACKET_BLOCK_SIZE_DEFAULT);
+		block_count =
+			globalreg->kismet_config->FetchOptUInt("tpacket_block_count",
+												   TPACKET_BLOCK_COUNT_DEFAULT);
+		block_timeout =
+			globalreg->kismet_config->FetchOptUInt("tpacket_block_timeout",
+												   TPACKET_BLOCK_TIMEOUT_DEFAULT);
+	}
+
+	string opt;
+
+	if ((opt = FetchOpt("blocksize", in_opts)) != "" &&
+		sscanf(opt.c_str(), "%u", &block_size) != 1) {
+		_MSG("Invalid blocksize= on source '" + interface + "', expected a "
+			 "size in KB", MSGFLAG_ERROR);
+		block_size = TPACKET_BLOCK_SIZE_DEFAULT;
+	}
+
+	if ((opt = FetchOpt("blocks", in_opts)) != "" &&
+		sscanf(opt.c_str(), "%u", &block_count) != 1) {
+		_MSG("Invalid blocks= on source '" + interface + "', expected a number "
+			 "of blocks", MSGFLAG_ERROR);
+		block_count = TPACKET_BLOCK_COUNT_DEFAULT;
+	}
+
+	// The kernel wants whole pages in a block, and room for at least one
+	// full-sized frame
+	unsigned int page_kb = getpagesize() / 1024;
+
+	if (page_kb == 0)
+		page_kb = 1;
+
+	if (block_size < page_kb || (block_size % page_kb) != 0 ||
+		block_size * 1024 < TPACKET_FRAME_SIZE) {
+		_MSG("Block size on tpacket source '" + interface + "' must be a multiple "
+			 "of the page size (" + UIntToString(page_kb) + "KB), using the "
+			 "default of " + UIntToString(TPACKET_BLOCK_SIZE_DEFAULT) + "KB",
+			 MSGFLAG_ERROR);
+		block_size = TPACKET_BLOCK_SIZE_DEFAULT;
+	}
+
+	if (block_count < 2) {
+		_MSG("Tpacket source '" + interface + "' needs at least 2 blocks so that "
+			 "the kernel can fill one while Kismet reads another", MSGFLAG_ERROR);
+		block_count = 2;
+	}
+
+	if ((opt = FetchOpt("fanout", in_opts)) != "") {
+		if (sscanf(opt.c_str(), "%u", &fanout_group) != 1 || fanout_group == 0 ||
+			fanout_group > 0xFFFF) {
+			_MSG("Invalid fanout= on source '" + interface + "', expected a group "
+				 "number from 1 to 65535", MSGFLAG_ERROR);
+			fanout_group = 0;
+		}
+	}
+
+	opt = StrLower(FetchOpt("fanoutmode", in_opts));
+
+	if (opt == "" || opt == "hash") {
+		fanout_mode = PACKET_FANOUT_HASH;
+	} else if (opt == "lb") {
+		fanout_mode = PACKET_FANOUT_LB;
+	} else if (opt == "cpu") {
+		fanout_mode = PACKET_FANOUT_CPU;
+	} else {
+		_MSG("Unknown fanoutmode= '" + opt + "' on source '" + interface + "', "
+			 "expected hash, lb, or cpu", MSGFLAG_ERROR);
+		fanout_mode = PACKET_FANOUT_HASH;
+	}
+
+	return 1;
+}
+
+int PacketSource_Tpacket::OpenSource() {
+	char errstr[STATUS_MAX] = "";
+	last_channel = 0;
+
+	// Open without a protocol so nothing is queued until we're bound to the
+	// right interface
+	if ((tpacket_fd = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+		snprintf(errstr, STATUS_MAX, "Failed to open AF_PACKET socket for "
+				 "tpacket source '%s': %s", interface.c_str(), strerror(errno));
+		_MSG(errstr, MSGFLAG_ERROR);
+		return 0;
+	}
+
+	int version = TPACKET_V3;
+	if (setsockopt(tpacket_fd, SOL_PACKET, PACKET_VERSION, &version,
+				   sizeof(version)) < 0) {
+		snprintf(errstr, STATUS_MAX, "Failed to enable TPACKET_V3 on tpacket "
+				 "source '%s', the kernel may be too old: %s", interface.c_str(),
+				 strerror(errno));
+		_MSG(errstr, MSGFLAG_ERROR);
+		CloseSource();
+		return 0;
+	}
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = block_size * 1024;
+	req.tp_block_nr = block_count;
+	req.tp_frame_size = TPACKET_FRAME_SIZE;
+	req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+	req.tp_retire_blk_tov = block_timeout;
+
+	if (setsockopt(tpacket_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		snprintf(errstr, STATUS_MAX, "Failed to create a %u x %uKB receive ring on "
+				 "tpacket source '%s': %s", block_count, block_size,
+				 interface.c_str(), strerror(errno));
+		_MSG(errstr, MSGFLAG_ERROR);
+		CloseSource();
+		return 0;
+	}
+
+	ring_len = (size_t) req.tp_block_size * req.tp_block_nr;
+	ring = (uint8_t *) mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+							tpacket_fd, 0);
+
+	if (ring == MAP_FAILED) {
+		ring = NULL;
+		snprintf(errstr, STATUS_MAX, "Failed to map the receive ring of tpacket "
+				 "source '%s': %s", interface.c_str(), strerror(errno));
+		_MSG(errstr, MSGFLAG_ERROR);
+		CloseSource();
+		return 0;
+	}
+
+	ring_block = 0;
+
+	struct sockaddr_ll sll;
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = if_nametoindex(interface.c_str());
+
+	if (sll.sll_ifindex == 0) {
+		snprintf(errstr, STATUS_MAX, "Failed to find interface '%s' for tpacket "
+				 "source: %s", interface.c_str(), strerror(errno));
+		_MSG(errstr, MSGFLAG_ERROR);
+		CloseSource();
+		return 0;
+	}
+
+	if (bind(tpacket_fd, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+		snprintf(errstr, STATUS_MAX, "Failed to bind tpacket source to '%s': %s",
+				 interface.c_str(), strerror(errno));
+		_MSG(errstr, MSGFLAG_ERROR);
+		CloseSource();
+		return 0;
+	}
+
+	// Same as pcap_open_live; the kernel drops the membership when we close
+	struct packet_mreq mr;
+	memset(&mr, 0, sizeof(mr));
+	mr.mr_ifindex = sll.sll_ifindex;
+	mr.mr_type = PACKET_MR_PROMISC;
+
+	if (setsockopt(tpacket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr,
+				   sizeof(mr)) < 0) {
+		snprintf(errstr, STATUS_MAX, "Failed to set tpacket source '%s' "
+				 "promiscuous, continuing anyhow: %s", interface.c_str(),
+				 strerror(errno));
+		_MSG(errstr, MSGFLAG_ERROR);
+	}
+
+	// Join the fanout group last, so the socket is complete before the kernel
+	// starts balancing frames to it
+	if (fanout_group != 0) {
+		int fanout = (int) (fanout_group | (fanout_mode << 16));
+
+		if (setsockopt(tpacket_fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+					   sizeof(fanout)) < 0) {
+			snprintf(errstr, STATUS_MAX, "Failed to join fanout group %u on "
+					 "tpacket source '%s'; every socket in a group must use the "
+					 "same mode: %s", fanout_group, interface.c_str(),
+					 strerror(errno));
+			_MSG(errstr, MSGFLAG_ERROR);
+			CloseSource();
+			return 0;
+		}
+	}
+
+	if (DatalinkType() < 0) {
+		CloseSource();
+		return -1;
+	}
+
+	error = 0;
+	paused = 0;
+	num_packets = 0;
+
+	_MSG("Tpacket source '" + interface + "' capturing with " +
+		 UIntToString(block_count) + " x " + UIntToString(block_size) +
+		 "KB ring blocks" +
+		 (fanout_group != 0 ? " in fanout group " + UIntToString(fanout_group) :
+		  string("")), MSGFLAG_INFO);
+
+	return 1;
+}
+
+int PacketSource_Tpacket::CloseSource() {
+	if (ring != NULL)
+		munmap(ring, ring_len);
+	ring = NULL;
+	ring_len = 0;
+
+	if (tpacket_fd >= 0)
+		close(tpacket_fd);
+	tpacket_fd = -1;
+
+	return 1;
+}
+
+int PacketSource_Tpacket::DatalinkType() {
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+
+	if (ioctl(tpacket_fd, SIOCGIFHWADDR, &ifr) < 0) {
+		_MSG("Failed to get the link type of tpacket source '" + interface +
+			 "': " + string(strerror(errno)), MSGFLAG_ERROR);
+		return -1;
+	}
+
+	switch (ifr.ifr_hwaddr.sa_family) {
+		case ARPHRD_IEEE80211_RADIOTAP:
+			datalink_type = DLT_IEEE802_11_RADIO;
+			break;
+		case ARPHRD_IEEE80211_PRISM:
+			datalink_type = DLT_PRISM_HEADER;
+			break;
+		case ARPHRD_IEEE80211:
+			datalink_type = DLT_IEEE802_11;
+			break;
+		case ARPHRD_ETHER:
+		case ARPHRD_LOOPBACK:
+			// Useful for exercising the capture path on a veth pair or lo,
+			// but nothing will decode as 802.11
+			datalink_type = DLT_EN10MB;
+			_MSG("Tpacket source '" + interface + "' is an ethernet device, not "
+				 "a monitor mode interface.  Frames will be captured, but not "
+				 "decoded as 802.11.", MSGFLAG_INFO);
+			break;
+		default:
+			datalink_type = ifr.ifr_hwaddr.sa_family;
+			_MSG("Unknown hardware type " + IntToString(datalink_type) + " on "
+				 "tpacket source '" + interface + "'.  Continuing on blindly and "
+				 "hoping we get something useful...", MSGFLAG_ERROR);
+			break;
+	}
+
+	return 1;
+}
+
+int PacketSource_Tpacket::FetchDescriptor() {
+	if (error)
+		return -1;
+
+	return tpacket_fd;
+}
+
+void PacketSource_Tpacket::ProcessBlock(struct tpacket_block_desc *in_block) {
+	struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) ((uint8_t *) in_block +
+			in_block->hdr.bh1.offset_to_first_pkt);
+	struct pcap_pkthdr pkthdr;
+
+	for (unsigned int x = 0; x < in_block->hdr.bh1.num_pkts; x++) {
+		pkthdr.ts.tv_sec = hdr->tp_sec;
+		pkthdr.ts.tv_usec = hdr->tp_nsec / 1000;
+		pkthdr.caplen = hdr->tp_snaplen;
+		pkthdr.len = hdr->tp_len;
+
+		// The block stays ours until we return it, and the packetchain is
+		// done with each packet before ProcessFrame returns, so the frame
+		// is referenced in place in the ring
+		ProcessFrame(&pkthdr, (uint8_t *) hdr + hdr->tp_mac, false);
+
+		hdr = (struct tpacket3_hdr *) ((uint8_t *) hdr + hdr->tp_next_offset);
+	}
+}
+
+int PacketSource_Tpacket::Poll() {
+	char errstr[STATUS_MAX] = "";
+	unsigned int blocks = 0;
+
+	if (tpacket_fd < 0 || ring == NULL)
+		return 0;
+
+	dispatch_frames = 0;
+
+	if (dispatch_budget != 0)
+		gettimeofday(&dispatch_start, NULL);
+
+	while (1) {
+		struct tpacket_block_desc *block =
+			(struct tpacket_block_desc *) (ring + ((size_t) ring_block *
+												   block_size * 1024));
+
+		if ((__atomic_load_n(&(block->hdr.bh1.block_status),
+							 __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+			break;
+
+		ProcessBlock(block);
+
+		dispatch_frames += block->hdr.bh1.num_pkts;
+		blocks++;
+
+		// Hand it back to the kernel, after we're done with every frame in it
+		__atomic_store_n(&(block->hdr.bh1.block_status), TP_STATUS_KERNEL,
+						 __ATOMIC_RELEASE);
+
+		ring_block = (ring_block + 1) % block_count;
+
+		// Whole blocks are read at a time; stop between them once we've used
+		// our share, the rest is read on the next pass of the main loop
+		if (dispatch_budget != 0) {
+			struct timeval now;
+			gettimeofday(&now, NULL);
+
+			if ((unsigned int) ((now.tv_sec - dispatch_start.tv_sec) * 1000000 +
+						(now.tv_usec - dispatch_start.tv_usec)) >= dispatch_budget)
+				break;
+		}
+	}
+
+	if (blocks != 0)
+		return 1;
+
+	// Readable with nothing in the ring; find out if the interface went away
+	int sockerr = 0;
+	socklen_t sockerr_len = sizeof(sockerr);
+
+	if (getsockopt(tpacket_fd, SOL_SOCKET, SO_ERROR, &sockerr, &sockerr_len) < 0)
+		sockerr = errno;
+
+	if (sockerr == 0)
+		return 0;
+
+	int flags = 0;
+	if (Ifconfig_Get_Flags(interface.c_str(), errstr, &flags) >= 0 &&
+		(flags & IFF_UP) == 0) {
+		snprintf(errstr, STATUS_MAX, "Failed to read a packet from %s.  The "
+				 "interface is no longer up.  Usually this happens when a DHCP "
+				 "client daemon is left running and times out, turning off the "
+				 "interface.  See the Kismet README troubleshooting section "
+				 "for more information.", interface.c_str());
+	} else {
+		snprintf(errstr, STATUS_MAX, "Reading packet from tpacket interface %s "
+				 "failed, interface is no longer available: %s", interface.c_str(),
+				 strerror(sockerr));
+	}
+
+	error = 1;
+	_MSG(errstr, MSGFLAG_ERROR);
+	CloseSource();
+	return 0;
+}
+
+#endif
+
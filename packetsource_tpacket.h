@@ -0,0 +1,134 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * tpacket captures directly from a Linux AF_PACKET socket with a TPACKET_V3
+ * receive ring instead of going through libpcap.  The kernel fills blocks of
+ * frames in a ring shared with us; each block is handed to the packetchain
+ * frame by frame without copying, and returned to the kernel once every frame
+ * in it has been processed.  One wakeup and no syscalls per block, instead of
+ * a read and a copy per frame.
+ *
+ * The source doesn't control the interface; it must already be in monitor
+ * mode (or be a wired interface, a veth pair or lo, for testing the capture
+ * path).
+ */
+
+#ifndef __PACKETSOURCE_TPACKET_H__
+#define __PACKETSOURCE_TPACKET_H__
+
+#include "config.h"
+
+#if (defined(HAVE_LIBPCAP) && defined(SYS_LINUX))
+
+#include <linux/if_packet.h>
+
+// TPACKET_V3 arrived in 3.2 kernel headers
+#ifdef TPACKET3_HDRLEN
+
+#include "packet.h"
+#include "packet_ieee80211.h"
+#include "packetsource.h"
+#include "packetsource_pcap.h"
+
+#define USE_PACKETSOURCE_TPACKET
+
+// Ring geometry.  Blocks are retired to us when they fill or when the timeout
+// (in ms) passes, so a quiet interface still delivers frames promptly.  Block
+// size (in KB) and count are overridden by tpacket_block_size and
+// tpacket_block_count in kismet.conf, and blocksize= and blocks= on a source.
+#define TPACKET_BLOCK_SIZE_DEFAULT		1024
+#define TPACKET_BLOCK_COUNT_DEFAULT		16
+#define TPACKET_BLOCK_TIMEOUT_DEFAULT	50
+#define TPACKET_FRAME_SIZE				2048
+
+class PacketSource_Tpacket : public PacketSource_Pcap {
+public:
+	// HANDLED PACKET SOURCES:
+	// tpacket
+	PacketSource_Tpacket() {
+		fprintf(stderr, "FATAL OOPS:  Packetsource_Tpacket() called\n");
+		exit(1);
+	}
+
+	PacketSource_Tpacket(GlobalRegistry *in_globalreg) :
+		PacketSource_Pcap(in_globalreg) {
+		tpacket_fd = -1;
+		ring = NULL;
+		ring_len = 0;
+	}
+
+	virtual KisPacketSource *CreateSource(GlobalRegistry *in_globalreg,
+										  string in_interface,
+										  vector<opt_pair> *in_opts) {
+		return new PacketSource_Tpacket(in_globalreg, in_interface, in_opts);
+	}
+
+	virtual int AutotypeProbe(string in_device);
+	virtual int RegisterSources(Packetsourcetracker *tracker);
+
+	PacketSource_Tpacket(GlobalRegistry *in_globalreg, string in_interface,
+						 vector<opt_pair> *in_opts);
+	virtual ~PacketSource_Tpacket();
+
+	virtual int ParseOptions(vector<opt_pair> *in_opts);
+
+	virtual int OpenSource();
+	virtual int CloseSource();
+	virtual int FetchDescriptor();
+	virtual int Poll();
+
+	// The interface is configured outside of Kismet
+	virtual int FetchChannelCapable() { return 0; }
+	virtual int EnableMonitor() { return 0; }
+	virtual int DisableMonitor() { return PACKSOURCE_UNMONITOR_RET_SILENCE; }
+	virtual int SetChannel(unsigned int in_ch) { return 0; }
+	virtual int FetchHardwareChannel() { return 0; }
+
+protected:
+	virtual void FetchRadioData(kis_packet *in_packet) { };
+
+	// Map the ARPHRD type of the bound interface to a DLT
+	virtual int DatalinkType();
+
+	// Hand every frame in a retired block to the packetchain
+	void ProcessBlock(struct tpacket_block_desc *in_block);
+
+	int tpacket_fd;
+
+	unsigned int block_size;
+	unsigned int block_count;
+	unsigned int block_timeout;
+
+	// Fanout group (0 for none) and PACKET_FANOUT_* balancing mode
+	unsigned int fanout_group;
+	unsigned int fanout_mode;
+
+	uint8_t *ring;
+	size_t ring_len;
+
+	// Next block we expect the kernel to hand us
+	unsigned int ring_block;
+};
+
+#endif /* TPACKET3_HDRLEN */
+
+#endif /* have_libpcap && sys_linux */
+
+#endif
+
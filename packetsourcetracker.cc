@@ -409,6 +409,10 @@ Packetsourcetracker::Packetsourcetracker(GlobalRegistry *in_globalreg) :
             entrytracker->RegisterField("kis.oldsource.source", old_builder,
                     "Old packetsource");
     }
+
+    Httpd_RegisterRoute("POST", "/packetsource/config/channel.cmd");
+    Httpd_RegisterRoute("POST", "/packetsource/config/add_source.cmd");
+    Httpd_RegisterRoute("GET", "/packetsource/all_sources.msgpack");
 }
 
 Packetsourcetracker::~Packetsourcetracker() {
@@ -421,6 +421,11 @@ Kis_80211_Phy::Kis_80211_Phy(GlobalRegistry *in_globalreg,
 	ssid_conf->ParseConfig(ssid_conf->ExpandLogPath(globalreg->kismet_config->FetchOpt("configdir") + "/" + "ssid_map.conf", "", "", 0, 1).c_str());
 	globalreg->InsertGlobal("SSID_CONF_FILE", shared_ptr<ConfigFile>(ssid_conf));
 
+    Httpd_RegisterRoute("POST", "/phy/phy80211/ssid_regex.cmd");
+    Httpd_RegisterRoute("POST", "/phy/phy80211/ssid_regex.jcmd");
+    Httpd_RegisterRoute("POST", "/phy/phy80211/probe_regex.cmd");
+    Httpd_RegisterRoute("POST", "/phy/phy80211/probe_regex.jcmd");
+    Httpd_RegisterRoute("GET", "/phy/phy80211/handshake/:mac/:file");
 }
 
 Kis_80211_Phy::~Kis_80211_Phy() {
@@ -1229,7 +1234,12 @@ int Kis_80211_Phy::TrackerDot11(kis_packet *in_pack) {
         ss << "Detected new 802.11 Wi-Fi device " << commoninfo->device.Mac2String();
         _MSG(ss.str(), MSGFLAG_INFO);
 
-        dot11dev.reset(new dot11_tracked_device(globalreg, dot11_device_entry_id));
+        {
+            // Keep the dot11 record in the same arena as the base device
+            TrackerArenaScope scope(basedev->get_arena());
+            dot11dev.reset(new dot11_tracked_device(globalreg, dot11_device_entry_id));
+        }
+
         dot11_tracked_device::attach_base_parent(dot11dev, basedev);
         // basedev->add_map(dot11dev);
     }
@@ -1725,6 +1735,14 @@ bool Kis_80211_Phy::Httpd_VerifyPath(const char *path, const char *method) {
     return false;
 }
 
+int Kis_80211_Phy::Httpd_RequestClass(const char *url, const char *method) {
+    if (strcmp(method, "POST") == 0 && 
+            strstr(url, "/phy/phy80211/") == url && strstr(url, "_regex.") != NULL)
+        return KIS_HTTPD_CLASS_HEAVY;
+
+    return KIS_HTTPD_CLASS_LIGHT;
+}
+
 void Kis_80211_Phy::GenerateHandshakePcap(shared_ptr<kis_tracked_device_base> dev, 
         std::stringstream &stream) {
     // We need to make a temp file and then use that to make the pcap log
@@ -1942,30 +1960,8 @@ int Kis_80211_Phy::Httpd_PostIterator(void *coninfo_cls, enum MHD_ValueKind kind
         if (structdata->hasKey("fields"))
             field_list = structdata->getStructuredByKey("fields");
 
-        if (field_list != NULL) {
-            StructuredData::structured_vec fvec = field_list->getStructuredArray();
-            for (StructuredData::structured_vec::iterator i = fvec.begin(); 
-                    i != fvec.end(); ++i) {
-                if ((*i)->isString()) {
-                    SharedElementSummary s(new TrackerElementSummary((*i)->getString(), 
-                                entrytracker));
-                    summary_vec.push_back(s);
-                } else if ((*i)->isArray()) {
-                    StructuredData::string_vec mapvec = (*i)->getStringVec();
-
-                    if (mapvec.size() != 2) {
-                        concls->response_stream << "Invalid request: "
-                            "Expected field, rename";
-                        concls->httpcode = 400;
-                        return 1;
-                    }
-
-                    SharedElementSummary s(new TrackerElementSummary(mapvec[0], 
-                                mapvec[1], entrytracker));
-                    summary_vec.push_back(s);
-                }
-            }
-        }
+        if (field_list != NULL)
+            entrytracker->CompileSummaryFields(field_list, summary_vec);
 
         // Make a worker instance
 
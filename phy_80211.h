@@ -403,7 +403,7 @@ public:
     __Proxy(ssid_beacon, uint8_t, bool, bool, ssid_beacon);
     __Proxy(ssid_probe_response, uint8_t, bool, bool, ssid_probe_response);
 
-    __Proxy(channel, string, string, string, channel);
+    __ProxyInterned(channel, channel);
 
     __Proxy(first_time, uint64_t, time_t, time_t, first_time);
     __Proxy(last_time, uint64_t, time_t, time_t, last_time);
@@ -1028,6 +1028,9 @@ public:
     // HTTPD API
     virtual bool Httpd_VerifyPath(const char *path, const char *method);
 
+    // Regex searches match against every device
+    virtual int Httpd_RequestClass(const char *url, const char *method);
+
     virtual void Httpd_CreateStreamResponse(Kis_Net_Httpd *httpd,
             Kis_Net_Httpd_Connection *connection,
             const char *url, const char *method, const char *upload_data,
@@ -59,6 +59,7 @@ Kis_RTL433_Phy::Kis_RTL433_Phy(GlobalRegistry *in_globalreg,
         entrytracker->RegisterField("rtl433.device.weatherstation",
                 weatherbuilder, "RTL433 weather station");
 
+    Httpd_RegisterRoute("POST", "/phy/phyRTL433/post_sensor_json.cmd");
 }
 
 Kis_RTL433_Phy::~Kis_RTL433_Phy() {
@@ -369,6 +370,96 @@ void Kis_RTL433_Phy::Httpd_CreateStreamResponse(Kis_Net_Httpd *httpd,
 }
 
 
+static bool rtl433_post_is_ndjson(Kis_Net_Httpd_Connection *concls) {
+    const char *ctype = 
+        MHD_lookup_connection_value(concls->connection, MHD_HEADER_KIND,
+                MHD_HTTP_HEADER_CONTENT_TYPE);
+
+    return ctype != NULL && strncasecmp(ctype, "application/x-ndjson", 20) == 0;
+}
+
+bool Kis_RTL433_Phy::Httpd_UseStreamingPost(Kis_Net_Httpd_Connection *concls) {
+    if (concls->url != "/phy/phyRTL433/post_sensor_json.cmd")
+        return false;
+
+    const char *ctype = 
+        MHD_lookup_connection_value(concls->connection, MHD_HEADER_KIND,
+                MHD_HTTP_HEADER_CONTENT_TYPE);
+
+    if (ctype == NULL)
+        return false;
+
+    return strncasecmp(ctype, "application/json", 16) == 0 ||
+        strncasecmp(ctype, "application/x-ndjson", 20) == 0;
+}
+
+void Kis_RTL433_Phy::Httpd_PostData(Kis_Net_Httpd_Connection *concls,
+        const char *data, size_t size) {
+
+    // Records are dropped without a login; the error is sent when the post
+    // completes
+    if (!httpd->HasValidSession(concls, false))
+        return;
+
+    // A plain JSON body is a single record which may span lines
+    if (!rtl433_post_is_ndjson(concls)) {
+        concls->post_remainder.append(data, size);
+        return;
+    }
+
+    // Handle each complete line as it arrives, keeping only a partial line
+    size_t start = 0;
+
+    for (size_t x = 0; x < size; x++) {
+        if (data[x] != '\n')
+            continue;
+
+        if (concls->post_remainder.length() != 0) {
+            concls->post_remainder.append(data + start, x - start);
+            post_json_record(concls, concls->post_remainder);
+            concls->post_remainder.clear();
+        } else {
+            post_json_record(concls, string(data + start, x - start));
+        }
+
+        start = x + 1;
+    }
+
+    if (start < size)
+        concls->post_remainder.append(data + start, size - start);
+}
+
+void Kis_RTL433_Phy::post_json_record(Kis_Net_Httpd_Connection *concls,
+        const string &in_record) {
+
+    if (in_record.find_first_not_of(" \t\r\n") == string::npos)
+        return;
+
+    struct JSON_value *json;
+    string err;
+
+    json = JSON_parse(in_record, err);
+
+    if (err.length() != 0 || json == NULL) {
+        if (concls->httpcode != 400) {
+            concls->response_stream << "Invalid request: could not parse JSON";
+            concls->httpcode = 400;
+        }
+
+        if (json != NULL)
+            JSON_delete(json);
+
+        return;
+    }
+
+    if (!json_to_rtl(json) && concls->httpcode != 400) {
+        concls->response_stream << "Invalid request:  could not convert to RTL device";
+        concls->httpcode = 400;
+    }
+
+    JSON_delete(json);
+}
+
 int Kis_RTL433_Phy::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
 
     // Anything involving POST here requires a login
@@ -380,6 +471,17 @@ int Kis_RTL433_Phy::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
 
     if (concls->url != "/phy/phyRTL433/post_sensor_json.cmd")
         return 1;
+
+    if (concls->post_streaming) {
+        // Whatever is left is the last record, or the entire JSON body
+        post_json_record(concls, concls->post_remainder);
+        concls->post_remainder.clear();
+
+        if (concls->httpcode != 400)
+            concls->response_stream << "OK";
+
+        return 1;
+    }
    
     if (concls->variable_cache.find("obj") != concls->variable_cache.end()) {
         struct JSON_value *json;
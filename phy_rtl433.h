@@ -422,6 +422,12 @@ public:
 
     virtual int Httpd_PostComplete(Kis_Net_Httpd_Connection *concls);
 
+    // Sensor records posted directly as JSON (one record) or newline-delimited
+    // JSON (any number of records) are handled as they arrive
+    virtual bool Httpd_UseStreamingPost(Kis_Net_Httpd_Connection *concls);
+    virtual void Httpd_PostData(Kis_Net_Httpd_Connection *concls,
+            const char *data, size_t size);
+
 protected:
     shared_ptr<Packetchain> packetchain;
     shared_ptr<EntryTracker> entrytracker;
@@ -438,6 +444,10 @@ protected:
     // if we can't do anything with it
     bool json_to_rtl(struct JSON_value *in_json);
 
+    // Parse and handle one posted JSON record, flagging the request as bad
+    // if it fails
+    void post_json_record(Kis_Net_Httpd_Connection *concls, const string &in_record);
+
     double f_to_c(double f);
 
 };
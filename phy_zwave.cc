@@ -44,6 +44,8 @@ Kis_Zwave_Phy::Kis_Zwave_Phy(GlobalRegistry *in_globalreg,
     shared_ptr<zwave_tracked_device> builder(new zwave_tracked_device(globalreg, 0));
     zwave_device_id =
         entrytracker->RegisterField("zwave.device", builder, "Z-Wave Device");
+
+    Httpd_RegisterRoute("POST", "/phy/phyZwave/post_zwave_json.cmd");
 }
 
 Kis_Zwave_Phy::~Kis_Zwave_Phy() {
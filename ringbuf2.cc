@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <algorithm>
 
 #include "util.h"
 #include "ringbuf2.h"
@@ -181,3 +182,25 @@ size_t RingbufV2::peek(void *ptr, size_t in_sz) {
     return 0;
 }
 
+size_t RingbufV2::zero_copy_peek(uint8_t **ptr, size_t in_sz) {
+    local_locker lock(&buffer_locker);
+
+    // No matter what is requested we can't peek more than we have
+    size_t opsize = used_nl();
+
+    if (opsize > in_sz)
+        opsize = in_sz;
+
+    // Rotate wrapped data to the start of the buffer so it can be handed out
+    // in one piece.  This happens at most once each time the data wraps, and
+    // only touches our own buffer.
+    if (start_pos + opsize > buffer_sz) {
+        std::rotate(buffer, buffer + start_pos, buffer + buffer_sz);
+        start_pos = 0;
+    }
+
+    *ptr = buffer + start_pos;
+
+    return opsize;
+}
+
@@ -54,6 +54,13 @@ public:
     // Return the amount of data actually peeked
     size_t peek(void *in_data, size_t in_sz);
 
+    // Peek data from a buffer, up to sz, without copying it.  in_data is set
+    // to a contiguous view of the data in the buffer; if the data wraps around
+    // the end of the buffer it is first moved to the start.  The view is valid
+    // until the data is consumed or peeked again; writes don't disturb it.
+    // Return the amount of data in the view
+    size_t zero_copy_peek(uint8_t **in_data, size_t in_sz);
+
 protected:
     // Mutex for all operations on the buffer
     pthread_mutex_t buffer_locker;
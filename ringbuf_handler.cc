@@ -149,6 +149,33 @@ size_t RingbufferHandler::PeekWriteBufferData(void *in_ptr, size_t in_sz) {
     return 0;
 }
 
+size_t RingbufferHandler::ZeroCopyPeekReadBufferData(void **in_ptr, size_t in_sz) {
+    local_locker lock(&handler_locker);
+
+    if (read_buffer)
+        return read_buffer->zero_copy_peek((uint8_t **) in_ptr, in_sz);
+
+    return 0;
+}
+
+size_t RingbufferHandler::ConsumeReadBufferData(size_t in_sz) {
+    local_locker lock(&handler_locker);
+
+    if (read_buffer)
+        return read_buffer->read(NULL, in_sz);
+
+    return 0;
+}
+
+size_t RingbufferHandler::ConsumeWriteBufferData(size_t in_sz) {
+    local_locker lock(&handler_locker);
+
+    if (write_buffer)
+        return write_buffer->read(NULL, in_sz);
+
+    return 0;
+}
+
 size_t RingbufferHandler::PutReadBufferData(void *in_ptr, size_t in_sz, 
         bool in_atomic) {
     size_t ret;
@@ -62,6 +62,11 @@ public:
     size_t PeekReadBufferData(void *in_ptr, size_t in_sz);
     size_t PeekWriteBufferData(void *in_ptr, size_t in_sz);
 
+    // Fetch a contiguous view of read buffer data, up to in_sz, without copying
+    // or consuming it.  The view is valid until the data is consumed.
+    // Returns amount in the view
+    size_t ZeroCopyPeekReadBufferData(void **in_ptr, size_t in_sz);
+
     // Consume data w/out copying it (used to flag data we previously peeked)
     size_t ConsumeReadBufferData(size_t in_sz);
     size_t ConsumeWriteBufferData(size_t in_sz);
@@ -60,6 +60,19 @@ Systemmonitor::Systemmonitor(GlobalRegistry *in_globalreg) :
 
     timer_id = 
         globalreg->timetracker->RegisterTimer(0, &trigger_tm, 0, this);
+
+    httpd_client_vec_id =
+        globalreg->entrytracker->RegisterField("kismet.httpd.client_list",
+                TrackerVector, "webserver clients");
+
+    shared_ptr<tracked_httpd_client> client_builder(new tracked_httpd_client(globalreg, 0));
+
+    httpd_client_entry_id =
+        globalreg->entrytracker->RegisterField("kismet.httpd.client",
+                client_builder, "webserver client");
+
+    Httpd_RegisterRoute("GET", "/system/status.*");
+    Httpd_RegisterRoute("GET", "/system/http_clients.*");
 }
 
 Systemmonitor::~Systemmonitor() {
@@ -212,23 +225,78 @@ bool Systemmonitor::Httpd_VerifyPath(const char *path, const char *method) {
     if (strcmp(path, "/system/status.json") == 0)
         return true;
 
+    string stripped = Httpd_StripSuffix(path);
+
+    if (stripped == "/system/http_clients" && Httpd_CanSerialize(path))
+        return true;
+
     return false;
 }
 
+uint64_t Systemmonitor::Httpd_ContentGeneration(const char *path, const char *method) {
+    if (strcmp(method, "GET") != 0)
+        return 0;
+
+    // Client statistics change with every request, including this one
+    if (strcmp(path, "/system/status.msgpack") != 0 && 
+            strcmp(path, "/system/status.json") != 0)
+        return 0;
+
+    return globalreg->timestamp.tv_sec;
+}
+
 void Systemmonitor::Httpd_CreateStreamResponse(
-        Kis_Net_Httpd *httpd __attribute__((unused)),
-        Kis_Net_Httpd_Connection *connection __attribute__((unused)),
+        Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection,
         const char *path, const char *method, 
         const char *upload_data __attribute__((unused)),
         size_t *upload_data_size __attribute__((unused)), 
         std::stringstream &stream) {
 
-    local_locker lock(&monitor_mutex);
-
     if (strcmp(method, "GET") != 0) {
         return;
     }
 
+    if (Httpd_StripSuffix(path) == "/system/http_clients") {
+        // Client addresses aren't for anyone who can reach the server; ask
+        // for a login the same way the server would
+        if (!httpd->HasValidSession(connection, false)) {
+            connection->httpcode = MHD_HTTP_UNAUTHORIZED;
+            connection->response_headers[MHD_HTTP_HEADER_WWW_AUTHENTICATE] =
+                "Basic realm=\"Kismet Admin\"";
+            connection->response_headers["Content-Type"] = "text/plain";
+            stream << "Login required";
+            return;
+        }
+
+        vector<Kis_Net_Httpd_Client> clients;
+        httpd->GetClientStats(clients);
+
+        SharedTrackerElement clientvec =
+            globalreg->entrytracker->GetTrackedInstance(httpd_client_vec_id);
+
+        for (vector<Kis_Net_Httpd_Client>::iterator i = clients.begin();
+                i != clients.end(); ++i) {
+            shared_ptr<tracked_httpd_client> c(new tracked_httpd_client(globalreg,
+                        httpd_client_entry_id));
+
+            c->set_key(i->key);
+            c->set_address(i->address);
+            c->set_requests(i->requests);
+            c->set_rejected(i->rejected);
+            c->set_cpu_usec(i->cpu_usec);
+            c->set_bytes(i->bytes);
+            c->set_last_time(i->last_time);
+
+            clientvec->add_vector(c);
+        }
+
+        Httpd_Serialize(path, stream, clientvec);
+        return;
+    }
+
+    local_locker lock(&monitor_mutex);
+
     if (strcmp(path, "/system/status.msgpack") == 0) {
         MsgpackAdapter::Pack(globalreg, stream, 
             static_pointer_cast<Systemmonitor>(globalreg->FetchGlobal("SYSTEM_MONITOR")));
@@ -30,6 +30,83 @@
 #include "devicetracker.h"
 #include "kis_net_microhttpd.h"
 
+// Request accounting for a single webserver client
+class tracked_httpd_client : public tracker_component {
+public:
+    tracked_httpd_client(GlobalRegistry *in_globalreg, int in_id) :
+        tracker_component(in_globalreg, in_id) {
+        register_fields();
+        reserve_fields(NULL);
+    }
+
+    tracked_httpd_client(GlobalRegistry *in_globalreg, int in_id, 
+            SharedTrackerElement e) :
+        tracker_component(in_globalreg, in_id) {
+        register_fields();
+        reserve_fields(e);
+    }
+
+    virtual SharedTrackerElement clone_type() {
+        return SharedTrackerElement(new tracked_httpd_client(globalreg, get_id()));
+    }
+
+    __Proxy(key, string, string, string, key);
+    __Proxy(address, string, string, string, address);
+    __Proxy(requests, uint64_t, uint64_t, uint64_t, requests);
+    __Proxy(rejected, uint64_t, uint64_t, uint64_t, rejected);
+    __Proxy(cpu_usec, uint64_t, uint64_t, uint64_t, cpu_usec);
+    __Proxy(bytes, uint64_t, uint64_t, uint64_t, bytes);
+    __Proxy(last_time, uint64_t, time_t, time_t, last_time);
+
+protected:
+    virtual void register_fields() {
+        tracker_component::register_fields();
+
+        key_id =
+            RegisterField("kismet.httpd.client.key", TrackerString,
+                    "client session hash or address", &key);
+        address_id =
+            RegisterField("kismet.httpd.client.address", TrackerString,
+                    "last address of client", &address);
+        requests_id =
+            RegisterField("kismet.httpd.client.requests", TrackerUInt64,
+                    "requests admitted", &requests);
+        rejected_id =
+            RegisterField("kismet.httpd.client.rejected", TrackerUInt64,
+                    "requests rejected by the rate limit", &rejected);
+        cpu_usec_id =
+            RegisterField("kismet.httpd.client.cpu_usec", TrackerUInt64,
+                    "CPU time spent on requests, in usec", &cpu_usec);
+        bytes_id =
+            RegisterField("kismet.httpd.client.bytes", TrackerUInt64,
+                    "response bytes sent", &bytes);
+        last_time_id =
+            RegisterField("kismet.httpd.client.last_time", TrackerUInt64,
+                    "time of last request", &last_time);
+    }
+
+    SharedTrackerElement key;
+    int key_id;
+
+    SharedTrackerElement address;
+    int address_id;
+
+    SharedTrackerElement requests;
+    int requests_id;
+
+    SharedTrackerElement rejected;
+    int rejected_id;
+
+    SharedTrackerElement cpu_usec;
+    int cpu_usec_id;
+
+    SharedTrackerElement bytes;
+    int bytes_id;
+
+    SharedTrackerElement last_time;
+    int last_time_id;
+};
+
 class Systemmonitor : public tracker_component, public Kis_Net_Httpd_Stream_Handler,
     public LifetimeGlobal, public TimetrackerEvent {
 public:
@@ -53,6 +130,9 @@ public:
             const char *url, const char *method, const char *upload_data,
             size_t *upload_data_size, std::stringstream &stream);
 
+    // Status is refreshed once a second
+    virtual uint64_t Httpd_ContentGeneration(const char *url, const char *method);
+
     __Proxy(battery_perc, int32_t, int32_t, int32_t, battery_perc);
     __Proxy(battery_charging, string, string, string, battery_charging);
     __Proxy(battery_ac, uint8_t, bool, bool, battery_ac);
@@ -108,6 +188,8 @@ protected:
     shared_ptr<kis_tracked_rrd<> > devices_rrd;
 
     long mem_per_page;
+
+    int httpd_client_vec_id, httpd_client_entry_id;
 };
 
 #endif
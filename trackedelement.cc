@@ -20,6 +20,11 @@
 
 #include <vector>
 #include <stdexcept>
+#include <unordered_set>
+#include <set>
+#include <cstddef>
+
+#include <pthread.h>
 
 #include "util.h"
 
@@ -29,10 +34,61 @@
 
 #include "alphanum.hpp"
 
+// Backing store for the string pool; built on first use so that it exists before
+// any statically constructed elements need it
+struct tracker_string_pool {
+    tracker_string_pool() {
+        pthread_mutex_init(&pool_mutex, NULL);
+    }
+
+    pthread_mutex_t pool_mutex;
+
+    // Nodes in an unordered_set are stable across rehashing, so we can safely
+    // hand out pointers to the contained strings
+    std::unordered_set<string> pool;
+};
+
+static tracker_string_pool *get_string_pool() {
+    static tracker_string_pool *p = new tracker_string_pool();
+    return p;
+}
+
+const string *TrackerStringPool::Intern(const string& in_str) {
+    if (in_str.length() > TRACKER_STRINGPOOL_MAXLEN)
+        return NULL;
+
+    tracker_string_pool *p = get_string_pool();
+
+    local_locker lock(&(p->pool_mutex));
+
+    std::unordered_set<string>::iterator i = p->pool.find(in_str);
+
+    if (i != p->pool.end())
+        return &(*i);
+
+    if (p->pool.size() >= TRACKER_STRINGPOOL_MAX)
+        return NULL;
+
+    return &(*(p->pool.insert(in_str).first));
+}
+
+size_t TrackerStringPool::Size() {
+    tracker_string_pool *p = get_string_pool();
+
+    local_locker lock(&(p->pool_mutex));
+
+    return p->pool.size();
+}
+
 void TrackerElement::Initialize() {
     this->type = TrackerUnassigned;
     reference_count = 0;
 
+    string_interned = false;
+
+    // A new element is new to every reader holding a current token
+    update_generation = global_generation.load(std::memory_order_relaxed);
+
     set_id(-1);
 
     // Redundant I guess
@@ -63,6 +119,102 @@ void TrackerElement::Initialize() {
 
 }
 
+TrackerArena *TrackerArena::create(size_t in_size) {
+    return new TrackerArena(in_size);
+}
+
+TrackerArena::TrackerArena(size_t in_size) {
+    refs = 1;
+    block = new uint8_t[in_size];
+    size = in_size;
+    used = 0;
+}
+
+TrackerArena::~TrackerArena() {
+    delete[] block;
+}
+
+void TrackerArena::ref() {
+    refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TrackerArena::unref() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+}
+
+void *TrackerArena::allocate(size_t in_sz) {
+    // Keep everything aligned for any type
+    size_t align = sizeof(std::max_align_t);
+    in_sz = (in_sz + align - 1) & ~(align - 1);
+
+    if (size - used < in_sz)
+        return NULL;
+
+    void *r = block + used;
+    used += in_sz;
+
+    return r;
+}
+
+static thread_local TrackerArena *tracker_arena_current = NULL;
+
+TrackerArenaScope::TrackerArenaScope(TrackerArena *in_arena) {
+    prev = tracker_arena_current;
+    tracker_arena_current = in_arena;
+}
+
+TrackerArenaScope::~TrackerArenaScope() {
+    tracker_arena_current = prev;
+}
+
+TrackerArena *TrackerArenaScope::current() {
+    return tracker_arena_current;
+}
+
+// Every element is prefixed with the arena it came from (or NULL for the heap),
+// padded to keep the element aligned
+union tracker_alloc_header {
+    TrackerArena *arena;
+    std::max_align_t align;
+};
+
+void *TrackerElement::operator new(size_t sz) {
+    TrackerArena *arena = tracker_arena_current;
+    tracker_alloc_header *hdr = NULL;
+
+    if (arena != NULL) {
+        hdr = (tracker_alloc_header *) 
+            arena->allocate(sizeof(tracker_alloc_header) + sz);
+
+        if (hdr != NULL)
+            arena->ref();
+        else
+            arena = NULL;
+    }
+
+    // Outgrew the arena, or no arena at all
+    if (hdr == NULL)
+        hdr = (tracker_alloc_header *) 
+            ::operator new(sizeof(tracker_alloc_header) + sz);
+
+    hdr->arena = arena;
+
+    return hdr + 1;
+}
+
+void TrackerElement::operator delete(void *p) {
+    if (p == NULL)
+        return;
+
+    tracker_alloc_header *hdr = ((tracker_alloc_header *) p) - 1;
+
+    if (hdr->arena != NULL)
+        hdr->arena->unref();
+    else
+        ::operator delete(hdr);
+}
+
 TrackerElement::TrackerElement(TrackerType type) {
     Initialize();
     set_type(type);
@@ -91,7 +243,8 @@ TrackerElement::~TrackerElement() {
     } else if (type == TrackerDoubleMap) {
         delete dataunion.subdoublemap_value;
     } else if (type == TrackerString) {
-        delete(dataunion.string_value);
+        if (!string_interned)
+            delete(dataunion.string_value);
     } else if (type == TrackerMac) {
         delete(dataunion.mac_value);
     } else if (type == TrackerUuid) {
@@ -131,8 +284,10 @@ void TrackerElement::set_type(TrackerType in_type) {
         delete(dataunion.uuid_value);
         dataunion.uuid_value = NULL;
     } else if (type == TrackerString && dataunion.string_value != NULL) {
-        delete(dataunion.string_value);
+        if (!string_interned)
+            delete(dataunion.string_value);
         dataunion.string_value = NULL;
+        string_interned = false;
     } else if (type == TrackerByteArray && dataunion.bytearray_value != NULL) {
         delete(dataunion.bytearray_value);
         dataunion.bytearray_value = NULL;
@@ -165,7 +320,98 @@ void TrackerElement::set_type(TrackerType in_type) {
     }
 }
 
+std::atomic<uint64_t> TrackerElement::global_generation(1);
+thread_local unsigned int TrackerElement::quiet_depth = 0;
+
+uint64_t TrackerElement::next_generation() {
+    return ++global_generation;
+}
+
+uint64_t TrackerElement::current_generation() {
+    return global_generation.load();
+}
+
+bool TrackerElement::modified_since(uint64_t gen) {
+    if (update_generation >= gen)
+        return true;
+
+    // Containers aren't re-stamped when a child changes in place, so look
+    // at the children
+    switch (type) {
+        case TrackerMap:
+            for (map_iterator i = dataunion.submap_value->begin();
+                    i != dataunion.submap_value->end(); ++i) {
+                if (i->second != NULL && i->second->modified_since(gen))
+                    return true;
+            }
+            break;
+        case TrackerIntMap:
+            for (int_map_iterator i = dataunion.subintmap_value->begin();
+                    i != dataunion.subintmap_value->end(); ++i) {
+                if (i->second != NULL && i->second->modified_since(gen))
+                    return true;
+            }
+            break;
+        case TrackerMacMap:
+            for (mac_map_iterator i = dataunion.submacmap_value->begin();
+                    i != dataunion.submacmap_value->end(); ++i) {
+                if (i->second != NULL && i->second->modified_since(gen))
+                    return true;
+            }
+            break;
+        case TrackerStringMap:
+            for (string_map_iterator i = dataunion.substringmap_value->begin();
+                    i != dataunion.substringmap_value->end(); ++i) {
+                if (i->second != NULL && i->second->modified_since(gen))
+                    return true;
+            }
+            break;
+        case TrackerDoubleMap:
+            for (double_map_iterator i = dataunion.subdoublemap_value->begin();
+                    i != dataunion.subdoublemap_value->end(); ++i) {
+                if (i->second != NULL && i->second->modified_since(gen))
+                    return true;
+            }
+            break;
+        case TrackerVector:
+            for (vector_iterator i = dataunion.subvector_value->begin();
+                    i != dataunion.subvector_value->end(); ++i) {
+                if (*i != NULL && (*i)->modified_since(gen))
+                    return true;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+void TrackerElement::set_interned(const string& v) {
+    except_type_mismatch(TrackerString);
+
+    // Most updates re-set the same value; don't touch the pool if nothing changed
+    if (string_interned && *(dataunion.string_value) == v)
+        return;
+
+    mark_updated();
+
+    const string *pooled = TrackerStringPool::Intern(v);
+
+    if (pooled == NULL) {
+        set(v);
+        return;
+    }
+
+    if (!string_interned)
+        delete(dataunion.string_value);
+
+    dataunion.string_value = const_cast<string *>(pooled);
+    string_interned = true;
+}
+
 TrackerElement& TrackerElement::operator++(int) {
+    mark_updated();
     switch (type) {
         case TrackerInt8:
             dataunion.int8_value++;
@@ -205,6 +451,7 @@ TrackerElement& TrackerElement::operator++(int) {
 }
 
 TrackerElement& TrackerElement::operator--(int) {
+    mark_updated();
     switch (type) {
         case TrackerInt8:
             dataunion.int8_value--;
@@ -244,6 +491,7 @@ TrackerElement& TrackerElement::operator--(int) {
 }
 
 TrackerElement& TrackerElement::operator+=(const float& v) {
+    mark_updated();
     switch (type) {
         case TrackerFloat:
             dataunion.float_value+= v;
@@ -259,6 +507,7 @@ TrackerElement& TrackerElement::operator+=(const float& v) {
 }
 
 TrackerElement& TrackerElement::operator+=(const double& v) {
+    mark_updated();
     switch (type) {
         case TrackerFloat:
             dataunion.float_value+= v;
@@ -274,6 +523,7 @@ TrackerElement& TrackerElement::operator+=(const double& v) {
 }
 
 TrackerElement& TrackerElement::operator+=(const int& v) {
+    mark_updated();
     switch (type) {
         case TrackerInt8:
             dataunion.int8_value += v;
@@ -313,6 +563,7 @@ TrackerElement& TrackerElement::operator+=(const int& v) {
 }
 
 TrackerElement& TrackerElement::operator+=(const unsigned int& v) {
+    mark_updated();
     switch (type) {
         case TrackerInt8:
             dataunion.int8_value += v;
@@ -353,17 +604,20 @@ TrackerElement& TrackerElement::operator+=(const unsigned int& v) {
 
 TrackerElement& TrackerElement::operator+=(const int64_t& i) {
     except_type_mismatch(TrackerInt64);
+    mark_updated();
     dataunion.int64_value += i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator+=(const uint64_t& i) {
     except_type_mismatch(TrackerUInt64);
+    mark_updated();
     dataunion.uint64_value += i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator-=(const int& v) {
+    mark_updated();
     switch (type) {
         case TrackerInt8:
             dataunion.int8_value -= v;
@@ -403,6 +657,7 @@ TrackerElement& TrackerElement::operator-=(const int& v) {
 }
 
 TrackerElement& TrackerElement::operator-=(const unsigned int& v) {
+    mark_updated();
     switch (type) {
         case TrackerInt8:
             dataunion.int8_value -= v;
@@ -442,6 +697,7 @@ TrackerElement& TrackerElement::operator-=(const unsigned int& v) {
 }
 
 TrackerElement& TrackerElement::operator-=(const float& v) {
+    mark_updated();
     switch (type) {
         case TrackerFloat:
             dataunion.float_value-= v;
@@ -457,6 +713,7 @@ TrackerElement& TrackerElement::operator-=(const float& v) {
 }
 
 TrackerElement& TrackerElement::operator-=(const double& v) {
+    mark_updated();
     switch (type) {
         case TrackerFloat:
             dataunion.float_value-= v;
@@ -473,12 +730,14 @@ TrackerElement& TrackerElement::operator-=(const double& v) {
 
 TrackerElement& TrackerElement::operator-=(const int64_t& i) {
     except_type_mismatch(TrackerInt64);
+    mark_updated();
     dataunion.int64_value -= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator-=(const uint64_t& i) {
     except_type_mismatch(TrackerUInt64);
+    mark_updated();
     dataunion.uint64_value -= i;
     return *this;
 }
@@ -486,144 +745,168 @@ TrackerElement& TrackerElement::operator-=(const uint64_t& i) {
 
 TrackerElement& TrackerElement::operator|=(int8_t i) {
     except_type_mismatch(TrackerInt8);
+    mark_updated();
     dataunion.int8_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator|=(uint8_t i) {
     except_type_mismatch(TrackerUInt8);
+    mark_updated();
     dataunion.uint8_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator|=(int16_t i) {
     except_type_mismatch(TrackerInt16);
+    mark_updated();
     dataunion.int16_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator|=(uint16_t i) {
     except_type_mismatch(TrackerUInt16);
+    mark_updated();
     dataunion.uint16_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator|=(int32_t i) {
     except_type_mismatch(TrackerInt32);
+    mark_updated();
     dataunion.int32_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator|=(uint32_t i) {
     except_type_mismatch(TrackerUInt32);
+    mark_updated();
     dataunion.uint32_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator|=(int64_t i) {
     except_type_mismatch(TrackerInt64);
+    mark_updated();
     dataunion.int64_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator|=(uint64_t i) {
     except_type_mismatch(TrackerUInt64);
+    mark_updated();
     dataunion.uint64_value |= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(int8_t i) {
     except_type_mismatch(TrackerInt8);
+    mark_updated();
     dataunion.int8_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(uint8_t i) {
     except_type_mismatch(TrackerUInt8);
+    mark_updated();
     dataunion.uint8_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(int16_t i) {
     except_type_mismatch(TrackerInt16);
+    mark_updated();
     dataunion.int16_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(uint16_t i) {
     except_type_mismatch(TrackerUInt16);
+    mark_updated();
     dataunion.uint16_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(int32_t i) {
     except_type_mismatch(TrackerInt32);
+    mark_updated();
     dataunion.int32_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(uint32_t i) {
     except_type_mismatch(TrackerUInt32);
+    mark_updated();
     dataunion.uint32_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(int64_t i) {
     except_type_mismatch(TrackerInt64);
+    mark_updated();
     dataunion.int64_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator&=(uint64_t i) {
     except_type_mismatch(TrackerUInt64);
+    mark_updated();
     dataunion.uint64_value &= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(int8_t i) {
     except_type_mismatch(TrackerInt8);
+    mark_updated();
     dataunion.int8_value ^= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(uint8_t i) {
     except_type_mismatch(TrackerUInt8);
+    mark_updated();
     dataunion.uint8_value ^= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(int16_t i) {
     except_type_mismatch(TrackerInt16);
+    mark_updated();
     dataunion.int16_value ^= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(uint16_t i) {
     except_type_mismatch(TrackerUInt16);
+    mark_updated();
     dataunion.uint16_value ^= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(int32_t i) {
     except_type_mismatch(TrackerInt32);
+    mark_updated();
     dataunion.int32_value ^= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(uint32_t i) {
     except_type_mismatch(TrackerUInt32);
+    mark_updated();
     dataunion.uint32_value ^= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(int64_t i) {
     except_type_mismatch(TrackerInt64);
+    mark_updated();
     dataunion.int64_value ^= i;
     return *this;
 }
 
 TrackerElement& TrackerElement::operator^=(uint64_t i) {
     except_type_mismatch(TrackerUInt64);
+    mark_updated();
     dataunion.uint64_value ^= i;
     return *this;
 }
@@ -708,12 +991,14 @@ TrackerElement::mac_map_iterator TrackerElement::mac_find(mac_addr k) {
 
 void TrackerElement::add_macmap(mac_addr i, shared_ptr<TrackerElement> s) {
     except_type_mismatch(TrackerMacMap);
+    mark_updated();
 
     (*dataunion.submacmap_value)[i] = s;
 }
 
 void TrackerElement::del_macmap(mac_addr f) {
     except_type_mismatch(TrackerMacMap);
+    mark_updated();
 
     mac_map_iterator mi = dataunion.submacmap_value->find(f);
     if (mi != dataunion.submacmap_value->end()) {
@@ -723,12 +1008,14 @@ void TrackerElement::del_macmap(mac_addr f) {
 
 void TrackerElement::del_macmap(mac_map_iterator i) {
     except_type_mismatch(TrackerMacMap);
+    mark_updated();
 
     dataunion.submacmap_value->erase(i);
 }
 
 void TrackerElement::clear_macmap() {
     except_type_mismatch(TrackerMacMap);
+    mark_updated();
 
     dataunion.submacmap_value->clear();
 }
@@ -741,6 +1028,7 @@ size_t TrackerElement::size_macmap() {
 
 void TrackerElement::insert_macmap(mac_map_pair p) {
     except_type_mismatch(TrackerMacMap);
+    mark_updated();
 
     dataunion.submacmap_value->insert(p);
 }
@@ -777,12 +1065,14 @@ TrackerElement::string_map_iterator TrackerElement::string_find(string k) {
 
 void TrackerElement::add_stringmap(string i, shared_ptr<TrackerElement> s) {
     except_type_mismatch(TrackerStringMap);
+    mark_updated();
 
     (*dataunion.substringmap_value)[i] = s;
 }
 
 void TrackerElement::del_stringmap(string f) {
     except_type_mismatch(TrackerStringMap);
+    mark_updated();
 
     string_map_iterator mi = dataunion.substringmap_value->find(f);
     if (mi != dataunion.substringmap_value->end()) {
@@ -792,12 +1082,14 @@ void TrackerElement::del_stringmap(string f) {
 
 void TrackerElement::del_stringmap(string_map_iterator i) {
     except_type_mismatch(TrackerStringMap);
+    mark_updated();
 
     dataunion.substringmap_value->erase(i);
 }
 
 void TrackerElement::clear_stringmap() {
     except_type_mismatch(TrackerStringMap);
+    mark_updated();
 
     dataunion.substringmap_value->clear();
 }
@@ -810,6 +1102,7 @@ size_t TrackerElement::size_stringmap() {
 
 void TrackerElement::insert_stringmap(string_map_pair p) {
     except_type_mismatch(TrackerStringMap);
+    mark_updated();
 
     dataunion.substringmap_value->insert(p);
 }
@@ -846,12 +1139,14 @@ TrackerElement::double_map_iterator TrackerElement::double_find(double k) {
 
 void TrackerElement::add_doublemap(double i, shared_ptr<TrackerElement> s) {
     except_type_mismatch(TrackerDoubleMap);
+    mark_updated();
 
     (*dataunion.subdoublemap_value)[i] = s;
 }
 
 void TrackerElement::del_doublemap(double f) {
     except_type_mismatch(TrackerDoubleMap);
+    mark_updated();
 
     double_map_iterator mi = dataunion.subdoublemap_value->find(f);
     if (mi != dataunion.subdoublemap_value->end()) {
@@ -861,12 +1156,14 @@ void TrackerElement::del_doublemap(double f) {
 
 void TrackerElement::del_doublemap(double_map_iterator i) {
     except_type_mismatch(TrackerDoubleMap);
+    mark_updated();
 
     dataunion.subdoublemap_value->erase(i);
 }
 
 void TrackerElement::clear_doublemap() {
     except_type_mismatch(TrackerDoubleMap);
+    mark_updated();
 
     for (double_map_iterator i = dataunion.subdoublemap_value->begin();
             i != dataunion.subdoublemap_value->end(); ++i) {
@@ -877,6 +1174,7 @@ void TrackerElement::clear_doublemap() {
 
 void TrackerElement::insert_doublemap(double_map_pair p) {
     except_type_mismatch(TrackerDoubleMap);
+    mark_updated();
 
     dataunion.subdoublemap_value->insert(p);
 }
@@ -936,18 +1234,21 @@ string TrackerElement::type_to_string(TrackerType t) {
 
 void TrackerElement::add_map(int f, shared_ptr<TrackerElement> s) {
     except_type_mismatch(TrackerMap);
+    mark_updated();
 
     dataunion.submap_value->emplace(f, s);
 }
 
 void TrackerElement::add_map(shared_ptr<TrackerElement> s) {
     except_type_mismatch(TrackerMap);
+    mark_updated();
 
     dataunion.submap_value->emplace(s->get_id(), s);
 }
 
 void TrackerElement::del_map(int f) {
     except_type_mismatch(TrackerMap);
+    mark_updated();
 
     map_iterator i = dataunion.submap_value->find(f);
     if (i != dataunion.submap_value->end()) {
@@ -961,17 +1262,20 @@ void TrackerElement::del_map(shared_ptr<TrackerElement> e) {
 
 void TrackerElement::del_map(map_iterator i) {
     except_type_mismatch(TrackerMap);
+    mark_updated();
     dataunion.submap_value->erase(i);
 }
 
 void TrackerElement::insert_map(tracked_pair p) {
     except_type_mismatch(TrackerMap);
+    mark_updated();
 
     dataunion.submap_value->insert(p);
 }
 
 void TrackerElement::clear_map() {
     except_type_mismatch(TrackerMap);
+    mark_updated();
     
     dataunion.submap_value->clear();
 }
@@ -1014,6 +1318,7 @@ TrackerElement::int_map_iterator TrackerElement::int_find(int k) {
 
 void TrackerElement::clear_intmap() {
     except_type_mismatch(TrackerIntMap);
+    mark_updated();
 
     dataunion.subintmap_value->clear();
 }
@@ -1026,18 +1331,21 @@ size_t TrackerElement::size_intmap() {
 
 void TrackerElement::insert_intmap(int_map_pair p) {
     except_type_mismatch(TrackerIntMap);
+    mark_updated();
 
     dataunion.subintmap_value->insert(p);
 }
 
 void TrackerElement::add_intmap(int i, shared_ptr<TrackerElement> s) {
     except_type_mismatch(TrackerIntMap);
+    mark_updated();
 
     (*dataunion.subintmap_value)[i] = s;
 }
 
 void TrackerElement::del_intmap(int i) {
     except_type_mismatch(TrackerIntMap);
+    mark_updated();
 
     int_map_iterator itr = dataunion.subintmap_value->find(i);
     if (itr != dataunion.subintmap_value->end()) {
@@ -1047,18 +1355,21 @@ void TrackerElement::del_intmap(int i) {
 
 void TrackerElement::del_intmap(int_map_iterator i) {
     except_type_mismatch(TrackerIntMap);
+    mark_updated();
 
     dataunion.subintmap_value->erase(i);
 }
 
 void TrackerElement::add_vector(shared_ptr<TrackerElement> s) {
     except_type_mismatch(TrackerVector);
+    mark_updated();
 
     dataunion.subvector_value->push_back(s);
 }
 
 void TrackerElement::del_vector(unsigned int p) {
     except_type_mismatch(TrackerVector);
+    mark_updated();
 
     if (p > dataunion.subvector_value->size()) {
         string w = "del_vector out of range (" + IntToString(p) + ", vector " + 
@@ -1073,12 +1384,14 @@ void TrackerElement::del_vector(unsigned int p) {
 
 void TrackerElement::del_vector(vector_iterator i) {
     except_type_mismatch(TrackerVector);
+    mark_updated();
 
     dataunion.subvector_value->erase(i);
 }
 
 void TrackerElement::clear_vector() {
     except_type_mismatch(TrackerVector);
+    mark_updated();
 
     dataunion.subvector_value->clear();
 }
@@ -1091,6 +1404,7 @@ size_t TrackerElement::size_vector() {
 
 void TrackerElement::set_bytearray(uint8_t *d, size_t len) {
     except_type_mismatch(TrackerByteArray);
+    mark_updated();
 
     dataunion.bytearray_value->reset(new uint8_t[len], std::default_delete<uint8_t[]>());
     memcpy(dataunion.bytearray_value->get(), d, len);
@@ -1099,6 +1413,7 @@ void TrackerElement::set_bytearray(uint8_t *d, size_t len) {
 
 void TrackerElement::set_bytearray(shared_ptr<uint8_t> d, size_t len) {
     except_type_mismatch(TrackerByteArray);
+    mark_updated();
 
     *(dataunion.bytearray_value) = d;
     bytearray_value_len = len;
@@ -1183,6 +1498,78 @@ template<> mac_addr GetTrackerValue(shared_ptr<TrackerElement> e) {
     return e->get_mac();
 }
 
+// Typed storage access is checked regardless of TE_TYPE_SAFETY; it only happens
+// when a TrackedValue is bound, and a mismatch would otherwise scribble over 
+// the wrong union member
+static void except_value_ptr_mismatch(TrackerType is, TrackerType want) {
+    if (is != want) {
+        string w = "element type mismatch, is " + 
+            TrackerElement::type_to_string(is) + " tried to bind as " + 
+            TrackerElement::type_to_string(want);
+        throw std::runtime_error(w);
+    }
+}
+
+template<> int8_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerInt8);
+    return &(dataunion.int8_value);
+}
+
+template<> uint8_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerUInt8);
+    return &(dataunion.uint8_value);
+}
+
+template<> int16_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerInt16);
+    return &(dataunion.int16_value);
+}
+
+template<> uint16_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerUInt16);
+    return &(dataunion.uint16_value);
+}
+
+template<> int32_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerInt32);
+    return &(dataunion.int32_value);
+}
+
+template<> uint32_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerUInt32);
+    return &(dataunion.uint32_value);
+}
+
+template<> int64_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerInt64);
+    return &(dataunion.int64_value);
+}
+
+template<> uint64_t *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerUInt64);
+    return &(dataunion.uint64_value);
+}
+
+template<> float *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerFloat);
+    return &(dataunion.float_value);
+}
+
+template<> double *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerDouble);
+    return &(dataunion.double_value);
+}
+
+template<> mac_addr *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerMac);
+    return dataunion.mac_value;
+}
+
+template<> uuid *TrackerElement::get_value_ptr() {
+    except_value_ptr_mismatch(type, TrackerUuid);
+    return dataunion.uuid_value;
+}
+
 template<> TrackerElement::tracked_map *GetTrackerValue(shared_ptr<TrackerElement> e) {
     return e->get_map();
 }
@@ -1330,6 +1717,10 @@ bool operator<(TrackerElement &te1, TrackerElement &te2) {
             return te1.get_double() < te2.get_double();
             break;
         case TrackerString:
+            // Two pooled instances of the same string are always equal
+            if (te1.is_interned() && te2.is_interned() &&
+                    te1.dataunion.string_value == te2.dataunion.string_value)
+                return false;
             return doj::alphanum_comp(te1.get_string(), te2.get_string()) < 0;
         case TrackerMac:
             return te1.get_mac() < te2.get_mac();
@@ -1380,6 +1771,9 @@ bool operator<(SharedTrackerElement te1, SharedTrackerElement te2) {
             return te1->get_double() < te2->get_double();
             break;
         case TrackerString:
+            if (te1->is_interned() && te2->is_interned() &&
+                    te1->dataunion.string_value == te2->dataunion.string_value)
+                return false;
             return doj::alphanum_comp(te1->get_string(), te2->get_string()) < 0;
         case TrackerMac:
             return te1->get_mac() < te2->get_mac();
@@ -1508,7 +1902,8 @@ void tracker_component::reserve_fields(shared_ptr<TrackerElement> e) {
 
         if (rf->assign != NULL) {
             *(rf->assign) = import_or_new(e, rf->id);
-        } else {
+        } else if (rf->typed_assign != NULL) {
+            rf->typed_assign->bind(import_or_new(e, rf->id));
         }
     }
 }
@@ -1606,6 +2001,8 @@ TrackerElementSummary::TrackerElementSummary(SharedElementSummary in_c) {
     parent_element = in_c->parent_element;
     resolved_path = in_c->resolved_path;
     rename = in_c->rename;
+    field_name = in_c->field_name;
+    path_name = in_c->path_name;
 }
 
 TrackerElementSummary::TrackerElementSummary(string in_path, string in_rename,
@@ -1656,12 +2053,22 @@ void TrackerElementSummary::parse_path(vector<string> in_path, string in_rename,
             path_full = false;
 
         resolved_path.push_back(id);
+
+        if (path_name.length() != 0)
+            path_name += "/";
+        path_name += in_path[x];
     }
 
+    // Nothing but separators; leave it unresolved for the caller to reject
+    if (resolved_path.size() == 0)
+        return;
+
     if (!path_full) {
         rename = in_path[in_path.size() - 1];
     } else {
         rename = in_rename;
+        field_name = 
+            entrytracker->GetFieldName(resolved_path[resolved_path.size() - 1]);
     }
 }
 
@@ -1987,14 +2394,14 @@ std::vector<SharedTrackerElement> GetTrackerElementMultiPath(std::vector<int> in
 
 void SummarizeTrackerElement(shared_ptr<EntryTracker> entrytracker,
         SharedTrackerElement in, 
-        vector<SharedElementSummary> in_summarization, 
+        const vector<SharedElementSummary>& in_summarization, 
         SharedTrackerElement &ret_elem, 
         TrackerElementSerializer::rename_map &rename_map) {
 
     unsigned int fn = 0;
     ret_elem.reset(new TrackerElement(TrackerMap));
 
-    for (vector<SharedElementSummary>::iterator si = in_summarization.begin();
+    for (vector<SharedElementSummary>::const_iterator si = in_summarization.begin();
             si != in_summarization.end(); ++si) {
         fn++;
 
@@ -2005,14 +2412,13 @@ void SummarizeTrackerElement(shared_ptr<EntryTracker> entrytracker,
             GetTrackerElementPath((*si)->resolved_path, in);
 
         if (f == NULL) {
-            f = entrytracker->RegisterAndGetField("unknown" + IntToString(fn),
-                    TrackerInt8, "unallocated field");
-
             f = SharedTrackerElement(new TrackerElement(TrackerUInt8));
             f->set((uint8_t) 0);
         
             if ((*si)->rename.length() != 0) {
                 f->set_local_name((*si)->rename);
+            } else if ((*si)->field_name.length() != 0) {
+                f->set_local_name((*si)->field_name);
             } else {
                 // Get the last name of the field in the path, if we can...
                 int lastid = (*si)->resolved_path[(*si)->resolved_path.size() - 1];
@@ -2039,3 +2445,63 @@ void SummarizeTrackerElement(shared_ptr<EntryTracker> entrytracker,
     }
 }
 
+static SharedTrackerElement project_tracker_element(SharedTrackerElement in,
+        const vector<const vector<int> *> &in_exclude, unsigned int in_depth) {
+
+    if (in == NULL || in->get_type() != TrackerMap)
+        return in;
+
+    // Fields dropped at this level, and exclusions which descend into a child
+    set<int> drop;
+    map<int, vector<const vector<int> *> > descend;
+
+    for (unsigned int x = 0; x < in_exclude.size(); x++) {
+        int id = (*(in_exclude[x]))[in_depth];
+
+        if (in_exclude[x]->size() == in_depth + 1)
+            drop.insert(id);
+        else
+            descend[id].push_back(in_exclude[x]);
+    }
+
+    // The copy is serialized in place of the original, so anything the
+    // original does before serialization has to happen now
+    in->pre_serialize();
+
+    SharedTrackerElement ret(new TrackerElement(TrackerMap, in->get_id()));
+    ret->set_local_name(in->get_local_name());
+
+    for (TrackerElement::map_iterator i = in->begin(); i != in->end(); ++i) {
+        if (drop.find(i->first) != drop.end())
+            continue;
+
+        map<int, vector<const vector<int> *> >::iterator di = descend.find(i->first);
+
+        if (di == descend.end())
+            ret->add_map(i->first, i->second);
+        else
+            ret->add_map(i->first, 
+                    project_tracker_element(i->second, di->second, in_depth + 1));
+    }
+
+    // Building the copy stamped it as new; it has to look exactly as changed
+    // as the original or a delta would send every projected map
+    ret->set_update_generation(in->get_update_generation());
+
+    return ret;
+}
+
+SharedTrackerElement ProjectTrackerElement(SharedTrackerElement in,
+        const vector<vector<int> > &in_exclude) {
+    vector<const vector<int> *> exclude;
+
+    for (unsigned int x = 0; x < in_exclude.size(); x++) {
+        if (in_exclude[x].size() != 0)
+            exclude.push_back(&(in_exclude[x]));
+    }
+
+    if (exclude.size() == 0)
+        return in;
+
+    return project_tracker_element(in, exclude, 0);
+}
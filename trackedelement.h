@@ -31,6 +31,7 @@
 #include <map>
 
 #include <memory>
+#include <atomic>
 
 #include "macaddr.h"
 #include "uuid.h"
@@ -58,6 +59,31 @@ class TrackerElement;
 
 typedef std::shared_ptr<TrackerElement> SharedTrackerElement;
 
+// Maximum number of unique strings held in the global intern pool, and the 
+// longest string we'll consider interning.  Once the pool is full, new strings
+// are stored privately in the element as normal.
+#define TRACKER_STRINGPOOL_MAX      65536
+#define TRACKER_STRINGPOOL_MAXLEN   128
+
+// Global, thread-safe pool of immutable strings shared between tracked elements.
+//
+// Huge numbers of devices carry identical strings (manufacturers, phy names, 
+// channels, crypt descriptions); interned string elements reference a single
+// copy held here instead of allocating their own.
+//
+// Pooled strings are never freed; the pool is bounded by TRACKER_STRINGPOOL_MAX.
+// Only intern values from a small set; anything taken from the air, such as
+// SSIDs, could fill the pool and stop interning for the rest of the run.
+class TrackerStringPool {
+public:
+    // Return a pointer to the pooled instance of this string, or NULL if the
+    // string can't be interned (too long, or the pool is full)
+    static const string *Intern(const string& in_str);
+
+    // Number of unique strings in the pool
+    static size_t Size();
+};
+
 // Types of fields we can track and automatically resolve
 // Statically assigned type numbers which MUST NOT CHANGE as things go forwards for 
 // binary/fast serialization, new types must be added to the end of the list
@@ -105,6 +131,53 @@ enum TrackerType {
     TrackerByteArray = 19,
 };
 
+// Default size of a per-record allocation arena.  Elements which don't fit in
+// the arena are allocated from the heap as normal.  Sized for what is built 
+// along with a new device:  the base record and its fields come to about
+// 3.8KB on 64-bit systems, and a dot11 record about 2.6KB more.
+#define TRACKER_ARENA_SIZE      8192
+
+// Bump allocator for the elements of a single record, such as a device and its
+// phy sub-records.  Building a record inside a TrackerArenaScope places the
+// TrackerElements it creates contiguously; freeing an element only releases
+// its reference to the arena, and the whole block is returned at once when
+// the last element is gone.  Elements are still individually destructed and
+// reference-counted, so they may safely outlive the record which built them.
+class TrackerArena {
+public:
+    // Returns an arena holding one reference for the caller
+    static TrackerArena *create(size_t in_size = TRACKER_ARENA_SIZE);
+
+    void ref();
+    void unref();
+
+    // Allocate from the arena; returns NULL when the arena is exhausted
+    void *allocate(size_t in_sz);
+
+protected:
+    TrackerArena(size_t in_size);
+    ~TrackerArena();
+
+    std::atomic<unsigned int> refs;
+
+    uint8_t *block;
+    size_t size, used;
+};
+
+// Direct TrackerElement allocations made on this thread into an arena for the
+// lifetime of the scope.  Scopes nest.
+class TrackerArenaScope {
+public:
+    TrackerArenaScope(TrackerArena *in_arena);
+    ~TrackerArenaScope();
+
+    // Arena for the current thread, or NULL
+    static TrackerArena *current();
+
+protected:
+    TrackerArena *prev;
+};
+
 class TrackerElement {
 public:
     TrackerElement() {
@@ -116,6 +189,10 @@ public:
 
     virtual ~TrackerElement();
 
+    // Allocate from the arena of the current TrackerArenaScope, if any
+    static void *operator new(size_t sz);
+    static void operator delete(void *p);
+
     void Initialize();
 
     // Factory-style for easily making more of the same if we're subclassed
@@ -134,6 +211,44 @@ public:
     // Called prior to serialization output
     virtual void pre_serialize() { }
 
+    // Update generations.  Every mutation stamps the element with the current
+    // global generation; a reader takes a token with next_generation() and can
+    // later ask for only the elements changed at or after that token
+    static uint64_t next_generation();
+    static uint64_t current_generation();
+
+    uint64_t get_update_generation() {
+        return update_generation;
+    }
+
+    void mark_updated() {
+        if (quiet_depth == 0)
+            update_generation = global_generation.load(std::memory_order_relaxed);
+    }
+
+    // Changes made on this thread while a quiet_scope is alive aren't stamped.
+    // For bookkeeping which doesn't change what an element says, like an RRD
+    // catching up to the current time before it's serialized
+    class quiet_scope {
+    public:
+        quiet_scope() { quiet_depth++; }
+        ~quiet_scope() { quiet_depth--; }
+    };
+
+    // Carry another element's generation, for copies which stand in for it
+    void set_update_generation(uint64_t in_gen) {
+        update_generation = in_gen;
+    }
+
+    // Has this element, or anything contained in it, changed at or after
+    // generation gen?
+    bool modified_since(uint64_t gen);
+
+    // Direct pointer to the value storage of a scalar element, type-checked 
+    // once here.  Used by TrackedValue to skip the per-access type checks; the 
+    // pointer is valid as long as the element exists and its type isn't changed.
+    template<typename T> T *get_value_ptr();
+
     int get_id() {
         return tracked_id;
     }
@@ -300,67 +415,97 @@ public:
     // Overloaded set
     void set(string v) {
         except_type_mismatch(TrackerString);
+        mark_updated();
+
+        // Never write through to a pooled string; go back to a private copy
+        if (string_interned) {
+            dataunion.string_value = new string(v);
+            string_interned = false;
+            return;
+        }
+
         *(dataunion.string_value) = v;
     }
 
+    // Set a string value which is likely to be repeated across many elements;
+    // the element references a shared copy from the TrackerStringPool.  Serializers
+    // and getters see a normal TrackerString.
+    void set_interned(const string& v);
+
+    bool is_interned() {
+        return string_interned;
+    }
+
     void set(uint8_t v) {
         except_type_mismatch(TrackerUInt8);
+        mark_updated();
         dataunion.uint8_value = v;
     }
 
     void set(int8_t v) {
         except_type_mismatch(TrackerInt8);
+        mark_updated();
         dataunion.int8_value = v;
     }
 
     void set(uint16_t v) {
         except_type_mismatch(TrackerUInt16);
+        mark_updated();
         dataunion.uint16_value = v;
     }
 
     void set(int16_t v) {
         except_type_mismatch(TrackerInt16);
+        mark_updated();
         dataunion.int16_value = v;
     }
 
     void set(uint32_t v) {
         except_type_mismatch(TrackerUInt32);
+        mark_updated();
         dataunion.uint32_value = v;
     }
 
     void set(int32_t v) {
         except_type_mismatch(TrackerInt32);
+        mark_updated();
         dataunion.int32_value = v;
     }
 
     void set(uint64_t v) {
         except_type_mismatch(TrackerUInt64);
+        mark_updated();
         dataunion.uint64_value = v;
     }
 
     void set(int64_t v) {
         except_type_mismatch(TrackerInt64);
+        mark_updated();
         dataunion.int64_value = v;
     }
 
     void set(float v) {
         except_type_mismatch(TrackerFloat);
+        mark_updated();
         dataunion.float_value = v;
     }
 
     void set(double v) {
         except_type_mismatch(TrackerDouble);
+        mark_updated();
         dataunion.double_value = v;
     }
 
     void set(mac_addr v) {
         except_type_mismatch(TrackerMac);
+        mark_updated();
         // mac has overrided =
         *(dataunion.mac_value) = v;
     }
 
     void set(uuid v) {
         except_type_mismatch(TrackerUuid);
+        mark_updated();
         // uuid has overrided =
         *(dataunion.uuid_value) = v;
     }
@@ -572,6 +717,18 @@ protected:
 
     size_t bytearray_value_len;
 
+    // String value is owned by the TrackerStringPool and must not be freed
+    // or modified
+    bool string_interned;
+
+    // Generation of the last mutation
+    uint64_t update_generation;
+
+    static std::atomic<uint64_t> global_generation;
+
+    // Depth of quiet_scopes on this thread
+    static thread_local unsigned int quiet_depth;
+
     // We could make these all one type, but then we'd have odd interactions
     // with incrementing and I'm not positive that's safe in all cases
     union du {
@@ -940,6 +1097,132 @@ template<> map<int, shared_ptr<TrackerElement> >
 template<> vector<shared_ptr<TrackerElement> > 
     GetTrackerValue(shared_ptr<TrackerElement> e);
 
+template<> int8_t *TrackerElement::get_value_ptr();
+template<> uint8_t *TrackerElement::get_value_ptr();
+template<> int16_t *TrackerElement::get_value_ptr();
+template<> uint16_t *TrackerElement::get_value_ptr();
+template<> int32_t *TrackerElement::get_value_ptr();
+template<> uint32_t *TrackerElement::get_value_ptr();
+template<> int64_t *TrackerElement::get_value_ptr();
+template<> uint64_t *TrackerElement::get_value_ptr();
+template<> float *TrackerElement::get_value_ptr();
+template<> double *TrackerElement::get_value_ptr();
+template<> mac_addr *TrackerElement::get_value_ptr();
+template<> uuid *TrackerElement::get_value_ptr();
+
+// Map C++ value types to the TrackerType they're stored as
+template<typename T> struct TrackerTypeTraits;
+template<> struct TrackerTypeTraits<int8_t> { static const TrackerType type = TrackerInt8; };
+template<> struct TrackerTypeTraits<uint8_t> { static const TrackerType type = TrackerUInt8; };
+template<> struct TrackerTypeTraits<int16_t> { static const TrackerType type = TrackerInt16; };
+template<> struct TrackerTypeTraits<uint16_t> { static const TrackerType type = TrackerUInt16; };
+template<> struct TrackerTypeTraits<int32_t> { static const TrackerType type = TrackerInt32; };
+template<> struct TrackerTypeTraits<uint32_t> { static const TrackerType type = TrackerUInt32; };
+template<> struct TrackerTypeTraits<int64_t> { static const TrackerType type = TrackerInt64; };
+template<> struct TrackerTypeTraits<uint64_t> { static const TrackerType type = TrackerUInt64; };
+template<> struct TrackerTypeTraits<float> { static const TrackerType type = TrackerFloat; };
+template<> struct TrackerTypeTraits<double> { static const TrackerType type = TrackerDouble; };
+template<> struct TrackerTypeTraits<mac_addr> { static const TrackerType type = TrackerMac; };
+template<> struct TrackerTypeTraits<uuid> { static const TrackerType type = TrackerUuid; };
+
+// Untyped base so tracker_component can bind typed fields during reserve_fields
+class TrackedValueBase {
+public:
+    virtual ~TrackedValueBase() { }
+
+    virtual TrackerType get_tracker_type() const = 0;
+    virtual void bind(shared_ptr<TrackerElement> in_elem) = 0;
+};
+
+// Statically typed handle to a scalar TrackerElement.
+//
+// Components on the per-packet path can hold a TrackedValue instead of a 
+// SharedTrackerElement; the element type is checked once when the field is 
+// bound, and reads and writes after that are plain loads and stores on the 
+// element storage (plus the update generation stamp).  The element itself is
+// still a normal TrackerElement in the component map, so serialization and
+// path lookups are unchanged.
+template<typename T>
+class TrackedValue : public TrackedValueBase {
+public:
+    TrackedValue() : value(NULL) { }
+
+    virtual TrackerType get_tracker_type() const {
+        return TrackerTypeTraits<T>::type;
+    }
+
+    virtual void bind(shared_ptr<TrackerElement> in_elem) {
+        value = in_elem->get_value_ptr<T>();
+        elem = in_elem;
+    }
+
+    shared_ptr<TrackerElement> get_element() const {
+        return elem;
+    }
+
+    const T& get() const {
+        return *value;
+    }
+
+    void set(const T& in) {
+        *value = in;
+        elem->mark_updated();
+    }
+
+    TrackedValue<T>& operator++(int) {
+        (*value)++;
+        elem->mark_updated();
+        return *this;
+    }
+
+    TrackedValue<T>& operator--(int) {
+        (*value)--;
+        elem->mark_updated();
+        return *this;
+    }
+
+    TrackedValue<T>& operator+=(const T& in) {
+        *value += in;
+        elem->mark_updated();
+        return *this;
+    }
+
+    TrackedValue<T>& operator-=(const T& in) {
+        *value -= in;
+        elem->mark_updated();
+        return *this;
+    }
+
+    TrackedValue<T>& operator|=(const T& in) {
+        *value |= in;
+        elem->mark_updated();
+        return *this;
+    }
+
+    TrackedValue<T>& operator&=(const T& in) {
+        *value &= in;
+        elem->mark_updated();
+        return *this;
+    }
+
+protected:
+    shared_ptr<TrackerElement> elem;
+    T *value;
+};
+
+typedef TrackedValue<int8_t> TrackedInt8;
+typedef TrackedValue<uint8_t> TrackedUInt8;
+typedef TrackedValue<int16_t> TrackedInt16;
+typedef TrackedValue<uint16_t> TrackedUInt16;
+typedef TrackedValue<int32_t> TrackedInt32;
+typedef TrackedValue<uint32_t> TrackedUInt32;
+typedef TrackedValue<int64_t> TrackedInt64;
+typedef TrackedValue<uint64_t> TrackedUInt64;
+typedef TrackedValue<float> TrackedFloat;
+typedef TrackedValue<double> TrackedDouble;
+typedef TrackedValue<mac_addr> TrackedMac;
+typedef TrackedValue<uuid> TrackedUuid;
+
 // Complex trackable unit based on trackertype dataunion.
 //
 // All tracker_components are built from maps.
@@ -986,6 +1269,19 @@ class tracker_component : public TrackerElement {
         cvar->set((stype) in); \
     } 
 
+// Proxy a string value which should be stored in the global string pool; 
+// see TrackerElement::set_interned
+#define __ProxyInterned(name, cvar) \
+    virtual shared_ptr<TrackerElement> get_tracker_##name() { \
+        return (shared_ptr<TrackerElement>) cvar; \
+    } \
+    virtual string get_##name() const { \
+        return GetTrackerValue<string>(cvar); \
+    } \
+    virtual void set_##name(string in) { \
+        cvar->set_interned(in); \
+    }
+
 // Proxy increment and decrement functions
 #define __ProxyIncDec(name, ptype, rtype, cvar) \
     virtual void inc_##name() { \
@@ -1049,6 +1345,46 @@ class tracker_component : public TrackerElement {
         return (dtype) (GetTrackerValue<dtype>(cvar) & bs); \
     }
 
+// Proxies for TrackedValue fields; same functions as __Proxy, __ProxyGet,
+// __ProxyIncDec and __ProxyAddSub without the per-call type checks
+#define __ProxyTyped(name, itype, rtype, cvar) \
+    virtual shared_ptr<TrackerElement> get_tracker_##name() { \
+        return cvar.get_element(); \
+    } \
+    virtual rtype get_##name() const { \
+        return (rtype) cvar.get(); \
+    } \
+    virtual void set_##name(itype in) { \
+        cvar.set(in); \
+    }
+
+#define __ProxyTypedGet(name, rtype, cvar) \
+    virtual rtype get_##name() { \
+        return (rtype) cvar.get(); \
+    } 
+
+#define __ProxyTypedIncDec(name, rtype, cvar) \
+    virtual void inc_##name() { \
+        cvar++; \
+    } \
+    virtual void inc_##name(rtype i) { \
+        cvar += i; \
+    } \
+    virtual void dec_##name() { \
+        cvar--; \
+    } \
+    virtual void dec_##name(rtype i) { \
+        cvar -= i; \
+    }
+
+#define __ProxyTypedAddSub(name, itype, cvar) \
+    virtual void add_##name(itype i) { \
+        cvar += i; \
+    } \
+    virtual void sub_##name(itype i) { \
+        cvar -= i; \
+    }
+
 #define __RegisterComplexField(type, id, name, description) \
     shared_ptr< type > builder_##id(new type(globalreg, 0)); \
     id = RegisterComplexField(name, builder_##id, description);
@@ -1099,6 +1435,17 @@ protected:
     int RegisterField(string in_name, shared_ptr<TrackerElement> in_builder, 
             string in_desc, shared_ptr<TrackerElement> *in_dest);
 
+    // Reserve a statically typed field; the TrackedValue is bound to the new or
+    // imported element during the reservefields stage
+    template<typename T>
+    int RegisterField(string in_name, string in_desc, TrackedValue<T> *in_dest) {
+        int id = RegisterField(in_name, TrackerTypeTraits<T>::type, in_desc);
+
+        registered_fields.push_back(new registered_field(id, in_dest));
+
+        return id;
+    }
+
     // Reserve a complex via the entrytracker, using standard entrytracker build methods.
     // This field will NOT be automatically assigned or built during the reservefields 
     // stage, callers should manually create these fields, importing from the parent
@@ -1127,10 +1474,18 @@ protected:
             registered_field(int id, shared_ptr<TrackerElement> *assign) { 
                 this->id = id; 
                 this->assign = assign;
+                this->typed_assign = NULL;
+            }
+
+            registered_field(int id, TrackedValueBase *typed_assign) {
+                this->id = id;
+                this->assign = NULL;
+                this->typed_assign = typed_assign;
             }
 
             int id;
             shared_ptr<TrackerElement> *assign;
+            TrackedValueBase *typed_assign;
     };
 
     GlobalRegistry *globalreg;
@@ -1165,6 +1520,13 @@ public:
     vector<int> resolved_path;
     string rename;
 
+    // Registered name of the final field in the path, resolved once when the
+    // summary is built so that summarizing doesn't look it up per record
+    string field_name;
+
+    // Path as it was requested, for reporting fields which don't resolve
+    string path_name;
+
 protected:
     void parse_path(vector<string> in_path, string in_rename, 
             shared_ptr<EntryTracker> entrytracker);
@@ -1183,6 +1545,45 @@ public:
     virtual void serialize(shared_ptr<TrackerElement> in_elem, 
             std::stringstream &stream, rename_map *name_map = NULL) = 0;
 
+    // Serialize only the portions of in_elem modified at or after generation
+    // 'since'; keyed maps omit unchanged children.  Serializers which don't
+    // understand deltas emit the complete element.
+    virtual void serialize_delta(shared_ptr<TrackerElement> in_elem,
+            std::stringstream &stream, uint64_t since, 
+            rename_map *name_map = NULL) {
+        serialize(in_elem, stream, name_map);
+    }
+
+    // Streaming responses emit a vector one element at a time, bracketed by
+    // the framing the serializer would have written around a TrackerVector.
+    // Elements and framing are appended straight onto the contiguous chunk
+    // which is handed to the response.  Serializers which can't frame a
+    // vector incrementally return false from can_stream_vector and are sent
+    // as a single complete document.
+    virtual bool can_stream_vector() {
+        return false;
+    }
+
+    virtual void stream_serialize(shared_ptr<TrackerElement> in_elem, string &out,
+            rename_map *name_map = NULL) {
+        std::stringstream stream;
+        serialize(in_elem, stream, name_map);
+        out.append(stream.str());
+    }
+
+    virtual void stream_vector_open(string &out __attribute__((unused)),
+            size_t in_size __attribute__((unused))) { }
+    virtual void stream_vector_separator(string &out __attribute__((unused))) { }
+    virtual void stream_vector_close(string &out __attribute__((unused))) { }
+
+    // Should a child of a keyed map be left out of a delta since 'since'
+    static bool delta_skip(shared_ptr<TrackerElement> in_elem, uint64_t since) {
+        if (since == 0)
+            return false;
+
+        return in_elem == NULL || !in_elem->modified_since(since);
+    }
+
     // Fields extracted from a summary path need to preserialize their parent
     // paths or updates may not happen in the expected fashion, serializers should
     // call this when necessary
@@ -1226,9 +1627,16 @@ std::vector<SharedTrackerElement> GetTrackerElementMultiPath(std::vector<int> in
 // completed in rename.
 void SummarizeTrackerElement(shared_ptr<EntryTracker> entrytracker,
         SharedTrackerElement in, 
-        vector<SharedElementSummary> in_summarization, 
+        const vector<SharedElementSummary>& in_summarization, 
         SharedTrackerElement &ret_elem, 
         TrackerElementSerializer::rename_map &rename_map);
 
+// Remove sub-trees from a record.  Each exclusion is a resolved field ID path;
+// the maps along the path are replaced by shallow copies which omit the final
+// field, and everything else is shared with the original record.  Excluded
+// fields are never visited when the result is serialized.
+SharedTrackerElement ProjectTrackerElement(SharedTrackerElement in,
+        const vector<vector<int> > &in_exclude);
+
 
 #endif
@@ -1229,6 +1229,114 @@ std::string MultiReplaceAll(std::string in, std::string match,
     return in;
 }
 
+std::atomic<bool> local_locker_stats::enabled(false);
+std::atomic<uint64_t> local_locker_stats::contended(0);
+std::atomic<uint64_t> local_locker_stats::wait_usec(0);
+
+kis_recursive_rwlock::kis_recursive_rwlock() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    // The default prefers readers and would let overlapping readers starve
+    // a writer indefinitely
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&rwlock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    writer.store(std::thread::id());
+    write_depth = 0;
+}
+
+kis_recursive_rwlock::~kis_recursive_rwlock() {
+    pthread_rwlock_destroy(&rwlock);
+}
+
+// Count a contended wait in the local_locker stats when they're enabled
+static void kis_rwlock_waited(bool timed, struct timespec &start) {
+    if (!timed)
+        return;
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    local_locker_stats::contended++;
+    local_locker_stats::wait_usec += 
+        (end.tv_sec - start.tv_sec) * 1000000 + 
+        (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+void kis_recursive_rwlock::lock() {
+    if (writer.load() == std::this_thread::get_id()) {
+        write_depth++;
+        return;
+    }
+
+    if (pthread_rwlock_trywrlock(&rwlock) != 0) {
+        struct timespec start;
+        bool timed = local_locker_stats::enabled.load(std::memory_order_relaxed);
+
+        if (timed)
+            clock_gettime(CLOCK_MONOTONIC, &start);
+
+#ifdef HAVE_PTHREAD_TIMELOCK
+        struct timespec t;
+
+        clock_gettime(CLOCK_REALTIME , &t); 
+        t.tv_sec += 5;
+
+        if (pthread_rwlock_timedwrlock(&rwlock, &t) != 0) {
+            throw(std::runtime_error("rwlock not available w/in 5 seconds"));
+        }
+#else
+        pthread_rwlock_wrlock(&rwlock);
+#endif
+
+        kis_rwlock_waited(timed, start);
+    }
+
+    writer.store(std::this_thread::get_id());
+    write_depth = 1;
+}
+
+void kis_recursive_rwlock::unlock() {
+    if (--write_depth != 0)
+        return;
+
+    writer.store(std::thread::id());
+    pthread_rwlock_unlock(&rwlock);
+}
+
+void kis_recursive_rwlock::lock_shared() {
+    // The writer already excludes everyone else
+    if (writer.load() == std::this_thread::get_id()) {
+        write_depth++;
+        return;
+    }
+
+    if (pthread_rwlock_tryrdlock(&rwlock) == 0)
+        return;
+
+    struct timespec start;
+    bool timed = local_locker_stats::enabled.load(std::memory_order_relaxed);
+
+    if (timed)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_rwlock_rdlock(&rwlock);
+
+    kis_rwlock_waited(timed, start);
+}
+
+void kis_recursive_rwlock::unlock_shared() {
+    if (writer.load() == std::this_thread::get_id()) {
+        unlock();
+        return;
+    }
+
+    pthread_rwlock_unlock(&rwlock);
+}
+
 string kis_strerror_r(int errnum) {
     char *d_errstr = new char[1024];
     string rs;
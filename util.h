@@ -45,6 +45,8 @@
 #include <sstream>
 #include <iomanip>
 #include <stdexcept>
+#include <atomic>
+#include <thread>
 
 #include <pthread.h>
 
@@ -268,12 +270,32 @@ int GetLengthTagOffsets(unsigned int init_offset,
 						kis_datachunk *in_chunk,
 						map<int, vector<int> > *tag_cache_map);
 
+// Contention counters for local_locker, across all mutexes.  Only gathered
+// when enabled, by benchmarking tools; an uncontended lock never looks at them.
+class local_locker_stats {
+public:
+    static std::atomic<bool> enabled;
+    static std::atomic<uint64_t> contended;
+    static std::atomic<uint64_t> wait_usec;
+};
+
 // Act as a scoped locker on a mutex
 // If possible, use a timed lock and throw a system exception if we can't
 // acquire the mutex within 5 seconds, so that we crash instead of hanging
 class local_locker {
 public:
     local_locker(pthread_mutex_t *in) {
+        lock = in;
+
+        if (pthread_mutex_trylock(in) == 0)
+            return;
+
+        struct timespec start;
+        bool timed = local_locker_stats::enabled.load(std::memory_order_relaxed);
+
+        if (timed)
+            clock_gettime(CLOCK_MONOTONIC, &start);
+
 #ifdef HAVE_PTHREAD_TIMELOCK
         struct timespec t;
 
@@ -286,7 +308,16 @@ public:
 #else
         pthread_mutex_lock(in);
 #endif
-        lock = in;
+
+        if (timed) {
+            struct timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            local_locker_stats::contended++;
+            local_locker_stats::wait_usec += 
+                (end.tv_sec - start.tv_sec) * 1000000 + 
+                (end.tv_nsec - start.tv_nsec) / 1000;
+        }
     }
 
     ~local_locker() {
@@ -296,6 +327,47 @@ protected:
     pthread_mutex_t *lock;
 };
 
+// Reader/writer lock with a recursive write side, for data guarded by a
+// recursive mutex which also has readers that can run alongside each other.
+// The write lock behaves like the mutex it replaces, including the 5 second
+// timeout of local_locker, and a thread holding it may also take the read
+// lock.  Read locks must not be nested.  Writers are preferred where the
+// platform supports it so a stream of readers can't hold them off.  Waits
+// are counted in local_locker_stats.
+class kis_recursive_rwlock {
+public:
+    kis_recursive_rwlock();
+    ~kis_recursive_rwlock();
+
+    void lock();
+    void unlock();
+
+    void lock_shared();
+    void unlock_shared();
+
+protected:
+    pthread_rwlock_t rwlock;
+
+    // Thread holding the write lock and how many times it has taken it
+    std::atomic<std::thread::id> writer;
+    unsigned int write_depth;
+};
+
+// Hold the read side of a kis_recursive_rwlock for the scope
+class local_shared_locker {
+public:
+    local_shared_locker(kis_recursive_rwlock *in) {
+        lock = in;
+        lock->lock_shared();
+    }
+
+    ~local_shared_locker() {
+        lock->unlock_shared();
+    }
+protected:
+    kis_recursive_rwlock *lock;
+};
+
 // Local copy of strerror_r because glibc did such an amazingly poor job of it
 string kis_strerror_r(int errnum);
 
@@ -64,10 +64,20 @@ void XmlserializeAdapter::XmlSerialize(SharedTrackerElement v,
 
     unsigned int tvi;
 
-    string name = globalreg->entrytracker->GetFieldName(v->get_id());
+    const TrackerFieldToken *token = globalreg->entrytracker->GetFieldToken(v->get_id());
+
+    string name, lower_name;
+
+    if (token != NULL) {
+        name = token->name;
+        lower_name = token->lower_name;
+    } else {
+        name = globalreg->entrytracker->GetFieldName(v->get_id());
+        lower_name = StrLower(name);
+    }
 
     map<string, Xmladapter *>::iterator mi = 
-        field_adapter_map.find(StrLower(name));
+        field_adapter_map.find(lower_name);
 
     if (mi == field_adapter_map.end()) {
         fprintf(stderr, "debug - xmlserialize no xml field for %s\n", name.c_str());